@@ -0,0 +1,313 @@
+#include "Animation.hpp"
+
+#include "SceneFile.hpp"
+#include "read_write_chunk.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ANIMATION_SSE
+#endif
+
+AnimationClips::AnimationClips(std::string const &filename) {
+	std::ifstream file(filename, std::ios::binary);
+	if (!file) {
+		throw std::runtime_error("Failed to open animation file '" + filename + "'");
+	}
+
+	std::vector< char > strings;
+	read_chunk(file, "str0", &strings);
+
+	std::vector< SceneFile::ClipEntry > clip_entries;
+	read_chunk(file, "anm0", &clip_entries);
+
+	std::vector< SceneFile::TrackEntry > track_entries;
+	read_chunk(file, "trk0", &track_entries);
+
+	read_chunk(file, "tim0", &times);
+	read_chunk(file, "key0", &values);
+
+	if (file.peek() != EOF) {
+		std::cerr << "WARNING: trailing data in animation file '" << filename << "'" << std::endl;
+	}
+
+	if (times.size() != values.size()) {
+		throw std::runtime_error("animation file '" + filename + "' has " + std::to_string(times.size()) + " keyframe times but " + std::to_string(values.size()) + " keyframe values");
+	}
+
+	auto get_name = [&](uint32_t begin, uint32_t end) -> std::string {
+		if (!(begin <= end && end <= strings.size())) {
+			throw std::runtime_error("animation file '" + filename + "' contains an entry with invalid name indices");
+		}
+		return std::string(strings.data() + begin, strings.data() + end);
+	};
+
+	tracks.reserve(track_entries.size());
+	for (auto const &t : track_entries) {
+		Track track;
+		track.target = get_name(t.name_begin, t.name_end);
+		if (t.channel >= ChannelCount) {
+			throw std::runtime_error("animation file '" + filename + "' has a track for '" + track.target + "' with unknown channel " + std::to_string(t.channel));
+		}
+		track.channel = Channel(t.channel);
+		if (!(t.key_begin < t.key_end && t.key_end <= times.size())) {
+			throw std::runtime_error("animation file '" + filename + "' has a track for '" + track.target + "' with an empty or out-of-range keyframe range");
+		}
+		for (uint32_t k = t.key_begin + 1; k < t.key_end; ++k) {
+			if (!(times[k-1] <= times[k])) {
+				throw std::runtime_error("animation file '" + filename + "' has a track for '" + track.target + "' with keyframes out of order");
+			}
+		}
+		track.begin = t.key_begin;
+		track.end = t.key_end;
+		tracks.emplace_back(track);
+	}
+
+	clips.reserve(clip_entries.size());
+	for (auto const &c : clip_entries) {
+		Clip clip;
+		clip.name = get_name(c.name_begin, c.name_end);
+		if (!(c.track_begin <= c.track_end && c.track_end <= tracks.size())) {
+			throw std::runtime_error("animation file '" + filename + "' has clip '" + clip.name + "' with out-of-range tracks");
+		}
+		clip.begin = c.track_begin;
+		clip.end = c.track_end;
+		clip.duration = std::max(0.0f, c.duration);
+		clips.emplace_back(clip);
+	}
+}
+
+AnimationClips::Clip const &AnimationClips::lookup(std::string const &name) const {
+	for (auto const &clip : clips) {
+		if (clip.name == name) return clip;
+	}
+	throw std::runtime_error("Looking up animation clip '" + name + "' that doesn't exist.");
+}
+
+//--------------------------------
+
+Animator::Handle Animator::play(AnimationClips const &clips, AnimationClips::Clip const &clip, Scene &scene, bool loop, float speed) {
+	assert(clip.begin <= clip.end && clip.end <= clips.tracks.size());
+
+	Handle handle;
+	if (!free_handles.empty()) {
+		handle = free_handles.back();
+		free_handles.pop_back();
+	} else {
+		handle = Handle(players.size());
+		players.emplace_back();
+	}
+
+	Player &player = players[handle];
+	player.playing = true;
+	player.loop = loop;
+	player.speed = speed;
+	player.duration = clip.duration;
+	player.time = (speed < 0.0f ? clip.duration : 0.0f);
+
+	for (uint32_t t = clip.begin; t < clip.end; ++t) {
+		AnimationClips::Track const &track = clips.tracks[t];
+
+		//prefer a copy-on-write override of a base transform, so the shared base is never written:
+		Scene::Transform *target = nullptr;
+		if (scene.base) {
+			if (Scene::Transform const *base_transform = scene.base->find_transform(track.target)) {
+				target = scene.override_transform(base_transform);
+			}
+		}
+		if (!target) target = scene.find_transform(track.target);
+		if (!target) {
+			std::cerr << "WARNING: animation clip '" << clip.name << "' animates '" << track.target << "', which isn't in the scene." << std::endl;
+			continue;
+		}
+
+		Batch &batch = batches[track.channel];
+		batch.player.emplace_back(handle);
+		batch.target.emplace_back(target);
+		batch.times.emplace_back(clips.times.data() + track.begin);
+		batch.values.emplace_back(clips.values.data() + track.begin);
+		batch.count.emplace_back(track.end - track.begin);
+		batch.cursor.emplace_back(0);
+	}
+
+	return handle;
+}
+
+void Animator::Batch::erase_player(Handle handle) {
+	size_t out = 0;
+	for (size_t i = 0; i < player.size(); ++i) {
+		if (player[i] == handle) continue;
+		player[out] = player[i];
+		target[out] = target[i];
+		times[out] = times[i];
+		values[out] = values[i];
+		count[out] = count[i];
+		cursor[out] = cursor[i];
+		++out;
+	}
+	player.resize(out);
+	target.resize(out);
+	times.resize(out);
+	values.resize(out);
+	count.resize(out);
+	cursor.resize(out);
+}
+
+void Animator::stop(Handle handle) {
+	assert(handle < players.size() && players[handle].playing);
+	for (auto &batch : batches) {
+		batch.erase_player(handle);
+	}
+	players[handle] = Player();
+	free_handles.emplace_back(handle);
+}
+
+float Animator::get_time(Handle handle) const {
+	assert(handle < players.size() && players[handle].playing);
+	return players[handle].time;
+}
+
+void Animator::set_time(Handle handle, float time) {
+	assert(handle < players.size() && players[handle].playing);
+	Player &player = players[handle];
+	player.time = std::max(0.0f, std::min(player.duration, time));
+}
+
+void Animator::set_speed(Handle handle, float speed) {
+	assert(handle < players.size() && players[handle].playing);
+	players[handle].speed = speed;
+}
+
+bool Animator::finished(Handle handle) const {
+	assert(handle < players.size() && players[handle].playing);
+	Player const &player = players[handle];
+	if (player.loop) return false;
+	return (player.speed >= 0.0f ? player.time >= player.duration : player.time <= 0.0f);
+}
+
+void Animator::update(float elapsed) {
+	//(1) advance clocks:
+	for (auto &player : players) {
+		if (!player.playing) continue;
+		player.time += elapsed * player.speed;
+		if (player.loop && player.duration > 0.0f) {
+			player.time = std::fmod(player.time, player.duration);
+			if (player.time < 0.0f) player.time += player.duration;
+		} else {
+			player.time = std::max(0.0f, std::min(player.duration, player.time));
+		}
+	}
+
+	for (uint32_t c = 0; c < AnimationClips::ChannelCount; ++c) {
+		Batch &batch = batches[c];
+		size_t const count = batch.player.size();
+		if (count == 0) continue;
+
+		batch.from.resize(count);
+		batch.to.resize(count);
+		batch.amount.resize(count);
+		batch.result.resize(count);
+
+		//(2) find the keyframes either side of each track's time:
+		for (size_t i = 0; i < count; ++i) {
+			float const t = players[batch.player[i]].time;
+			float const *times = batch.times[i];
+			uint32_t const n = batch.count[i];
+			uint32_t k = batch.cursor[i];
+
+			//usually time has moved forward by less than a keyframe, so check the next couple first:
+			if (times[k] <= t) {
+				if (k + 1 < n && times[k + 1] <= t) ++k;
+				if (k + 1 < n && times[k + 1] <= t) ++k;
+			}
+			//...and otherwise (looping, seeking, fast playback) search for it:
+			if (times[k] > t || (k + 1 < n && times[k + 1] <= t)) {
+				k = uint32_t(std::upper_bound(times, times + n, t) - times);
+				k = (k > 0 ? k - 1 : 0);
+			}
+			batch.cursor[i] = k;
+
+			uint32_t const next = std::min(k + 1, n - 1);
+			float const span = times[next] - times[k];
+			batch.from[i] = batch.values[i][k];
+			batch.to[i] = batch.values[i][next];
+			batch.amount[i] = (span > 0.0f ? std::max(0.0f, std::min(1.0f, (t - times[k]) / span)) : 0.0f);
+		}
+
+		//(3) interpolate all tracks at once -- straight-line loops over flat arrays:
+		glm::vec4 const *from = batch.from.data();
+		glm::vec4 const *to = batch.to.data();
+		float const *amount = batch.amount.data();
+		glm::vec4 *result = batch.result.data();
+		bool const rotation = (c == AnimationClips::Rotation);
+
+#ifdef ANIMATION_SSE
+		//each keyframe value is exactly one register:
+		static_assert(sizeof(glm::vec4) == 4 * sizeof(float), "keyframe values are packed float4s");
+		//sum of a * b in every lane:
+		auto dot4 = [](__m128 a, __m128 b) {
+			__m128 m = _mm_mul_ps(a, b);
+			m = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2,3,0,1)));
+			return _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1,0,3,2)));
+		};
+		__m128 const sign_bit = _mm_set1_ps(-0.0f);
+		for (size_t i = 0; i < count; ++i) {
+			__m128 f = _mm_loadu_ps(&from[i].x);
+			__m128 t = _mm_loadu_ps(&to[i].x);
+			if (rotation) {
+				//q and -q are the same rotation; flip 't' into the same hemisphere as 'f' for the shorter arc:
+				t = _mm_xor_ps(t, _mm_and_ps(dot4(f, t), sign_bit));
+			}
+			__m128 r = _mm_add_ps(f, _mm_mul_ps(_mm_sub_ps(t, f), _mm_set1_ps(amount[i])));
+			if (rotation) {
+				__m128 l2 = dot4(r, r);
+				//(zero-length results stay zero: the mask drops the inf from 1/0)
+				r = _mm_mul_ps(r, _mm_and_ps(_mm_cmpgt_ps(l2, _mm_setzero_ps()), _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(l2))));
+			}
+			_mm_storeu_ps(&result[i].x, r);
+		}
+#else
+		for (size_t i = 0; i < count; ++i) {
+			glm::vec4 t = to[i];
+			if (rotation) {
+				//q and -q are the same rotation; flip 't' into the same hemisphere as 'from' for the shorter arc:
+				float d = from[i].x * t.x + from[i].y * t.y + from[i].z * t.z + from[i].w * t.w;
+				float s = (d < 0.0f ? -1.0f : 1.0f);
+				t.x *= s; t.y *= s; t.z *= s; t.w *= s;
+			}
+			float a = amount[i];
+			result[i].x = from[i].x + (t.x - from[i].x) * a;
+			result[i].y = from[i].y + (t.y - from[i].y) * a;
+			result[i].z = from[i].z + (t.z - from[i].z) * a;
+			result[i].w = from[i].w + (t.w - from[i].w) * a;
+			if (rotation) {
+				float l2 = result[i].x * result[i].x + result[i].y * result[i].y + result[i].z * result[i].z + result[i].w * result[i].w;
+				float s = (l2 > 0.0f ? 1.0f / std::sqrt(l2) : 0.0f);
+				result[i].x *= s; result[i].y *= s; result[i].z *= s; result[i].w *= s;
+			}
+		}
+#endif
+
+		//(4) write to transforms:
+		Scene::Transform * const *target = batch.target.data();
+		if (c == AnimationClips::Position) {
+			for (size_t i = 0; i < count; ++i) {
+				target[i]->position = glm::vec3(result[i]);
+			}
+		} else if (c == AnimationClips::Rotation) {
+			for (size_t i = 0; i < count; ++i) {
+				target[i]->rotation = glm::quat(result[i].w, result[i].x, result[i].y, result[i].z);
+			}
+		} else { //(c == AnimationClips::Scale)
+			for (size_t i = 0; i < count; ++i) {
+				target[i]->scale = glm::vec3(result[i]);
+			}
+		}
+	}
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+/*
+ * Keyframe animation:
+ *  "AnimationClips" holds the clips of an '.anim' file (layout in SceneFile.hpp); each clip is a set
+ *   of position, rotation, and scale tracks that name the transforms they animate.
+ *  "Animator" plays any number of clips on the transforms of scenes, and evaluates all playing
+ *   tracks together in update() -- a few tight loops over flat arrays, rather than per-object calls.
+ *
+ * Tracks are interpolated linearly (rotations with normalized lerp along the shorter arc), one SSE2
+ *  register per keyframe value where available. Each track remembers which keyframe it was last
+ *  after, so ordinary playback costs O(1) per track.
+ *
+ */
+
+#include "Scene.hpp"
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+struct AnimationClips {
+	//no clips (e.g., for a level that hasn't had its animation exported):
+	AnimationClips() = default;
+
+	//load clips from a file:
+	// note: will throw if file fails to read.
+	AnimationClips(std::string const &filename);
+
+	enum Channel : uint32_t {
+		Position = 0,
+		Rotation = 1,
+		Scale = 2,
+		ChannelCount = 3,
+	};
+
+	struct Track {
+		std::string target; //name of the animated transform
+		Channel channel = Position;
+		uint32_t begin = 0, end = 0; //keyframe range in times / values (never empty)
+	};
+
+	struct Clip {
+		std::string name;
+		float duration = 0.0f; //seconds
+		uint32_t begin = 0, end = 0; //range in tracks
+	};
+
+	std::vector< Clip > clips;
+	std::vector< Track > tracks;
+	std::vector< float > times; //keyframe times (seconds)
+	std::vector< glm::vec4 > values; //keyframe values (xyz for position and scale; rotations as x,y,z,w)
+
+	//look up a clip by name:
+	// note: will throw if clip not found.
+	Clip const &lookup(std::string const &name) const;
+};
+
+struct Animator {
+	typedef uint32_t Handle;
+
+	//start playing 'clip' (from 'clips', which must outlive the playback) on the transforms of 'scene':
+	// tracks are bound to transforms by name once, here; transforms from the base of a copy-on-write
+	// scene are overridden, and tracks naming transforms that don't exist are skipped (with a warning).
+	Handle play(AnimationClips const &clips, AnimationClips::Clip const &clip, Scene &scene, bool loop = true, float speed = 1.0f);
+
+	//stop playing (transforms keep their last values; the handle may be reused by a later play()):
+	void stop(Handle handle);
+
+	//current time within the clip, in seconds (a jump is fine -- cursors find their place again):
+	float get_time(Handle handle) const;
+	void set_time(Handle handle, float time);
+
+	//playback rate (negative plays backward):
+	void set_speed(Handle handle, float speed);
+
+	//true once a non-looping clip has reached its end (or, playing backward, its start):
+	bool finished(Handle handle) const;
+
+	//advance every playing clip by 'elapsed' seconds and write all tracks to their transforms:
+	// (transforms are just written -- call Scene::update_bvh() afterward if the scene has a bvh)
+	void update(float elapsed);
+
+	//--- internals ---
+	struct Player {
+		bool playing = false;
+		bool loop = true;
+		float time = 0.0f;
+		float speed = 1.0f;
+		float duration = 0.0f;
+	};
+	std::vector< Player > players; //indexed by handle
+	std::vector< Handle > free_handles;
+
+	//bound tracks of all players, split by channel and stored as parallel arrays:
+	struct Batch {
+		std::vector< Handle > player;
+		std::vector< Scene::Transform * > target;
+		std::vector< float const * > times; //keyframes of the track (point into an AnimationClips)
+		std::vector< glm::vec4 const * > values;
+		std::vector< uint32_t > count; //number of keyframes
+		std::vector< uint32_t > cursor; //last keyframe at or before the player's time
+
+		//per-update scratch: keyframes either side of each track's time, and the mix between them:
+		std::vector< glm::vec4 > from, to;
+		std::vector< float > amount;
+		std::vector< glm::vec4 > result;
+
+		void erase_player(Handle handle);
+	} batches[AnimationClips::ChannelCount];
+};
@@ -0,0 +1,284 @@
+#include "ClusteredLights.hpp"
+
+#include "FrameUniforms.hpp"
+#include "gl_errors.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+Load< ClusteredLights > clustered_lights(LoadTagEarly);
+
+char const *ClusteredLights::GLSL =
+	"layout(std140) uniform Clusters {\n"
+	"	mat4 WORLD_TO_VIEW;\n"
+	"	uvec4 CLUSTER_COUNT;\n"
+	"	vec4 CLUSTER_SCALE;\n"
+	"};\n"
+	"uniform usamplerBuffer CLUSTERS;\n" //(first index, count) per cluster
+	"uniform usamplerBuffer LIGHT_INDICES;\n"
+	"uniform samplerBuffer LIGHTS;\n" //(position, distance), (energy, is spot), (direction, cos cutoff) per light
+	"vec3 cluster_lighting(vec3 world_position, vec3 n) {\n"
+	"	float depth = -(WORLD_TO_VIEW * vec4(world_position, 1.0)).z;\n"
+	"	uvec3 c;\n"
+	"	c.xy = uvec2(gl_FragCoord.xy / CLUSTER_SCALE.xy);\n"
+	"	c.z = uint(max(0.0, log(max(depth, 1e-6)) * CLUSTER_SCALE.z + CLUSTER_SCALE.w));\n"
+	"	c = min(c, CLUSTER_COUNT.xyz - uvec3(1u));\n"
+	"	int cluster = int((c.z * CLUSTER_COUNT.y + c.y) * CLUSTER_COUNT.x + c.x);\n"
+	"	uvec2 range = texelFetch(CLUSTERS, cluster).xy;\n"
+	"	vec3 e = vec3(0.0);\n"
+	"	for (uint i = 0u; i < range.y; ++i) {\n"
+	"		int light = 3 * int(texelFetch(LIGHT_INDICES, int(range.x + i)).x);\n"
+	"		vec4 position = texelFetch(LIGHTS, light);\n"
+	"		vec4 energy = texelFetch(LIGHTS, light + 1);\n"
+	"		vec3 l = position.xyz - world_position;\n"
+	"		float dis2 = dot(l,l);\n"
+	"		float range2 = position.w * position.w;\n"
+	"		if (dis2 >= range2) continue;\n"
+	"		l *= inversesqrt(max(dis2, 1e-8));\n"
+	"		float fade = 1.0 - dis2 / range2;\n" //(fall off to zero at the light's distance)
+	"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2) * fade * fade;\n"
+	"		if (energy.w != 0.0) { //spot light\n"
+	"			vec4 direction = texelFetch(LIGHTS, light + 2);\n"
+	"			nl *= smoothstep(direction.w, mix(direction.w, 1.0, 0.1), dot(l, -direction.xyz));\n"
+	"		}\n"
+	"		e += nl * energy.rgb;\n"
+	"	}\n"
+	"	return e;\n"
+	"}\n"
+;
+
+ClusteredLights::ClusteredLights() {
+	glGenBuffers(1, &block_buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, block_buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), nullptr, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, FrameUniforms::ClustersBinding, block_buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	//texture buffer objects that view the (re-filled every frame) data buffers:
+	auto make_texture_buffer = [](GLenum format, GLuint *buffer, GLuint *texture) {
+		glGenBuffers(1, buffer);
+		glBindBuffer(GL_TEXTURE_BUFFER, *buffer);
+		glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+		glGenTextures(1, texture);
+		glBindTexture(GL_TEXTURE_BUFFER, *texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, format, *buffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	};
+	make_texture_buffer(GL_RG32UI, &clusters_buffer, &clusters_texture);
+	make_texture_buffer(GL_R32UI, &indices_buffer, &indices_texture);
+	make_texture_buffer(GL_RGBA32F, &lights_buffer, &lights_texture);
+
+	GL_ERRORS(); //PARANOIA: make sure nothing strange happened during setup
+}
+
+ClusteredLights::~ClusteredLights() {
+	glDeleteBuffers(1, &block_buffer);
+	block_buffer = 0;
+	for (GLuint *texture : { &clusters_texture, &indices_texture, &lights_texture }) {
+		glDeleteTextures(1, texture);
+		*texture = 0;
+	}
+	for (GLuint *buffer : { &clusters_buffer, &indices_buffer, &lights_buffer }) {
+		glDeleteBuffers(1, buffer);
+		*buffer = 0;
+	}
+}
+
+void ClusteredLights::bind_program(GLuint program) {
+	GLuint block_index = glGetUniformBlockIndex(program, "Clusters");
+	if (block_index != GL_INVALID_INDEX) glUniformBlockBinding(program, block_index, FrameUniforms::ClustersBinding);
+
+	glUseProgram(program);
+	auto set_unit = [program](char const *name, GLuint unit) {
+		GLint location = glGetUniformLocation(program, name);
+		if (location != -1) glUniform1i(location, GLint(unit));
+	};
+	set_unit("CLUSTERS", ClustersUnit);
+	set_unit("LIGHT_INDICES", IndicesUnit);
+	set_unit("LIGHTS", LightsUnit);
+	glUseProgram(0);
+}
+
+void ClusteredLights::compute_bounds(float fovy, float aspect, float near) const {
+	bounds_fovy = fovy;
+	bounds_aspect = aspect;
+	bounds_near = near;
+	bounds_far = far;
+
+	for (auto *v : { &bounds.min_x, &bounds.min_y, &bounds.min_d, &bounds.max_x, &bounds.max_y, &bounds.max_d }) {
+		v->resize(ClusterCount);
+	}
+
+	//view-space half-extents of the view at depth 1:
+	float scale_y = std::tan(0.5f * fovy);
+	float scale_x = scale_y * aspect;
+
+	float const infinity = std::numeric_limits< float >::infinity();
+	for (uint32_t z = 0; z < Slices; ++z) {
+		float d0 = near * std::pow(far / near, float(z) / float(Slices));
+		float d1 = near * std::pow(far / near, float(z + 1) / float(Slices));
+		//the last slice holds everything beyond 'far' as well, so it goes on forever:
+		bool last = (z + 1 == Slices);
+		if (last) d1 = infinity;
+		for (uint32_t y = 0; y < TilesY; ++y) {
+			float y0 = (2.0f * float(y) / float(TilesY) - 1.0f) * scale_y;
+			float y1 = (2.0f * float(y + 1) / float(TilesY) - 1.0f) * scale_y;
+			for (uint32_t x = 0; x < TilesX; ++x) {
+				float x0 = (2.0f * float(x) / float(TilesX) - 1.0f) * scale_x;
+				float x1 = (2.0f * float(x + 1) / float(TilesX) - 1.0f) * scale_x;
+				uint32_t i = (z * TilesY + y) * TilesX + x;
+				//(cluster edges are linear in depth, so the extremes are at the slice's near or far depth)
+				// (in the last slice, edges that lean outward go on forever; written out so 0 * infinity never comes up)
+				if (last) {
+					bounds.min_x[i] = (x0 < 0.0f ? -infinity : x0 * d0);
+					bounds.max_x[i] = (x1 > 0.0f ?  infinity : x1 * d0);
+					bounds.min_y[i] = (y0 < 0.0f ? -infinity : y0 * d0);
+					bounds.max_y[i] = (y1 > 0.0f ?  infinity : y1 * d0);
+				} else {
+					bounds.min_x[i] = std::min(x0 * d0, x0 * d1);
+					bounds.max_x[i] = std::max(x1 * d0, x1 * d1);
+					bounds.min_y[i] = std::min(y0 * d0, y0 * d1);
+					bounds.max_y[i] = std::max(y1 * d0, y1 * d1);
+				}
+				bounds.min_d[i] = d0;
+				bounds.max_d[i] = d1;
+			}
+		}
+	}
+}
+
+void ClusteredLights::update(Scene const &scene, Scene::Camera const &camera, glm::uvec2 const &drawable_size) const {
+	assert(camera.transform);
+
+	if (bounds_fovy != camera.fovy || bounds_aspect != camera.aspect || bounds_near != camera.near || bounds_far != far) {
+		compute_bounds(camera.fovy, camera.aspect, camera.near);
+	}
+
+	glm::mat4x3 world_to_view = camera.transform->make_world_to_local();
+	float slice_scale = float(Slices) / std::log(far / camera.near);
+	float slice_bias = -std::log(camera.near) * slice_scale;
+
+	//--- gather point and spot lights (including those of the base scene, as Scene::draw does) ---
+	lights.clear();
+	light_count = 0;
+	spheres.clear();
+	auto gather = [&](Scene::Light const &light) {
+		if (light.type != Scene::Light::Point && light.type != Scene::Light::Spot) return;
+		glm::mat4x3 to_world = light.transform->make_local_to_world();
+		glm::vec3 position = to_world[3];
+		glm::vec3 direction = -glm::normalize(to_world[2]);
+		bool spot = (light.type == Scene::Light::Spot);
+
+		lights.emplace_back(position, light.distance);
+		lights.emplace_back(light.energy, spot ? 1.0f : 0.0f);
+		lights.emplace_back(direction, std::cos(0.5f * light.spot_fov));
+
+		//(spot lights are bounded by the same sphere as point lights -- conservative, but simple)
+		spheres.emplace_back(world_to_view * glm::vec4(position, 1.0f), light.distance);
+		light_count += 1;
+	};
+	if (scene.base) {
+		for (auto const &light : scene.base->lights) {
+			if (scene.overrides.count(light.transform)) continue; //(has a local copy)
+			gather(light);
+		}
+	}
+	for (auto const &light : scene.lights) {
+		gather(light);
+	}
+
+	//--- find the clusters each light's sphere touches ---
+	hits.clear();
+	touched.assign(TilesX * TilesY, 0);
+	for (uint32_t l = 0; l < spheres.size(); ++l) {
+		glm::vec3 center = spheres[l];
+		float radius = spheres[l].w;
+		float depth = -center.z;
+		if (depth + radius < camera.near) continue; //entirely behind the camera
+
+		//depth slices overlapped by the sphere:
+		auto slice = [&](float d) {
+			float s = std::log(std::max(d, camera.near)) * slice_scale + slice_bias;
+			return uint32_t(std::min(std::max(s, 0.0f), float(Slices - 1)));
+		};
+		uint32_t z0 = slice(depth - radius);
+		uint32_t z1 = slice(depth + radius);
+
+		float r2 = radius * radius;
+		for (uint32_t z = z0; z <= z1; ++z) {
+			//sphere vs. cluster box for a whole slice at once (branch-free, so the compiler can vectorize it):
+			uint32_t begin = z * TilesX * TilesY;
+			float const *min_x = &bounds.min_x[begin], *max_x = &bounds.max_x[begin];
+			float const *min_y = &bounds.min_y[begin], *max_y = &bounds.max_y[begin];
+			float const *min_d = &bounds.min_d[begin], *max_d = &bounds.max_d[begin];
+			for (uint32_t i = 0; i < TilesX * TilesY; ++i) {
+				float dx = std::max(std::max(min_x[i] - center.x, center.x - max_x[i]), 0.0f);
+				float dy = std::max(std::max(min_y[i] - center.y, center.y - max_y[i]), 0.0f);
+				float dd = std::max(std::max(min_d[i] - depth, depth - max_d[i]), 0.0f);
+				touched[i] = uint8_t(dx * dx + dy * dy + dd * dd <= r2);
+			}
+			for (uint32_t i = 0; i < TilesX * TilesY; ++i) {
+				if (touched[i]) hits.emplace_back(begin + i, l);
+			}
+		}
+	}
+
+	//--- group light indices by cluster (counting sort) ---
+	clusters.assign(ClusterCount, glm::uvec2(0));
+	for (auto const &hit : hits) {
+		clusters[hit.first].y += 1;
+	}
+	uint32_t offset = 0;
+	for (auto &cluster : clusters) {
+		cluster.x = offset;
+		offset += cluster.y;
+		cluster.y = 0;
+	}
+	indices.resize(std::max< size_t >(1, hits.size())); //(buffers are never left empty)
+	for (auto const &hit : hits) {
+		glm::uvec2 &cluster = clusters[hit.first];
+		indices[cluster.x + cluster.y] = hit.second;
+		cluster.y += 1;
+	}
+	reference_count = uint32_t(hits.size());
+	if (lights.empty()) lights.resize(3, glm::vec4(0.0f));
+
+	//--- upload ---
+	Block block;
+	block.WORLD_TO_VIEW = glm::mat4(world_to_view);
+	block.CLUSTER_COUNT = glm::uvec4(TilesX, TilesY, Slices, 0);
+	block.CLUSTER_SCALE = glm::vec4(
+		float(drawable_size.x) / float(TilesX),
+		float(drawable_size.y) / float(TilesY),
+		slice_scale,
+		slice_bias
+	);
+	glBindBuffer(GL_UNIFORM_BUFFER, block_buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Block), &block);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	auto upload = [](GLuint buffer, size_t size, void const *data) {
+		glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+		glBufferData(GL_TEXTURE_BUFFER, size, data, GL_STREAM_DRAW); //(respecify, so the driver needn't wait on last frame's reads)
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	};
+	upload(clusters_buffer, clusters.size() * sizeof(glm::uvec2), clusters.data());
+	upload(indices_buffer, indices.size() * sizeof(GLuint), indices.data());
+	upload(lights_buffer, lights.size() * sizeof(glm::vec4), lights.data());
+
+	//--- bind (texture units above those Scene::draw uses, so they stay bound while drawing) ---
+	glActiveTexture(GL_TEXTURE0 + ClustersUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, clusters_texture);
+	glActiveTexture(GL_TEXTURE0 + IndicesUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, indices_texture);
+	glActiveTexture(GL_TEXTURE0 + LightsUnit);
+	glBindTexture(GL_TEXTURE_BUFFER, lights_texture);
+	glActiveTexture(GL_TEXTURE0);
+
+	GL_ERRORS();
+}
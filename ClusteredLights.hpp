@@ -0,0 +1,102 @@
+#pragma once
+
+/*
+ * Clustered forward lighting: each frame, the point and spot lights of a scene are
+ *  sorted into a grid of view-space "froxels" (screen tiles x exponential depth slices),
+ *  so a fragment shader only loops over the lights that can reach its cluster.
+ *
+ * The per-cluster light lists and the lights themselves are uploaded to texture buffers,
+ *  and the grid parameters to the "Clusters" uniform block; programs use them by pasting
+ *  ClusteredLights::GLSL into their fragment shader (which declares a function
+ *  'vec3 cluster_lighting(vec3 world_position, vec3 normal)') and calling
+ *  ClusteredLights::bind_program() once after linking.
+ *
+ * Hemisphere and directional lights reach everywhere, so they aren't clustered -- keep
+ *  using the "Light" block (FrameUniforms::set_light) for those.
+ *
+ */
+
+#include "GL.hpp"
+#include "Load.hpp"
+#include "Scene.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct ClusteredLights {
+	ClusteredLights();
+	~ClusteredLights();
+
+	//grid size (tiles across, tiles up, depth slices):
+	enum : uint32_t {
+		TilesX = 16,
+		TilesY = 9,
+		Slices = 24,
+		ClusterCount = TilesX * TilesY * Slices,
+	};
+
+	//depth slices are spaced exponentially from the camera's near plane out to this distance:
+	// (lights beyond it all land in the last slice)
+	float far = 200.0f;
+
+	//texture units the buffers are bound to (above those used by Scene::Drawable::Pipeline::textures):
+	enum : GLuint {
+		ClustersUnit = 4,
+		IndicesUnit = 5,
+		LightsUnit = 6,
+	};
+
+	//GLSL declarations + cluster_lighting() function, for inclusion in fragment shaders:
+	// (expects '#version 330' and, like the shader, world-space positions and normals)
+	static char const *GLSL;
+
+	//hook up the block and samplers that 'program' uses:
+	static void bind_program(GLuint program);
+
+	//assign the point and spot lights of 'scene' (and of its base, if any) to clusters as seen
+	// by 'camera' in a viewport of 'drawable_size', upload the result, and bind the buffers:
+	// (call once per frame, before drawing with programs that use cluster_lighting())
+	void update(Scene const &scene, Scene::Camera const &camera, glm::uvec2 const &drawable_size) const;
+
+	//counts from the last update(), for debugging:
+	mutable uint32_t light_count = 0;
+	mutable uint32_t reference_count = 0; //total entries in all cluster light lists
+
+	//--- internals ---
+	// (update() is const -- so it can be called through Load<> -- and these are its working state)
+
+	//std140 mirror of the "Clusters" block:
+	struct Block {
+		glm::mat4 WORLD_TO_VIEW;
+		glm::uvec4 CLUSTER_COUNT; //tiles x, tiles y, slices, (unused)
+		glm::vec4 CLUSTER_SCALE; //tile width (px), tile height (px), slice scale, slice bias
+	};
+	static_assert(sizeof(Block) == 4*16 + 4*4 + 4*4, "Clusters block is std140.");
+
+	//view-space bounds of each cluster, as separate arrays so the sphere tests vectorize:
+	// (depth is measured along -z, so all values of min_d/max_d are positive)
+	mutable struct Bounds {
+		std::vector< float > min_x, min_y, min_d;
+		std::vector< float > max_x, max_y, max_d;
+	} bounds;
+	//parameters the bounds were computed for (recomputed when these change):
+	mutable float bounds_fovy = 0.0f, bounds_aspect = 0.0f, bounds_near = 0.0f, bounds_far = 0.0f;
+	void compute_bounds(float fovy, float aspect, float near) const;
+
+	//CPU-side scratch space, kept between frames to avoid reallocating:
+	mutable std::vector< glm::uvec2 > clusters; //(first index, count) per cluster
+	mutable std::vector< GLuint > indices; //light indices, grouped by cluster
+	mutable std::vector< glm::vec4 > lights; //three texels per light: (position, distance), (energy, is spot), (direction, cos cutoff)
+	mutable std::vector< std::pair< uint32_t, uint32_t > > hits; //(cluster, light)
+	mutable std::vector< glm::vec4 > spheres; //view-space (center, radius) per light, for cluster assignment
+	mutable std::vector< uint8_t > touched; //per tile of a slice: does the current light's sphere touch it?
+
+	GLuint block_buffer = 0;
+	GLuint clusters_buffer = 0, clusters_texture = 0;
+	GLuint indices_buffer = 0, indices_texture = 0;
+	GLuint lights_buffer = 0, lights_texture = 0;
+};
+
+extern Load< ClusteredLights > clustered_lights;
@@ -0,0 +1,180 @@
+#include "ClusteredLitColorTextureProgram.hpp"
+
+#include "ClusteredLights.hpp"
+#include "FrameUniforms.hpp"
+#include "gl_compile_program.hpp"
+#include "gl_errors.hpp"
+
+#include <vector>
+
+Scene::Drawable::Pipeline clustered_lit_color_texture_program_pipeline;
+
+Load< ClusteredLitColorTextureProgram > clustered_lit_color_texture_program(LoadTagEarly, []() -> ClusteredLitColorTextureProgram const * {
+	ClusteredLitColorTextureProgram *ret = new ClusteredLitColorTextureProgram();
+
+	//----- build the pipeline template -----
+	clustered_lit_color_texture_program_pipeline.program = ret->program;
+
+	clustered_lit_color_texture_program_pipeline.OBJECT_TO_WORLD_mat4x3 = ret->OBJECT_TO_WORLD_mat4x3;
+	clustered_lit_color_texture_program_pipeline.NORMAL_TO_WORLD_mat3 = ret->NORMAL_TO_WORLD_mat3;
+
+	clustered_lit_color_texture_program_pipeline.t_float = ret->t;
+	clustered_lit_color_texture_program_pipeline.TEX_sampler2D = ret->TEX;
+
+	clustered_lit_color_texture_program_pipeline.instanced.program = ret->instanced_program;
+	clustered_lit_color_texture_program_pipeline.instanced.t_float = ret->instanced_t;
+	clustered_lit_color_texture_program_pipeline.instanced.TEX_sampler2D = ret->instanced_TEX;
+
+	//make a 1-pixel white texture to bind by default:
+	GLuint tex;
+	glGenTextures(1, &tex);
+
+	glBindTexture(GL_TEXTURE_2D, tex);
+	std::vector< glm::u8vec4 > tex_data(1, glm::u8vec4(0xff));
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, tex_data.data());
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	clustered_lit_color_texture_program_pipeline.textures[0].texture = tex;
+	clustered_lit_color_texture_program_pipeline.textures[0].target = GL_TEXTURE_2D;
+
+	return ret;
+});
+
+ClusteredLitColorTextureProgram::ClusteredLitColorTextureProgram() {
+	//Both variants share everything past the declaration of the object-to-* matrices:
+	std::string const vertex_shader_body =
+		std::string(FrameUniforms::CameraGLSL) +
+		"in vec4 Position;\n"
+		"in vec3 Normal;\n"
+		"in vec4 Color;\n"
+		"in vec2 TexCoord;\n"
+		"out vec3 position;\n"
+		"out vec3 normal;\n"
+		"out vec3 worldPosition;\n"
+		"out vec3 worldNormal;\n"
+		"out vec4 color;\n"
+		"out vec2 texCoord;\n"
+		"void main() {\n"
+		"	vec3 world_position = OBJECT_TO_WORLD * Position;\n"
+		"	gl_Position = WORLD_TO_CLIP * vec4(world_position, 1.0);\n"
+		"	worldPosition = world_position;\n"
+		"	worldNormal = NORMAL_TO_WORLD * Normal;\n"
+		"	position = WORLD_TO_LIGHT * vec4(world_position, 1.0);\n"
+		"	normal = NORMAL_WORLD_TO_LIGHT * worldNormal;\n"
+		"	color = Color;\n"
+		"	texCoord = TexCoord;\n"
+		"}\n"
+	;
+
+	std::string const fragment_shader =
+		"#version 330\n"
+		+ std::string(FrameUniforms::LightGLSL)
+		+ std::string(ClusteredLights::GLSL) +
+		"uniform sampler2D TEX;\n"
+		"uniform float t; \n"
+		"in vec3 position;\n"
+		"in vec3 normal;\n"
+		"in vec3 worldPosition;\n"
+		"in vec3 worldNormal;\n"
+		"in vec4 color;\n"
+		"in vec2 texCoord;\n"
+		"out vec4 fragColor;\n"
+		"void main() {\n"
+		"	vec3 n = normalize(normal);\n"
+		"	vec3 e;\n"
+		"	if (LIGHT_TYPE == 0) { //point light \n"
+		"		vec3 l = (LIGHT_LOCATION - position);\n"
+		"		float dis2 = dot(l,l);\n"
+		"		l = normalize(l);\n"
+		"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
+		"		e = nl * LIGHT_ENERGY;\n"
+		"	} else if (LIGHT_TYPE == 1) { //hemi light \n"
+		"		e = (dot(n,-LIGHT_DIRECTION) * 0.5 + 0.5) * LIGHT_ENERGY;\n"
+		"	} else if (LIGHT_TYPE == 2) { //spot light \n"
+		"		vec3 l = (LIGHT_LOCATION - position);\n"
+		"		float dis2 = dot(l,l);\n"
+		"		l = normalize(l);\n"
+		"		float nl = max(0.0, dot(n, l)) / max(1.0, dis2);\n"
+		"		float c = dot(l,-LIGHT_DIRECTION);\n"
+		"		nl *= smoothstep(LIGHT_CUTOFF,mix(LIGHT_CUTOFF,1.0,0.1), c);\n"
+		"		e = nl * LIGHT_ENERGY;\n"
+		"	} else { //(LIGHT_TYPE == 3) //directional light \n"
+		"		e = max(0.0, dot(n,-LIGHT_DIRECTION)) * LIGHT_ENERGY;\n"
+		"	}\n"
+		"	e += cluster_lighting(worldPosition, normalize(worldNormal));\n"
+		"	vec4 albedo = texture(TEX, texCoord) * color;\n"
+		"	vec4 texColor = vec4(e*albedo.rgb, albedo.a);\n"
+		"	fragColor = vec4(1.0-t)*texColor + vec4(t)*(vec4(0.25,0.25,0.5,1.0));"
+		"}\n"
+	;
+
+	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
+	program = gl_compile_program(
+		//vertex shader:
+		"#version 330\n"
+		"uniform mat4x3 OBJECT_TO_WORLD;\n"
+		"uniform mat3 NORMAL_TO_WORLD;\n"
+		+ vertex_shader_body
+		,
+		//fragment shader:
+		fragment_shader
+	);
+
+	//instanced variant reads the matrices from (per-instance) attributes instead:
+	instanced_program = gl_compile_program(
+		//vertex shader:
+		"#version 330\n"
+		"in mat4x3 OBJECT_TO_WORLD;\n"
+		"in mat3 NORMAL_TO_WORLD;\n"
+		+ vertex_shader_body
+		,
+		//fragment shader:
+		fragment_shader
+	);
+
+	//look up the locations of vertex attributes:
+	Position_vec4 = glGetAttribLocation(program, "Position");
+	Normal_vec3 = glGetAttribLocation(program, "Normal");
+	Color_vec4 = glGetAttribLocation(program, "Color");
+	TexCoord_vec2 = glGetAttribLocation(program, "TexCoord");
+
+	//look up the locations of uniforms:
+	OBJECT_TO_WORLD_mat4x3 = glGetUniformLocation(program, "OBJECT_TO_WORLD");
+	NORMAL_TO_WORLD_mat3 = glGetUniformLocation(program, "NORMAL_TO_WORLD");
+	t = glGetUniformLocation(program, "t");
+
+	TEX = glGetUniformLocation(program, "TEX");
+
+	//...and the same uniforms in the instanced variant:
+	instanced_t = glGetUniformLocation(instanced_program, "t");
+
+	instanced_TEX = glGetUniformLocation(instanced_program, "TEX");
+
+	//camera, light, and cluster state come from shared uniform blocks (and cluster texture buffers):
+	FrameUniforms::bind_program(program);
+	FrameUniforms::bind_program(instanced_program);
+	ClusteredLights::bind_program(program);
+	ClusteredLights::bind_program(instanced_program);
+
+	//set TEX to refer to texture binding zero by default (Scene::draw switches it per-material):
+	glUseProgram(program); //bind program -- glUniform* calls refer to this program now
+
+	glUniform1i(TEX, 0); //set TEX to sample from GL_TEXTURE0
+
+	glUseProgram(instanced_program);
+
+	glUniform1i(instanced_TEX, 0);
+
+	glUseProgram(0); //unbind program -- glUniform* calls refer to ??? now
+}
+
+ClusteredLitColorTextureProgram::~ClusteredLitColorTextureProgram() {
+	glDeleteProgram(program);
+	program = 0;
+	glDeleteProgram(instanced_program);
+	instanced_program = 0;
+}
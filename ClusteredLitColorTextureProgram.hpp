@@ -0,0 +1,46 @@
+#pragma once
+
+#include "GL.hpp"
+#include "Load.hpp"
+#include "Scene.hpp"
+
+//Shader program that draws transformed, lit, textured vertices tinted with vertex colors, like LitColorTextureProgram,
+// but adds in every point and spot light of the scene (looked up per cluster; see ClusteredLights.hpp):
+struct ClusteredLitColorTextureProgram {
+	ClusteredLitColorTextureProgram();
+	~ClusteredLitColorTextureProgram();
+
+	GLuint program = 0;
+
+	//Attribute (per-vertex variable) locations:
+	GLuint Position_vec4 = -1U;
+	GLuint Normal_vec3 = -1U;
+	GLuint Color_vec4 = -1U;
+	GLuint TexCoord_vec2 = -1U;
+
+	//Uniform (per-invocation variable) locations:
+	GLuint OBJECT_TO_WORLD_mat4x3 = -1U;
+	GLuint NORMAL_TO_WORLD_mat3 = -1U;
+	GLuint t = -1U;
+
+	//camera + lighting come from the shared "Camera", "Light", and "Clusters" uniform blocks
+	// (see FrameUniforms.hpp and ClusteredLights.hpp); call clustered_lights->update() before drawing.
+
+	//Textures:
+	//TEXTURE0 - texture that is accessed by TexCoord
+	GLuint TEX = -1U;
+	//TEXTURE4-6 - cluster light lists (bound by ClusteredLights::update)
+
+	//Instanced variant -- same shading, but OBJECT_TO_WORLD and NORMAL_TO_WORLD
+	// are per-instance attributes streamed by Scene::draw (see Scene::Instance):
+	GLuint instanced_program = 0;
+
+	GLuint instanced_t = -1U;
+	GLuint instanced_TEX = -1U;
+};
+
+extern Load< ClusteredLitColorTextureProgram > clustered_lit_color_texture_program;
+
+//For convenient scene-graph setup, copy this object:
+// NOTE: by default, has texture bound to 1-pixel white texture -- so it's okay to use with vertex-color-only meshes.
+extern Scene::Drawable::Pipeline clustered_lit_color_texture_program_pipeline;
@@ -0,0 +1,653 @@
+#include "CollisionMesh.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define COLLISION_MESH_SSE
+#endif
+
+//--------------------------------
+//four-wide floats (comparisons give lane masks, which only combine with & and | and feed bits()):
+// the plain-C++ version is always built, and the SSE2 one where available; CollisionMesh::lanes picks.
+
+namespace {
+#ifdef COLLISION_MESH_SSE
+	struct F4SSE {
+		__m128 v;
+		static F4SSE load(float const *p) { return F4SSE{ _mm_load_ps(p) }; }
+		static F4SSE splat(float f) { return F4SSE{ _mm_set1_ps(f) }; }
+		static F4SSE all_lanes() { return F4SSE{ _mm_castsi128_ps(_mm_set1_epi32(-1)) }; }
+	};
+	inline F4SSE operator+(F4SSE a, F4SSE b) { return F4SSE{ _mm_add_ps(a.v, b.v) }; }
+	inline F4SSE operator-(F4SSE a, F4SSE b) { return F4SSE{ _mm_sub_ps(a.v, b.v) }; }
+	inline F4SSE operator*(F4SSE a, F4SSE b) { return F4SSE{ _mm_mul_ps(a.v, b.v) }; }
+	inline F4SSE operator/(F4SSE a, F4SSE b) { return F4SSE{ _mm_div_ps(a.v, b.v) }; }
+	inline F4SSE min4(F4SSE a, F4SSE b) { return F4SSE{ _mm_min_ps(a.v, b.v) }; }
+	inline F4SSE max4(F4SSE a, F4SSE b) { return F4SSE{ _mm_max_ps(a.v, b.v) }; }
+	inline F4SSE abs4(F4SSE a) { return F4SSE{ _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v) }; }
+	inline F4SSE sqrt4(F4SSE a) { return F4SSE{ _mm_sqrt_ps(a.v) }; }
+	inline F4SSE operator<(F4SSE a, F4SSE b) { return F4SSE{ _mm_cmplt_ps(a.v, b.v) }; }
+	inline F4SSE operator<=(F4SSE a, F4SSE b) { return F4SSE{ _mm_cmple_ps(a.v, b.v) }; }
+	inline F4SSE operator>(F4SSE a, F4SSE b) { return F4SSE{ _mm_cmpgt_ps(a.v, b.v) }; }
+	inline F4SSE operator>=(F4SSE a, F4SSE b) { return F4SSE{ _mm_cmpge_ps(a.v, b.v) }; }
+	inline F4SSE operator&(F4SSE a, F4SSE b) { return F4SSE{ _mm_and_ps(a.v, b.v) }; }
+	inline F4SSE operator|(F4SSE a, F4SSE b) { return F4SSE{ _mm_or_ps(a.v, b.v) }; }
+	inline uint32_t bits(F4SSE mask) { return uint32_t(_mm_movemask_ps(mask.v)); }
+	inline void store4(F4SSE a, float *p) { _mm_storeu_ps(p, a.v); }
+#endif
+
+	struct F4Scalar {
+		float v[4];
+		static F4Scalar load(float const *p) { F4Scalar r; std::memcpy(r.v, p, sizeof(r.v)); return r; }
+		static F4Scalar splat(float f) { return F4Scalar{ { f, f, f, f } }; }
+		static F4Scalar all_lanes() { return splat(1.0f); }
+	};
+	template< typename OP >
+	inline F4Scalar lanes(F4Scalar a, F4Scalar b, OP const &op) {
+		F4Scalar r;
+		for (uint32_t i = 0; i < 4; ++i) r.v[i] = op(a.v[i], b.v[i]);
+		return r;
+	}
+	inline F4Scalar operator+(F4Scalar a, F4Scalar b) { return lanes(a, b, [](float x, float y) { return x + y; }); }
+	inline F4Scalar operator-(F4Scalar a, F4Scalar b) { return lanes(a, b, [](float x, float y) { return x - y; }); }
+	inline F4Scalar operator*(F4Scalar a, F4Scalar b) { return lanes(a, b, [](float x, float y) { return x * y; }); }
+	inline F4Scalar operator/(F4Scalar a, F4Scalar b) { return lanes(a, b, [](float x, float y) { return x / y; }); }
+	inline F4Scalar min4(F4Scalar a, F4Scalar b) { return lanes(a, b, [](float x, float y) { return (x < y ? x : y); }); }
+	inline F4Scalar max4(F4Scalar a, F4Scalar b) { return lanes(a, b, [](float x, float y) { return (x > y ? x : y); }); }
+	inline F4Scalar abs4(F4Scalar a) { return lanes(a, a, [](float x, float) { return std::abs(x); }); }
+	inline F4Scalar sqrt4(F4Scalar a) { return lanes(a, a, [](float x, float) { return std::sqrt(x); }); }
+	//(masks are 1.0f or 0.0f per lane)
+	inline F4Scalar operator<(F4Scalar a, F4Scalar b) { return lanes(a, b, [](float x, float y) { return (x < y ? 1.0f : 0.0f); }); }
+	inline F4Scalar operator<=(F4Scalar a, F4Scalar b) { return lanes(a, b, [](float x, float y) { return (x <= y ? 1.0f : 0.0f); }); }
+	inline F4Scalar operator>(F4Scalar a, F4Scalar b) { return lanes(a, b, [](float x, float y) { return (x > y ? 1.0f : 0.0f); }); }
+	inline F4Scalar operator>=(F4Scalar a, F4Scalar b) { return lanes(a, b, [](float x, float y) { return (x >= y ? 1.0f : 0.0f); }); }
+	inline F4Scalar operator&(F4Scalar a, F4Scalar b) { return lanes(a, b, [](float x, float y) { return (x != 0.0f && y != 0.0f ? 1.0f : 0.0f); }); }
+	inline F4Scalar operator|(F4Scalar a, F4Scalar b) { return lanes(a, b, [](float x, float y) { return (x != 0.0f || y != 0.0f ? 1.0f : 0.0f); }); }
+	inline uint32_t bits(F4Scalar mask) {
+		uint32_t b = 0;
+		for (uint32_t i = 0; i < 4; ++i) if (mask.v[i] != 0.0f) b |= (1 << i);
+		return b;
+	}
+	inline void store4(F4Scalar a, float *p) { std::memcpy(p, a.v, sizeof(a.v)); }
+
+	//a packet's lanes, loaded:
+	template< typename F4 >
+	struct PacketLanes {
+		F4 ax, ay, az;
+		F4 e1x, e1y, e1z;
+		F4 e2x, e2y, e2z;
+		PacketLanes(CollisionMesh::Packet const &p) :
+			ax(F4::load(p.ax)), ay(F4::load(p.ay)), az(F4::load(p.az)),
+			e1x(F4::load(p.e1x)), e1y(F4::load(p.e1y)), e1z(F4::load(p.e1z)),
+			e2x(F4::load(p.e2x)), e2y(F4::load(p.e2y)), e2z(F4::load(p.e2z)) { }
+
+		//mask of lanes whose triangle bounds overlap [min,max]:
+		F4 overlaps(glm::vec3 const &min, glm::vec3 const &max) const {
+			F4 bx = ax + e1x, by = ay + e1y, bz = az + e1z;
+			F4 cx = ax + e2x, cy = ay + e2y, cz = az + e2z;
+			return (min4(min4(ax, bx), cx) <= F4::splat(max.x)) & (max4(max4(ax, bx), cx) >= F4::splat(min.x))
+			     & (min4(min4(ay, by), cy) <= F4::splat(max.y)) & (max4(max4(ay, by), cy) >= F4::splat(min.y))
+			     & (min4(min4(az, bz), cz) <= F4::splat(max.z)) & (max4(max4(az, bz), cz) >= F4::splat(min.z));
+		}
+	};
+
+	glm::vec3 corner_a(CollisionMesh::Packet const &p, uint32_t i) { return glm::vec3(p.ax[i], p.ay[i], p.az[i]); }
+	glm::vec3 corner_b(CollisionMesh::Packet const &p, uint32_t i) { return corner_a(p, i) + glm::vec3(p.e1x[i], p.e1y[i], p.e1z[i]); }
+	glm::vec3 corner_c(CollisionMesh::Packet const &p, uint32_t i) { return corner_a(p, i) + glm::vec3(p.e2x[i], p.e2y[i], p.e2z[i]); }
+}
+
+#ifdef COLLISION_MESH_SSE
+CollisionMesh::Lanes const CollisionMesh::BestLanes = CollisionMesh::SSE2;
+#else
+CollisionMesh::Lanes const CollisionMesh::BestLanes = CollisionMesh::Scalar;
+#endif
+
+//--------------------------------
+//building:
+
+static float surface_area(glm::vec3 const &min, glm::vec3 const &max) {
+	glm::vec3 d = max - min;
+	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+static uint32_t packets_for(size_t triangles) {
+	return uint32_t((triangles + 3) / 4);
+}
+
+CollisionMesh::CollisionMesh(uint32_t const *indices, size_t index_count, void const *positions_, size_t position_stride) {
+	unsigned char const *positions = reinterpret_cast< unsigned char const * >(positions_);
+	triangle_count = index_count / 3;
+	if (triangle_count == 0) return;
+
+	std::vector< glm::vec3 > corners(3 * triangle_count);
+	for (size_t i = 0; i < corners.size(); ++i) {
+		std::memcpy(&corners[i], positions + indices[i] * position_stride, sizeof(glm::vec3));
+	}
+
+	std::vector< glm::vec3 > tri_min(triangle_count), tri_max(triangle_count), centroid(triangle_count);
+	for (size_t t = 0; t < triangle_count; ++t) {
+		tri_min[t] = glm::min(glm::min(corners[3*t+0], corners[3*t+1]), corners[3*t+2]);
+		tri_max[t] = glm::max(glm::max(corners[3*t+0], corners[3*t+1]), corners[3*t+2]);
+		centroid[t] = 0.5f * (tri_min[t] + tri_max[t]);
+		min = glm::min(min, tri_min[t]);
+		max = glm::max(max, tri_max[t]);
+	}
+
+	std::vector< uint32_t > order(triangle_count);
+	for (uint32_t t = 0; t < triangle_count; ++t) {
+		order[t] = t;
+	}
+
+	nodes.reserve(2 * packets_for(triangle_count));
+	packets.reserve(packets_for(triangle_count) + packets_for(triangle_count) / 4);
+
+	//binned SAH split of order[begin,end), recursively:
+	// (costs are in units of one packet test; a node visit costs half that)
+	constexpr uint32_t Bins = 12;
+	constexpr float TraversalCost = 0.5f;
+	std::function< void(size_t, size_t, uint32_t) > build = [&](size_t begin, size_t end, uint32_t depth) {
+		uint32_t index = uint32_t(nodes.size());
+		nodes.emplace_back();
+
+		glm::vec3 box_min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 box_max = glm::vec3(-std::numeric_limits< float >::infinity());
+		glm::vec3 c_min = box_min, c_max = box_max;
+		for (size_t i = begin; i < end; ++i) {
+			box_min = glm::min(box_min, tri_min[order[i]]);
+			box_max = glm::max(box_max, tri_max[order[i]]);
+			c_min = glm::min(c_min, centroid[order[i]]);
+			c_max = glm::max(c_max, centroid[order[i]]);
+		}
+		nodes[index].min = box_min;
+		nodes[index].max = box_max;
+
+		size_t count = end - begin;
+		size_t mid = begin;
+		if (count > 4 && depth < MaxDepth) {
+			float best_cost = surface_area(box_min, box_max) * packets_for(count); //(cost as a leaf)
+			int32_t best_axis = -1;
+			uint32_t best_split = 0;
+			for (uint32_t axis = 0; axis < 3; ++axis) {
+				float extent = c_max[axis] - c_min[axis];
+				if (!(extent > 0.0f)) continue;
+				struct Bin {
+					size_t count = 0;
+					glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+					glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+				} bins[Bins];
+				float scale = Bins / extent;
+				for (size_t i = begin; i < end; ++i) {
+					uint32_t t = order[i];
+					uint32_t b = std::min(Bins - 1, uint32_t((centroid[t][axis] - c_min[axis]) * scale));
+					bins[b].count += 1;
+					bins[b].min = glm::min(bins[b].min, tri_min[t]);
+					bins[b].max = glm::max(bins[b].max, tri_max[t]);
+				}
+				//cost of the right side of each split, then sweep in from the left:
+				float right_cost[Bins];
+				{
+					Bin right;
+					for (uint32_t b = Bins - 1; b > 0; --b) {
+						right.count += bins[b].count;
+						right.min = glm::min(right.min, bins[b].min);
+						right.max = glm::max(right.max, bins[b].max);
+						right_cost[b] = (right.count ? surface_area(right.min, right.max) * packets_for(right.count) : 0.0f);
+					}
+				}
+				Bin left;
+				for (uint32_t split = 1; split < Bins; ++split) {
+					left.count += bins[split-1].count;
+					left.min = glm::min(left.min, bins[split-1].min);
+					left.max = glm::max(left.max, bins[split-1].max);
+					if (left.count == 0 || left.count == count) continue;
+					float cost = TraversalCost * surface_area(box_min, box_max)
+						+ surface_area(left.min, left.max) * packets_for(left.count) + right_cost[split];
+					if (cost < best_cost) {
+						best_cost = cost;
+						best_axis = int32_t(axis);
+						best_split = split;
+					}
+				}
+			}
+
+			if (best_axis >= 0) {
+				uint32_t axis = uint32_t(best_axis);
+				float scale = Bins / (c_max[axis] - c_min[axis]);
+				mid = size_t(std::partition(order.begin() + begin, order.begin() + end, [&](uint32_t t) {
+					return std::min(Bins - 1, uint32_t((centroid[t][axis] - c_min[axis]) * scale)) < best_split;
+				}) - order.begin());
+			} else if (count > 16) {
+				//a leaf would be too big to be worth it, even if no split looks better (e.g., piled-up centroids):
+				glm::vec3 extent = c_max - c_min;
+				uint32_t axis = (extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2));
+				mid = begin + count / 2;
+				std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [&](uint32_t a, uint32_t b) {
+					return centroid[a][axis] < centroid[b][axis];
+				});
+			}
+		}
+
+		if (mid == begin || mid == end) {
+			//leaf:
+			nodes[index].first = uint32_t(packets.size());
+			nodes[index].count = packets_for(count);
+			for (size_t i = begin; i < end; i += 4) {
+				Packet packet;
+				for (uint32_t lane = 0; lane < 4; ++lane) {
+					if (i + lane < end) {
+						uint32_t t = order[i + lane];
+						glm::vec3 a = corners[3*t+0];
+						glm::vec3 e1 = corners[3*t+1] - a;
+						glm::vec3 e2 = corners[3*t+2] - a;
+						packet.ax[lane] = a.x; packet.ay[lane] = a.y; packet.az[lane] = a.z;
+						packet.e1x[lane] = e1.x; packet.e1y[lane] = e1.y; packet.e1z[lane] = e1.z;
+						packet.e2x[lane] = e2.x; packet.e2y[lane] = e2.y; packet.e2z[lane] = e2.z;
+						packet.triangle[lane] = t;
+					} else {
+						float nan = std::numeric_limits< float >::quiet_NaN();
+						packet.ax[lane] = packet.ay[lane] = packet.az[lane] = nan;
+						packet.e1x[lane] = packet.e1y[lane] = packet.e1z[lane] = 0.0f;
+						packet.e2x[lane] = packet.e2y[lane] = packet.e2z[lane] = 0.0f;
+						packet.triangle[lane] = -1U;
+					}
+				}
+				packets.emplace_back(packet);
+			}
+		} else {
+			build(begin, mid, depth + 1);
+			nodes[index].first = uint32_t(nodes.size());
+			nodes[index].count = 0;
+			build(mid, end, depth + 1);
+		}
+	};
+	build(0, triangle_count, 0);
+}
+
+//--------------------------------
+//traversal:
+
+//visit leaves whose boxes, grown by 'extent' on every side, are hit by origin + t * direction for
+// 0 <= t <= *max_t, nearest first; 'leaf' may lower *max_t (and return false to stop):
+template< typename LEAF >
+static void traverse(std::vector< CollisionMesh::Node > const &nodes, glm::vec3 const &origin, glm::vec3 const &direction, glm::vec3 const &extent, float const *max_t, LEAF const &leaf) {
+	if (nodes.empty()) return;
+
+	//(zero components get a huge-but-finite inverse, so the slab test never computes 0 * inf)
+	glm::vec3 inv_direction;
+	for (uint32_t c = 0; c < 3; ++c) {
+		inv_direction[c] = (std::abs(direction[c]) > 1e-20f ? 1.0f / direction[c] : 1e30f);
+	}
+	auto enter = [&](CollisionMesh::Node const &node) -> float {
+		glm::vec3 t0 = (node.min - extent - origin) * inv_direction;
+		glm::vec3 t1 = (node.max + extent - origin) * inv_direction;
+		glm::vec3 near = glm::min(t0, t1);
+		glm::vec3 far = glm::max(t0, t1);
+		float t_enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+		float t_exit = std::min(std::min(far.x, far.y), std::min(far.z, *max_t));
+		return (t_enter <= t_exit ? t_enter : std::numeric_limits< float >::infinity());
+	};
+
+	struct Entry {
+		uint32_t node;
+		float t;
+	};
+	Entry stack[CollisionMesh::MaxDepth + 2];
+	uint32_t top = 0;
+	float t_root = enter(nodes[0]);
+	if (t_root == std::numeric_limits< float >::infinity()) return;
+	stack[top++] = Entry{ 0, t_root };
+	while (top > 0) {
+		Entry entry = stack[--top];
+		if (entry.t > *max_t) continue;
+		CollisionMesh::Node const &node = nodes[entry.node];
+		if (node.count != 0) {
+			if (!leaf(node)) return;
+			continue;
+		}
+		uint32_t near_child = entry.node + 1, far_child = node.first;
+		float t_near = enter(nodes[near_child]), t_far = enter(nodes[far_child]);
+		if (t_far < t_near) {
+			std::swap(near_child, far_child);
+			std::swap(t_near, t_far);
+		}
+		if (t_far != std::numeric_limits< float >::infinity()) stack[top++] = Entry{ far_child, t_far };
+		if (t_near != std::numeric_limits< float >::infinity()) stack[top++] = Entry{ near_child, t_near };
+	}
+}
+
+//--------------------------------
+//rays:
+
+template< typename F4 >
+static bool ray_cast_lanes(CollisionMesh const &mesh, glm::vec3 const &origin, glm::vec3 const &direction, float max_t, CollisionMesh::Hit *hit) {
+	assert(hit);
+	std::vector< CollisionMesh::Node > const &nodes = mesh.nodes;
+	std::vector< CollisionMesh::Packet > const &packets = mesh.packets;
+	float best = max_t;
+	uint32_t best_packet = -1U, best_lane = 0;
+
+	F4 ox = F4::splat(origin.x), oy = F4::splat(origin.y), oz = F4::splat(origin.z);
+	F4 dx = F4::splat(direction.x), dy = F4::splat(direction.y), dz = F4::splat(direction.z);
+	traverse(nodes, origin, direction, glm::vec3(0.0f), &best, [&](CollisionMesh::Node const &leaf) {
+		for (uint32_t p = leaf.first; p < leaf.first + leaf.count; ++p) {
+			//Moller-Trumbore, four triangles at a time:
+			PacketLanes< F4 > l(packets[p]);
+			F4 px = dy * l.e2z - dz * l.e2y, py = dz * l.e2x - dx * l.e2z, pz = dx * l.e2y - dy * l.e2x;
+			F4 det = l.e1x * px + l.e1y * py + l.e1z * pz;
+			F4 inv_det = F4::splat(1.0f) / det;
+			F4 tx = ox - l.ax, ty = oy - l.ay, tz = oz - l.az;
+			F4 u = (tx * px + ty * py + tz * pz) * inv_det;
+			F4 qx = ty * l.e1z - tz * l.e1y, qy = tz * l.e1x - tx * l.e1z, qz = tx * l.e1y - ty * l.e1x;
+			F4 v = (dx * qx + dy * qy + dz * qz) * inv_det;
+			F4 t = (l.e2x * qx + l.e2y * qy + l.e2z * qz) * inv_det;
+			F4 mask = (abs4(det) > F4::splat(0.0f)) & (u >= F4::splat(0.0f)) & (v >= F4::splat(0.0f)) & (u + v <= F4::splat(1.0f))
+				& (t >= F4::splat(0.0f)) & (t <= F4::splat(best));
+			uint32_t hits = bits(mask);
+			if (!hits) continue;
+			float ts[4];
+			store4(t, ts);
+			for (uint32_t lane = 0; lane < 4; ++lane) {
+				if ((hits & (1 << lane)) && ts[lane] <= best) {
+					best = ts[lane];
+					best_packet = p;
+					best_lane = lane;
+				}
+			}
+		}
+		return true;
+	});
+
+	if (best_packet == -1U) return false;
+	CollisionMesh::Packet const &packet = packets[best_packet];
+	hit->t = best;
+	hit->triangle = packet.triangle[best_lane];
+	hit->point = origin + best * direction;
+	glm::vec3 n = glm::cross(corner_b(packet, best_lane) - corner_a(packet, best_lane), corner_c(packet, best_lane) - corner_a(packet, best_lane));
+	hit->normal = glm::normalize(glm::dot(n, direction) > 0.0f ? -n : n);
+	return true;
+}
+
+bool CollisionMesh::ray_cast(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, Hit *hit) const {
+#ifdef COLLISION_MESH_SSE
+	if (lanes == SSE2) return ray_cast_lanes< F4SSE >(*this, origin, direction, max_t, hit);
+#endif
+	return ray_cast_lanes< F4Scalar >(*this, origin, direction, max_t, hit);
+}
+
+//--------------------------------
+//sweeps:
+
+//closest point to p on triangle abc (Ericson, "Real-Time Collision Detection", 5.1.5):
+static glm::vec3 closest_on_triangle(glm::vec3 const &p, glm::vec3 const &a, glm::vec3 const &b, glm::vec3 const &c) {
+	glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+	float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f) return a;
+	glm::vec3 bp = p - b;
+	float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3) return b;
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return a + ab * (d1 / (d1 - d3));
+	glm::vec3 cp = p - c;
+	float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6) return c;
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return a + ac * (d2 / (d2 - d6));
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+	float denom = va + vb + vc;
+	if (!(denom > 0.0f)) return a; //(degenerate triangle whose closest feature wasn't a corner or edge above)
+	return a + ab * (vb / denom) + ac * (vc / denom);
+}
+
+//closest points of segments p1-q1 and p2-q2 (Ericson 5.1.9):
+static void closest_on_segments(glm::vec3 const &p1, glm::vec3 const &q1, glm::vec3 const &p2, glm::vec3 const &q2, glm::vec3 *c1, glm::vec3 *c2) {
+	glm::vec3 d1 = q1 - p1, d2 = q2 - p2, r = p1 - p2;
+	float a = glm::dot(d1, d1), e = glm::dot(d2, d2), f = glm::dot(d2, r);
+	float s = 0.0f, t = 0.0f;
+	if (a <= 1e-12f && e <= 1e-12f) {
+		//(both points)
+	} else if (a <= 1e-12f) {
+		t = glm::clamp(f / e, 0.0f, 1.0f);
+	} else {
+		float c = glm::dot(d1, r);
+		if (e <= 1e-12f) {
+			s = glm::clamp(-c / a, 0.0f, 1.0f);
+		} else {
+			float b = glm::dot(d1, d2);
+			float denom = a * e - b * b;
+			s = (denom > 0.0f ? glm::clamp((b * f - c * e) / denom, 0.0f, 1.0f) : 0.0f);
+			t = (b * s + f) / e;
+			if (t < 0.0f) {
+				t = 0.0f;
+				s = glm::clamp(-c / a, 0.0f, 1.0f);
+			} else if (t > 1.0f) {
+				t = 1.0f;
+				s = glm::clamp((b - c) / a, 0.0f, 1.0f);
+			}
+		}
+	}
+	*c1 = p1 + d1 * s;
+	*c2 = p2 + d2 * t;
+}
+
+//distance between segment p-q and triangle abc, with the closest points:
+static float segment_triangle_distance(glm::vec3 const &p, glm::vec3 const &q, glm::vec3 const &a, glm::vec3 const &b, glm::vec3 const &c, glm::vec3 *on_segment, glm::vec3 *on_triangle) {
+	//segment crossing the triangle:
+	glm::vec3 n = glm::cross(b - a, c - a);
+	float dp = glm::dot(p - a, n), dq = glm::dot(q - a, n);
+	if (dp * dq <= 0.0f && dp != dq) {
+		glm::vec3 x = p + (q - p) * (dp / (dp - dq));
+		glm::vec3 on = closest_on_triangle(x, a, b, c);
+		glm::vec3 diff = on - x;
+		if (glm::dot(diff, diff) <= 1e-10f * (glm::dot(b - a, b - a) + glm::dot(c - a, c - a))) {
+			*on_segment = *on_triangle = x;
+			return 0.0f;
+		}
+	}
+
+	//otherwise the closest points involve an end of the segment or an edge of the triangle:
+	float best2 = std::numeric_limits< float >::infinity();
+	auto consider = [&](glm::vec3 const &s, glm::vec3 const &t) {
+		glm::vec3 d = s - t;
+		float d2 = glm::dot(d, d);
+		if (d2 < best2) {
+			best2 = d2;
+			*on_segment = s;
+			*on_triangle = t;
+		}
+	};
+	consider(p, closest_on_triangle(p, a, b, c));
+	if (q != p) {
+		consider(q, closest_on_triangle(q, a, b, c));
+		glm::vec3 const *corners[3] = { &a, &b, &c };
+		for (uint32_t e = 0; e < 3; ++e) {
+			glm::vec3 s, t;
+			closest_on_segments(p, q, *corners[e], *corners[(e+1)%3], &s, &t);
+			consider(s, t);
+		}
+	}
+	return std::sqrt(best2);
+}
+
+//the distance is a convex function of t, so Newton steps from t = 0 never overshoot the first contact:
+bool CollisionMesh::sweep_triangle(glm::vec3 const &p, glm::vec3 const &q, float radius, glm::vec3 const &d, glm::vec3 const &a, glm::vec3 const &b, glm::vec3 const &c, float max_t, float *t_, glm::vec3 *point, glm::vec3 *normal) {
+	float const tolerance = 1e-5f + 1e-4f * radius;
+	float t = 0.0f;
+	for (uint32_t iter = 0; iter < 32; ++iter) {
+		glm::vec3 on_segment, on_triangle;
+		float distance = segment_triangle_distance(p + t * d, q + t * d, a, b, c, &on_segment, &on_triangle);
+		float f = distance - radius;
+		if (f <= tolerance) {
+			*t_ = t;
+			*point = on_triangle;
+			if (distance > 1e-6f) {
+				*normal = (on_segment - on_triangle) / distance;
+			} else {
+				//(touching the surface itself: use the face normal, against the motion)
+				glm::vec3 n = glm::cross(b - a, c - a);
+				float length = glm::length(n);
+				n = (length > 0.0f ? n / length : -glm::normalize(d));
+				*normal = (glm::dot(n, d) > 0.0f ? -n : n);
+			}
+			return true;
+		}
+		float slope = glm::dot((on_segment - on_triangle) / distance, d);
+		if (!(slope < 0.0f)) return false; //not getting closer, so (by convexity) never will
+		t -= f / slope;
+		if (t > max_t) return false;
+	}
+	return false;
+}
+
+template< typename F4 >
+static bool sweep_lanes(CollisionMesh const &mesh, glm::vec3 const &a, glm::vec3 const &b, float radius, glm::vec3 const &displacement, CollisionMesh::Hit *hit) {
+	assert(hit);
+	std::vector< CollisionMesh::Node > const &nodes = mesh.nodes;
+	std::vector< CollisionMesh::Packet > const &packets = mesh.packets;
+	float best = 1.0f;
+	bool found = false;
+
+	//nodes are grown by the shape's box, and tested along the path of its center:
+	glm::vec3 center = 0.5f * (a + b);
+	glm::vec3 extent = 0.5f * glm::abs(b - a) + glm::vec3(radius);
+
+	traverse(nodes, center, displacement, extent, &best, [&](CollisionMesh::Node const &leaf) {
+		//box around everything the shape touches before 'best', and the shape's ends at the start and at 'best':
+		glm::vec3 a1 = a + best * displacement, b1 = b + best * displacement;
+		glm::vec3 swept_min = glm::min(glm::min(a, b), glm::min(a1, b1)) - glm::vec3(radius);
+		glm::vec3 swept_max = glm::max(glm::max(a, b), glm::max(a1, b1)) + glm::vec3(radius);
+		glm::vec3 const ends[4] = { a, b, a1, b1 };
+
+		for (uint32_t p = leaf.first; p < leaf.first + leaf.count; ++p) {
+			//four-wide culling: triangle bounds against the swept box, and the shape against each triangle's plane:
+			PacketLanes< F4 > l(packets[p]);
+			F4 mask = l.overlaps(swept_min, swept_max);
+			if (!bits(mask)) continue;
+			F4 nx = l.e1y * l.e2z - l.e1z * l.e2y, ny = l.e1z * l.e2x - l.e1x * l.e2z, nz = l.e1x * l.e2y - l.e1y * l.e2x;
+			F4 reach = F4::splat(radius) * sqrt4(nx * nx + ny * ny + nz * nz); //(radius, in units of |n|)
+			F4 above = F4::all_lanes(), below = F4::all_lanes(); //(all four ends entirely on one side?)
+			for (auto const &end : ends) {
+				F4 s = (F4::splat(end.x) - l.ax) * nx + (F4::splat(end.y) - l.ay) * ny + (F4::splat(end.z) - l.az) * nz;
+				above = above & (s > reach);
+				below = below & (s < F4::splat(0.0f) - reach);
+			}
+			uint32_t candidates = bits(mask) & ~(bits(above) | bits(below));
+
+			//exact tests for the rest:
+			for (uint32_t lane = 0; lane < 4; ++lane) {
+				if (!(candidates & (1 << lane))) continue;
+				CollisionMesh::Packet const &packet = packets[p];
+				float t;
+				glm::vec3 point, normal;
+				if (CollisionMesh::sweep_triangle(a, b, radius, displacement, corner_a(packet, lane), corner_b(packet, lane), corner_c(packet, lane), best, &t, &point, &normal)) {
+					if (!found || t < best) {
+						best = t;
+						found = true;
+						hit->t = t;
+						hit->triangle = packet.triangle[lane];
+						hit->point = point;
+						hit->normal = normal;
+					}
+				}
+			}
+		}
+		return best > 0.0f; //(can't do better than touching at the start)
+	});
+	return found;
+}
+
+bool CollisionMesh::sweep(glm::vec3 const &a, glm::vec3 const &b, float radius, glm::vec3 const &displacement, Hit *hit) const {
+#ifdef COLLISION_MESH_SSE
+	if (lanes == SSE2) return sweep_lanes< F4SSE >(*this, a, b, radius, displacement, hit);
+#endif
+	return sweep_lanes< F4Scalar >(*this, a, b, radius, displacement, hit);
+}
+
+bool CollisionMesh::sweep_sphere(glm::vec3 const &center, float radius, glm::vec3 const &displacement, Hit *hit) const {
+	return sweep(center, center, radius, displacement, hit);
+}
+
+bool CollisionMesh::sweep_capsule(glm::vec3 const &a, glm::vec3 const &b, float radius, glm::vec3 const &displacement, Hit *hit) const {
+	return sweep(a, b, radius, displacement, hit);
+}
+
+//--------------------------------
+//boxes:
+
+template< typename F4 >
+static void query_box_lanes(CollisionMesh const &mesh, glm::vec3 const &box_min, glm::vec3 const &box_max, std::function< bool(uint32_t triangle, glm::vec3 const &a, glm::vec3 const &b, glm::vec3 const &c) > const &callback) {
+	std::vector< CollisionMesh::Node > const &nodes = mesh.nodes;
+	std::vector< CollisionMesh::Packet > const &packets = mesh.packets;
+	if (nodes.empty()) return;
+	uint32_t stack[CollisionMesh::MaxDepth + 2];
+	uint32_t top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		CollisionMesh::Node const &node = nodes[stack[--top]];
+		if (!(node.min.x <= box_max.x && box_min.x <= node.max.x
+		   && node.min.y <= box_max.y && box_min.y <= node.max.y
+		   && node.min.z <= box_max.z && box_min.z <= node.max.z)) continue;
+		if (node.count == 0) {
+			stack[top++] = node.first;
+			stack[top++] = uint32_t(&node - nodes.data()) + 1;
+			continue;
+		}
+		for (uint32_t p = node.first; p < node.first + node.count; ++p) {
+			uint32_t hits = bits(PacketLanes< F4 >(packets[p]).overlaps(box_min, box_max));
+			for (uint32_t lane = 0; lane < 4; ++lane) {
+				if (!(hits & (1 << lane))) continue;
+				CollisionMesh::Packet const &packet = packets[p];
+				if (!callback(packet.triangle[lane], corner_a(packet, lane), corner_b(packet, lane), corner_c(packet, lane))) return;
+			}
+		}
+	}
+}
+
+void CollisionMesh::query_box(glm::vec3 const &box_min, glm::vec3 const &box_max, std::function< bool(uint32_t triangle, glm::vec3 const &a, glm::vec3 const &b, glm::vec3 const &c) > const &callback) const {
+#ifdef COLLISION_MESH_SSE
+	if (lanes == SSE2) {
+		query_box_lanes< F4SSE >(*this, box_min, box_max, callback);
+		return;
+	}
+#endif
+	query_box_lanes< F4Scalar >(*this, box_min, box_max, callback);
+}
+
+//--------------------------------
+//through a transform:
+
+//smallest factor by which to_world scales lengths (exact for rotation + scale):
+static float smallest_scale(glm::mat4x3 const &to_world) {
+	return std::min(std::min(glm::length(to_world[0]), glm::length(to_world[1])), glm::length(to_world[2]));
+}
+
+//bring an object-space hit back to world space:
+static void hit_to_world(glm::mat4x3 const &to_world, glm::mat4x3 const &to_local, CollisionMesh::Hit *hit) {
+	hit->point = to_world * glm::vec4(hit->point, 1.0f);
+	//(normals transform by the inverse transpose)
+	hit->normal = glm::normalize(glm::transpose(glm::mat3(to_local)) * hit->normal);
+}
+
+bool CollisionMesh::ray_cast(glm::mat4x3 const &to_world, glm::mat4x3 const &to_local, glm::vec3 const &origin, glm::vec3 const &direction, float max_t, Hit *hit) const {
+	//(t is the same in both spaces, since the direction goes through the same linear map)
+	if (!ray_cast(to_local * glm::vec4(origin, 1.0f), glm::mat3(to_local) * direction, max_t, hit)) return false;
+	hit_to_world(to_world, to_local, hit);
+	return true;
+}
+
+bool CollisionMesh::sweep_sphere(glm::mat4x3 const &to_world, glm::mat4x3 const &to_local, glm::vec3 const &center, float radius, glm::vec3 const &displacement, Hit *hit) const {
+	glm::vec3 local = to_local * glm::vec4(center, 1.0f);
+	if (!sweep(local, local, radius / smallest_scale(to_world), glm::mat3(to_local) * displacement, hit)) return false;
+	hit_to_world(to_world, to_local, hit);
+	return true;
+}
+
+bool CollisionMesh::sweep_capsule(glm::mat4x3 const &to_world, glm::mat4x3 const &to_local, glm::vec3 const &a, glm::vec3 const &b, float radius, glm::vec3 const &displacement, Hit *hit) const {
+	if (!sweep(to_local * glm::vec4(a, 1.0f), to_local * glm::vec4(b, 1.0f), radius / smallest_scale(to_world), glm::mat3(to_local) * displacement, hit)) return false;
+	hit_to_world(to_world, to_local, hit);
+	return true;
+}
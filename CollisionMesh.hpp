@@ -0,0 +1,107 @@
+#pragma once
+
+/*
+ * A CollisionMesh is a CPU-side copy of a mesh's triangles with a bounding volume
+ *  hierarchy over them, for exact collision queries (rather than ones against the
+ *  Mesh::min/max box):
+ *  - ray_cast() finds the first triangle along a ray;
+ *  - sweep_sphere() / sweep_capsule() find where a moving sphere / capsule first touches;
+ *  - query_box() lists the triangles whose bounds overlap a box.
+ *
+ * The hierarchy is built top-down, split by the surface area heuristic over binned
+ *  triangle centroids. Leaves store their triangles four at a time in "packets"
+ *  (structure-of-arrays), so queries test four triangles at once with SIMD (SSE2 where
+ *  available, otherwise four-wide loops that compilers can vectorize; see 'lanes').
+ *
+ * Queries are in the mesh's object space; the overloads that take a transform
+ *  (e.g., Scene::Transform::make_local_to_world() and make_world_to_local()) take and
+ *  return world-space values.
+ *
+ * MeshBuffer builds these as it loads when asked to (see Mesh::collision).
+ *
+ */
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <vector>
+
+struct CollisionMesh {
+	//build from an indexed triangle list:
+	// (vertex positions are read from 'positions' + index * position_stride)
+	CollisionMesh(uint32_t const *indices, size_t index_count, void const *positions, size_t position_stride);
+	CollisionMesh() = default;
+
+	struct Hit {
+		float t = std::numeric_limits< float >::infinity(); //for rays, in units of 'direction'; for sweeps, the fraction of 'displacement'
+		uint32_t triangle = -1U; //which triangle (its first index, divided by three)
+		glm::vec3 point = glm::vec3(0.0f); //point of contact (on the triangle)
+		glm::vec3 normal = glm::vec3(0.0f); //unit normal at the contact, facing the ray / shape
+	};
+
+	//Queries return true (and fill in *hit) if anything was hit:
+	//first triangle (from either side) hit by origin + t * direction, 0 <= t <= max_t:
+	bool ray_cast(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, Hit *hit) const;
+	//first contact as a sphere moves from 'center' to 'center + displacement':
+	// (a sphere that is already touching something hits it at t = 0)
+	bool sweep_sphere(glm::vec3 const &center, float radius, glm::vec3 const &displacement, Hit *hit) const;
+	//...same for a capsule (the points within 'radius' of segment a-b):
+	bool sweep_capsule(glm::vec3 const &a, glm::vec3 const &b, float radius, glm::vec3 const &displacement, Hit *hit) const;
+	//triangles whose bounds overlap [min,max], with their corners (callback returns 'false' to stop early):
+	void query_box(glm::vec3 const &min, glm::vec3 const &max, std::function< bool(uint32_t triangle, glm::vec3 const &a, glm::vec3 const &b, glm::vec3 const &c) > const &callback) const;
+
+	//The same, for a mesh drawn with a transform:
+	// (radii are scaled by the transform's smallest scale factor, so sweeps stay conservative under non-uniform scale)
+	bool ray_cast(glm::mat4x3 const &to_world, glm::mat4x3 const &to_local, glm::vec3 const &origin, glm::vec3 const &direction, float max_t, Hit *hit) const;
+	bool sweep_sphere(glm::mat4x3 const &to_world, glm::mat4x3 const &to_local, glm::vec3 const &center, float radius, glm::vec3 const &displacement, Hit *hit) const;
+	bool sweep_capsule(glm::mat4x3 const &to_world, glm::mat4x3 const &to_local, glm::vec3 const &a, glm::vec3 const &b, float radius, glm::vec3 const &displacement, Hit *hit) const;
+
+	size_t triangle_count = 0;
+	//bounds of all the triangles:
+	glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+	glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
+	//-- internals ---
+
+	//hierarchy nodes, depth-first (so an interior node's first child is right after it):
+	struct Node {
+		glm::vec3 min;
+		uint32_t first; //leaves: first packet; interior nodes: second child
+		glm::vec3 max;
+		uint32_t count; //leaves: number of packets; interior nodes: 0
+	};
+	static_assert(sizeof(Node) == 32, "Node is packed.");
+	std::vector< Node > nodes;
+
+	//four triangles as corner 'a' and edges 'e1' = b - a, 'e2' = c - a:
+	// (unused lanes have a NaN corner, so no test ever passes for them)
+	struct alignas(16) Packet {
+		float ax[4], ay[4], az[4];
+		float e1x[4], e1y[4], e1z[4];
+		float e2x[4], e2y[4], e2z[4];
+		uint32_t triangle[4];
+	};
+	std::vector< Packet > packets;
+
+	//leaves are made at this depth no matter what, which bounds the query stacks:
+	static constexpr uint32_t MaxDepth = 48;
+
+	//shared by the sweeps (segment a-b, radius, displacement; a sphere has a == b):
+	bool sweep(glm::vec3 const &a, glm::vec3 const &b, float radius, glm::vec3 const &displacement, Hit *hit) const;
+
+	//first t in [0,max_t] at which segment p-q moved by t * d comes within 'radius' of triangle abc:
+	// (the exact test the sweeps run on each triangle that packet culling doesn't rule out)
+	static bool sweep_triangle(glm::vec3 const &p, glm::vec3 const &q, float radius, glm::vec3 const &d, glm::vec3 const &a, glm::vec3 const &b, glm::vec3 const &c, float max_t, float *t, glm::vec3 *point, glm::vec3 *normal);
+
+	//which four-wide code the queries use -- SSE2 where it was compiled in (BestLanes), else plain C++:
+	// (both give the same answers; the choice is per mesh so tests can compare them)
+	enum Lanes : uint8_t {
+		Scalar = 0,
+		SSE2 = 1, //(falls back to Scalar where SSE2 wasn't compiled in)
+	};
+	static Lanes const BestLanes;
+	Lanes lanes = BestLanes;
+};
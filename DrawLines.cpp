@@ -6,12 +6,92 @@
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <cstring>
+
 //All DrawLines instances share a vertex array object and vertex buffer, initialized at load time:
 
 //n.b. declared static so they don't conflict with similarly named global variables elsewhere:
 static GLuint vertex_buffer = 0;
 static GLuint vertex_buffer_for_color_program = 0;
 
+//vertex_buffer is used as a ring: each DrawLines appends its vertices after the previous one's
+// (writing with unsynchronized maps, so the driver never has to stall or reallocate), wrapping around
+// to the start when it reaches the end. The ring is split into sections, each fenced once the
+// ring has moved past it, so wrapping around only waits if the GPU is a whole ring behind:
+namespace {
+	struct LineRing {
+		static constexpr uint32_t Sections = 4;
+		GLsizeiptr capacity = 0; //bytes (a multiple of Sections * sizeof(DrawLines::Vertex))
+		GLsizeiptr head = 0; //where the next write goes
+		uint32_t section = Sections; //section holding the latest write, which has no fence yet (Sections => none)
+		GLsync fences[Sections] = {};
+
+		GLsizeiptr section_size() const { return capacity / Sections; }
+
+		void wait(uint32_t s) {
+			if (!fences[s]) return;
+			while (glClientWaitSync(fences[s], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull) == GL_TIMEOUT_EXPIRED) { }
+			glDeleteSync(fences[s]);
+			fences[s] = 0;
+		}
+
+		void fence(uint32_t s) {
+			if (fences[s]) glDeleteSync(fences[s]); //(can't be in use -- the new fence covers everything the old one did)
+			fences[s] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		}
+
+		//reserve 'size' bytes in the ring (vertex_buffer must be bound to GL_ARRAY_BUFFER); returns their offset:
+		GLsizeiptr begin_write(GLsizeiptr size) {
+			//batches much bigger than a section would wait on too much of the ring, so grow it instead:
+			// (re-specifying the storage orphans the old storage, so nothing needs to wait for it)
+			if (size > capacity / 2) {
+				GLsizeiptr quantum = Sections * sizeof(DrawLines::Vertex);
+				capacity = std::max< GLsizeiptr >(4 << 20, 4 * size);
+				capacity = (capacity + quantum - 1) / quantum * quantum;
+				glBufferData(GL_ARRAY_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+				for (uint32_t s = 0; s < Sections; ++s) {
+					if (fences[s]) glDeleteSync(fences[s]);
+					fences[s] = 0;
+				}
+				head = 0;
+				section = Sections;
+			}
+
+			GLsizeiptr begin = head;
+			if (begin + size > capacity) {
+				//wrap around (everything reading the latest section has already been issued):
+				if (section != Sections) fence(section);
+				begin = 0;
+				section = Sections;
+			}
+
+			//wait for the sections the write goes into (other than the one already being written):
+			uint32_t first = uint32_t(begin / section_size());
+			uint32_t last = uint32_t((begin + size - 1) / section_size());
+			for (uint32_t s = first; s <= last; ++s) {
+				if (s != section) wait(s);
+			}
+			return begin;
+		}
+
+		//after drawing from the write at 'begin', fence the sections the ring has moved past:
+		void end_write(GLsizeiptr begin, GLsizeiptr size) {
+			head = begin + size;
+			uint32_t first = (section != Sections ? section : uint32_t(begin / section_size()));
+			uint32_t last = uint32_t((head - 1) / section_size());
+			for (uint32_t s = first; s < last; ++s) {
+				fence(s);
+			}
+			section = last;
+		}
+	};
+	LineRing ring;
+
+	//vertex storage is handed from one DrawLines to the next, so it's only allocated once it's big enough:
+	std::vector< std::vector< DrawLines::Vertex > > spare_attribs;
+}
+
 static Load< void > setup_buffers(LoadTagDefault, [](){
 	//you may recognize this init code from DrawSprites.cpp:
 
@@ -64,6 +144,10 @@ static Load< void > setup_buffers(LoadTagDefault, [](){
 
 
 DrawLines::DrawLines(glm::mat4 const &world_to_clip_) : world_to_clip(world_to_clip_) {
+	if (!spare_attribs.empty()) {
+		attribs.swap(spare_attribs.back());
+		spare_attribs.pop_back();
+	}
 }
 
 void DrawLines::draw(glm::vec3 const &a, glm::vec3 const &b, glm::u8vec4 const &color) {
@@ -133,13 +217,24 @@ void DrawLines::draw_text(std::string const &text, glm::vec3 const &anchor_in, g
 }
 
 DrawLines::~DrawLines() {
-	if (attribs.empty()) return;
+	if (attribs.empty()) {
+		spare_attribs.emplace_back(std::move(attribs));
+		return;
+	}
 
 	//based on DrawSprites.cpp :
 
-	//upload vertices to vertex_buffer:
+	//append vertices to the vertex_buffer ring:
 	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer); //set vertex_buffer as current
-	glBufferData(GL_ARRAY_BUFFER, attribs.size() * sizeof(attribs[0]), attribs.data(), GL_STREAM_DRAW); //upload attribs array
+	GLsizeiptr size = GLsizeiptr(attribs.size() * sizeof(attribs[0]));
+	GLsizeiptr begin = ring.begin_write(size);
+	//(unsynchronized: the ring's fences already guarantee the GPU is done with this range)
+	void *mapped = glMapBufferRange(GL_ARRAY_BUFFER, begin, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (mapped) std::memcpy(mapped, attribs.data(), size);
+	if (!mapped || glUnmapBuffer(GL_ARRAY_BUFFER) != GL_TRUE) {
+		//(couldn't map, or the contents were lost while mapped)
+		glBufferSubData(GL_ARRAY_BUFFER, begin, size, attribs.data());
+	}
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
 	//set color_program as current program:
@@ -152,13 +247,18 @@ DrawLines::~DrawLines() {
 	glBindVertexArray(vertex_buffer_for_color_program);
 
 	//run the OpenGL pipeline:
-	glDrawArrays(GL_LINES, 0, GLsizei(attribs.size()));
+	glDrawArrays(GL_LINES, GLint(begin / sizeof(attribs[0])), GLsizei(attribs.size()));
+	ring.end_write(begin, size);
 
 	//reset vertex array to none:
 	glBindVertexArray(0);
 
 	//reset current program to none:
 	glUseProgram(0);
+
+	//keep the storage for the next DrawLines:
+	attribs.clear();
+	spare_attribs.emplace_back(std::move(attribs));
 }
 
 
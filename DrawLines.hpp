@@ -34,6 +34,7 @@ struct DrawLines {
 		glm::vec3 *anchor_out = nullptr);
 
 	//Finish drawing (push attribs to GPU):
+	// (vertices from all DrawLines go into one streaming ring buffer, and 'attribs' storage is reused by later DrawLines)
 	~DrawLines();
 
 
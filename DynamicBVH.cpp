@@ -0,0 +1,389 @@
+#include "DynamicBVH.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <queue>
+
+static float surface_area(glm::vec3 const &min, glm::vec3 const &max) {
+	glm::vec3 d = max - min;
+	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+static bool contains(glm::vec3 const &outer_min, glm::vec3 const &outer_max, glm::vec3 const &min, glm::vec3 const &max) {
+	return outer_min.x <= min.x && outer_min.y <= min.y && outer_min.z <= min.z
+	    && max.x <= outer_max.x && max.y <= outer_max.y && max.z <= outer_max.z;
+}
+
+static bool overlaps(glm::vec3 const &a_min, glm::vec3 const &a_max, glm::vec3 const &b_min, glm::vec3 const &b_max) {
+	return a_min.x <= b_max.x && b_min.x <= a_max.x
+	    && a_min.y <= b_max.y && b_min.y <= a_max.y
+	    && a_min.z <= b_max.z && b_min.z <= a_max.z;
+}
+
+//squared distance from point to box (zero inside):
+static float distance2(glm::vec3 const &point, glm::vec3 const &min, glm::vec3 const &max) {
+	glm::vec3 d = point - glm::clamp(point, min, max);
+	return glm::dot(d, d);
+}
+
+//slab test; on hit, stores the (clamped to >= 0) entry distance:
+static bool ray_hits(glm::vec3 const &origin, glm::vec3 const &inv_direction, float max_t, glm::vec3 const &min, glm::vec3 const &max, float *t_enter) {
+	glm::vec3 t0 = (min - origin) * inv_direction;
+	glm::vec3 t1 = (max - origin) * inv_direction;
+	glm::vec3 near = glm::min(t0, t1);
+	glm::vec3 far = glm::max(t0, t1);
+	float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+	float exit = std::min(std::min(far.x, far.y), std::min(far.z, max_t));
+	if (!(enter <= exit)) return false;
+	*t_enter = enter;
+	return true;
+}
+
+DynamicBVH::Proxy DynamicBVH::allocate() {
+	if (free_list == Null) {
+		nodes.emplace_back();
+		return Proxy(nodes.size() - 1);
+	}
+	Proxy index = free_list;
+	free_list = nodes[index].parent;
+	nodes[index] = Node();
+	return index;
+}
+
+void DynamicBVH::release(Proxy index) {
+	nodes[index].height = -1;
+	nodes[index].user = nullptr;
+	nodes[index].parent = free_list;
+	free_list = index;
+}
+
+DynamicBVH::Proxy DynamicBVH::insert(glm::vec3 const &min, glm::vec3 const &max, void *user) {
+	Proxy leaf = allocate();
+	Node &node = nodes[leaf];
+	node.tight_min = min;
+	node.tight_max = max;
+	node.min = min - glm::vec3(margin);
+	node.max = max + glm::vec3(margin);
+	node.user = user;
+	node.height = 0;
+	insert_leaf(leaf);
+	++count;
+	return leaf;
+}
+
+void DynamicBVH::remove(Proxy proxy) {
+	assert(proxy < nodes.size() && nodes[proxy].is_leaf() && nodes[proxy].height == 0);
+	remove_leaf(proxy);
+	release(proxy);
+	--count;
+}
+
+bool DynamicBVH::move(Proxy proxy, glm::vec3 const &min, glm::vec3 const &max) {
+	assert(proxy < nodes.size() && nodes[proxy].is_leaf() && nodes[proxy].height == 0);
+	nodes[proxy].tight_min = min;
+	nodes[proxy].tight_max = max;
+	if (contains(nodes[proxy].min, nodes[proxy].max, min, max)) return false;
+
+	remove_leaf(proxy);
+	nodes[proxy].min = min - glm::vec3(margin);
+	nodes[proxy].max = max + glm::vec3(margin);
+	insert_leaf(proxy);
+	return true;
+}
+
+void DynamicBVH::clear() {
+	nodes.clear();
+	root = Null;
+	free_list = Null;
+	count = 0;
+}
+
+void DynamicBVH::insert_leaf(Proxy leaf) {
+	if (root == Null) {
+		root = leaf;
+		nodes[leaf].parent = Null;
+		return;
+	}
+
+	glm::vec3 leaf_min = nodes[leaf].min;
+	glm::vec3 leaf_max = nodes[leaf].max;
+
+	//walk down, choosing the sibling that adds the least surface area:
+	Proxy index = root;
+	while (!nodes[index].is_leaf()) {
+		Node const &node = nodes[index];
+		float area = surface_area(node.min, node.max);
+		float combined = surface_area(glm::min(node.min, leaf_min), glm::max(node.max, leaf_max));
+
+		//cost of making a new parent for this node and the leaf:
+		float cost = 2.0f * combined;
+		//every ancestor of a deeper placement also grows by this much:
+		float inherited = 2.0f * (combined - area);
+
+		auto descend_cost = [&](Proxy c) {
+			Node const &child = nodes[c];
+			float grown = surface_area(glm::min(child.min, leaf_min), glm::max(child.max, leaf_max));
+			if (child.is_leaf()) return grown + inherited;
+			return grown - surface_area(child.min, child.max) + inherited;
+		};
+		float cost0 = descend_cost(node.child[0]);
+		float cost1 = descend_cost(node.child[1]);
+
+		if (cost < cost0 && cost < cost1) break;
+		index = (cost0 < cost1 ? node.child[0] : node.child[1]);
+	}
+	Proxy sibling = index;
+
+	//new parent for sibling and leaf:
+	Proxy old_parent = nodes[sibling].parent;
+	Proxy new_parent = allocate(); //(n.b. may reallocate 'nodes')
+	nodes[new_parent].parent = old_parent;
+	nodes[new_parent].min = glm::min(nodes[sibling].min, leaf_min);
+	nodes[new_parent].max = glm::max(nodes[sibling].max, leaf_max);
+	nodes[new_parent].height = nodes[sibling].height + 1;
+	nodes[new_parent].child[0] = sibling;
+	nodes[new_parent].child[1] = leaf;
+
+	if (old_parent != Null) {
+		if (nodes[old_parent].child[0] == sibling) nodes[old_parent].child[0] = new_parent;
+		else nodes[old_parent].child[1] = new_parent;
+	} else {
+		root = new_parent;
+	}
+	nodes[sibling].parent = new_parent;
+	nodes[leaf].parent = new_parent;
+
+	refit(new_parent);
+}
+
+void DynamicBVH::remove_leaf(Proxy leaf) {
+	if (leaf == root) {
+		root = Null;
+		return;
+	}
+
+	Proxy parent = nodes[leaf].parent;
+	Proxy grandparent = nodes[parent].parent;
+	Proxy sibling = (nodes[parent].child[0] == leaf ? nodes[parent].child[1] : nodes[parent].child[0]);
+
+	//sibling takes the parent's place:
+	if (grandparent != Null) {
+		if (nodes[grandparent].child[0] == parent) nodes[grandparent].child[0] = sibling;
+		else nodes[grandparent].child[1] = sibling;
+		nodes[sibling].parent = grandparent;
+		release(parent);
+		refit(grandparent);
+	} else {
+		root = sibling;
+		nodes[sibling].parent = Null;
+		release(parent);
+	}
+	nodes[leaf].parent = Null;
+}
+
+void DynamicBVH::refit(Proxy index) {
+	while (index != Null) {
+		index = balance(index);
+
+		Node &node = nodes[index];
+		Node const &a = nodes[node.child[0]];
+		Node const &b = nodes[node.child[1]];
+		node.height = 1 + std::max(a.height, b.height);
+		node.min = glm::min(a.min, b.min);
+		node.max = glm::max(a.max, b.max);
+
+		index = node.parent;
+	}
+}
+
+DynamicBVH::Proxy DynamicBVH::balance(Proxy iA) {
+	Node &A = nodes[iA];
+	if (A.is_leaf() || A.height < 2) return iA;
+
+	Proxy iB = A.child[0];
+	Proxy iC = A.child[1];
+	Node &B = nodes[iB];
+	Node &C = nodes[iC];
+
+	int32_t balance = C.height - B.height;
+
+	//rotate C up:
+	if (balance > 1) {
+		Proxy iF = C.child[0];
+		Proxy iG = C.child[1];
+		Node &F = nodes[iF];
+		Node &G = nodes[iG];
+
+		C.child[0] = iA;
+		C.parent = A.parent;
+		A.parent = iC;
+		if (C.parent != Null) {
+			if (nodes[C.parent].child[0] == iA) nodes[C.parent].child[0] = iC;
+			else nodes[C.parent].child[1] = iC;
+		} else {
+			root = iC;
+		}
+
+		//the taller of C's children stays with C:
+		if (F.height > G.height) {
+			C.child[1] = iF;
+			A.child[1] = iG;
+			G.parent = iA;
+			A.min = glm::min(B.min, G.min); A.max = glm::max(B.max, G.max);
+			C.min = glm::min(A.min, F.min); C.max = glm::max(A.max, F.max);
+			A.height = 1 + std::max(B.height, G.height);
+			C.height = 1 + std::max(A.height, F.height);
+		} else {
+			C.child[1] = iG;
+			A.child[1] = iF;
+			F.parent = iA;
+			A.min = glm::min(B.min, F.min); A.max = glm::max(B.max, F.max);
+			C.min = glm::min(A.min, G.min); C.max = glm::max(A.max, G.max);
+			A.height = 1 + std::max(B.height, F.height);
+			C.height = 1 + std::max(A.height, G.height);
+		}
+		return iC;
+	}
+
+	//rotate B up:
+	if (balance < -1) {
+		Proxy iD = B.child[0];
+		Proxy iE = B.child[1];
+		Node &D = nodes[iD];
+		Node &E = nodes[iE];
+
+		B.child[0] = iA;
+		B.parent = A.parent;
+		A.parent = iB;
+		if (B.parent != Null) {
+			if (nodes[B.parent].child[0] == iA) nodes[B.parent].child[0] = iB;
+			else nodes[B.parent].child[1] = iB;
+		} else {
+			root = iB;
+		}
+
+		if (D.height > E.height) {
+			B.child[1] = iD;
+			A.child[0] = iE;
+			E.parent = iA;
+			A.min = glm::min(C.min, E.min); A.max = glm::max(C.max, E.max);
+			B.min = glm::min(A.min, D.min); B.max = glm::max(A.max, D.max);
+			A.height = 1 + std::max(C.height, E.height);
+			B.height = 1 + std::max(A.height, D.height);
+		} else {
+			B.child[1] = iE;
+			A.child[0] = iD;
+			D.parent = iA;
+			A.min = glm::min(C.min, D.min); A.max = glm::max(C.max, D.max);
+			B.min = glm::min(A.min, E.min); B.max = glm::max(A.max, E.max);
+			A.height = 1 + std::max(C.height, D.height);
+			B.height = 1 + std::max(A.height, E.height);
+		}
+		return iB;
+	}
+
+	return iA;
+}
+
+//-------------------------
+
+void DynamicBVH::query_box(glm::vec3 const &min, glm::vec3 const &max, std::function< bool(Proxy) > const &callback) const {
+	if (root == Null) return;
+	std::vector< Proxy > stack;
+	stack.reserve(64);
+	stack.emplace_back(root);
+	while (!stack.empty()) {
+		Node const &node = nodes[stack.back()];
+		Proxy index = stack.back();
+		stack.pop_back();
+		if (!overlaps(node.min, node.max, min, max)) continue;
+		if (node.is_leaf()) {
+			if (overlaps(node.tight_min, node.tight_max, min, max)) {
+				if (!callback(index)) return;
+			}
+		} else {
+			stack.emplace_back(node.child[0]);
+			stack.emplace_back(node.child[1]);
+		}
+	}
+}
+
+void DynamicBVH::query_sphere(glm::vec3 const &center, float radius, std::function< bool(Proxy) > const &callback) const {
+	if (root == Null) return;
+	float radius2 = radius * radius;
+	std::vector< Proxy > stack;
+	stack.reserve(64);
+	stack.emplace_back(root);
+	while (!stack.empty()) {
+		Node const &node = nodes[stack.back()];
+		Proxy index = stack.back();
+		stack.pop_back();
+		if (distance2(center, node.min, node.max) > radius2) continue;
+		if (node.is_leaf()) {
+			if (distance2(center, node.tight_min, node.tight_max) <= radius2) {
+				if (!callback(index)) return;
+			}
+		} else {
+			stack.emplace_back(node.child[0]);
+			stack.emplace_back(node.child[1]);
+		}
+	}
+}
+
+void DynamicBVH::ray_cast(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, std::function< float(Proxy, float) > const &callback) const {
+	if (root == Null) return;
+	glm::vec3 inv_direction = 1.0f / direction;
+	std::vector< Proxy > stack;
+	stack.reserve(64);
+	stack.emplace_back(root);
+	while (!stack.empty()) {
+		Node const &node = nodes[stack.back()];
+		Proxy index = stack.back();
+		stack.pop_back();
+		float t;
+		if (!ray_hits(origin, inv_direction, max_t, node.min, node.max, &t)) continue;
+		if (node.is_leaf()) {
+			if (ray_hits(origin, inv_direction, max_t, node.tight_min, node.tight_max, &t)) {
+				max_t = std::min(max_t, callback(index, t));
+				if (max_t <= 0.0f) return;
+			}
+		} else {
+			stack.emplace_back(node.child[0]);
+			stack.emplace_back(node.child[1]);
+		}
+	}
+}
+
+DynamicBVH::Proxy DynamicBVH::nearest(glm::vec3 const &point, float max_distance, float *distance) const {
+	if (root == Null) return Null;
+
+	//best-first search; node boxes are lower bounds on the distance to anything inside them:
+	typedef std::pair< float, Proxy > Entry;
+	std::priority_queue< Entry, std::vector< Entry >, std::greater< Entry > > queue;
+
+	float best2 = max_distance * max_distance;
+	Proxy best = Null;
+	queue.emplace(distance2(point, nodes[root].min, nodes[root].max), root);
+	while (!queue.empty()) {
+		Entry entry = queue.top();
+		queue.pop();
+		if (entry.first > best2) break;
+		Node const &node = nodes[entry.second];
+		if (node.is_leaf()) {
+			float d2 = distance2(point, node.tight_min, node.tight_max);
+			if (d2 <= best2) {
+				best2 = d2;
+				best = entry.second;
+			}
+		} else {
+			for (Proxy c : node.child) {
+				float d2 = distance2(point, nodes[c].min, nodes[c].max);
+				if (d2 <= best2) queue.emplace(d2, c);
+			}
+		}
+	}
+
+	if (best != Null && distance) *distance = std::sqrt(best2);
+	return best;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+/*
+ * DynamicBVH is a bounding volume hierarchy over axis-aligned boxes that can be
+ * changed incrementally (objects inserted, moved, and removed) without rebuilding.
+ *
+ * Each object ("proxy") is stored with its exact box and a slightly enlarged ("fat")
+ * box; moving an object only restructures the tree when its exact box leaves its fat box.
+ * Internal nodes are kept height-balanced by rotations, and new leaves are placed where
+ * they increase total box surface area the least.
+ *
+ */
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <vector>
+
+struct DynamicBVH {
+	typedef uint32_t Proxy;
+	static constexpr Proxy Null = -1U;
+
+	//leaf boxes are enlarged by this much on each side so small motions don't touch the tree:
+	float margin = 0.1f;
+
+	//add an object with bounds [min,max]; 'user' is returned by user() for convenience:
+	Proxy insert(glm::vec3 const &min, glm::vec3 const &max, void *user);
+	void remove(Proxy proxy);
+	//update an object's bounds; returns true if the tree had to be restructured:
+	bool move(Proxy proxy, glm::vec3 const &min, glm::vec3 const &max);
+	void clear();
+
+	void *user(Proxy proxy) const { return nodes[proxy].user; }
+	size_t size() const { return count; }
+
+	//Queries:
+	// (callbacks return 'false' to stop the query early)
+	//objects whose bounds overlap [min,max]:
+	void query_box(glm::vec3 const &min, glm::vec3 const &max, std::function< bool(Proxy) > const &callback) const;
+	//objects whose bounds overlap a sphere:
+	void query_sphere(glm::vec3 const &center, float radius, std::function< bool(Proxy) > const &callback) const;
+	//objects whose bounds a ray (origin + t * direction, 0 <= t <= max_t) hits, with the entry 't':
+	// callback returns the new max_t -- e.g., return 't' to look only for closer hits, or 0 to stop
+	void ray_cast(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, std::function< float(Proxy, float) > const &callback) const;
+	//object whose bounds are closest to 'point' (no further than max_distance), or Null:
+	Proxy nearest(glm::vec3 const &point, float max_distance = std::numeric_limits< float >::infinity(), float *distance = nullptr) const;
+
+	//internals:
+	struct Node {
+		glm::vec3 min = glm::vec3(0.0f), max = glm::vec3(0.0f); //fat bounds for leaves
+		glm::vec3 tight_min = glm::vec3(0.0f), tight_max = glm::vec3(0.0f); //exact bounds (leaves only)
+		Proxy parent = Null; //(next free node when on the free list)
+		Proxy child[2] = {Null, Null}; //both Null for leaves
+		int32_t height = 0; //0 for leaves, -1 for free nodes
+		void *user = nullptr;
+		bool is_leaf() const { return child[0] == Null; }
+	};
+	std::vector< Node > nodes;
+	Proxy root = Null;
+	Proxy free_list = Null;
+	size_t count = 0;
+
+	Proxy allocate();
+	void release(Proxy index);
+	void insert_leaf(Proxy leaf);
+	void remove_leaf(Proxy leaf);
+	void refit(Proxy index); //fix bounds and heights from index up to the root, rebalancing
+	Proxy balance(Proxy index); //rotate index's subtree if unbalanced; returns new subtree root
+};
@@ -0,0 +1,78 @@
+#include "FrameUniforms.hpp"
+
+#include "gl_errors.hpp"
+
+Load< FrameUniforms > frame_uniforms(LoadTagEarly);
+
+char const *FrameUniforms::CameraGLSL =
+	"layout(std140) uniform Camera {\n"
+	"	mat4 WORLD_TO_CLIP;\n"
+	"	mat4x3 WORLD_TO_LIGHT;\n"
+	"	mat3 NORMAL_WORLD_TO_LIGHT;\n"
+	"};\n"
+;
+
+char const *FrameUniforms::LightGLSL =
+	"layout(std140) uniform Light {\n"
+	"	int LIGHT_TYPE;\n"
+	"	float LIGHT_CUTOFF;\n"
+	"	vec3 LIGHT_LOCATION;\n"
+	"	vec3 LIGHT_DIRECTION;\n"
+	"	vec3 LIGHT_ENERGY;\n"
+	"};\n"
+;
+
+FrameUniforms::FrameUniforms() {
+	//allocate both buffers and attach them to their binding points:
+	// (binding points are global state, so this only needs to happen once)
+	glGenBuffers(1, &camera_buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, camera_buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(Camera), nullptr, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, CameraBinding, camera_buffer);
+
+	glGenBuffers(1, &light_buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, light_buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(Light), nullptr, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, LightBinding, light_buffer);
+
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	//start with identity camera + a default light:
+	set_camera(glm::mat4(1.0f), glm::mat4x3(1.0f));
+	set_light(Light());
+
+	GL_ERRORS(); //PARANOIA: make sure nothing strange happened during setup
+}
+
+FrameUniforms::~FrameUniforms() {
+	glDeleteBuffers(1, &camera_buffer);
+	camera_buffer = 0;
+	glDeleteBuffers(1, &light_buffer);
+	light_buffer = 0;
+}
+
+void FrameUniforms::bind_program(GLuint program) {
+	//blocks that a program doesn't use come back as GL_INVALID_INDEX, and are skipped:
+	GLuint camera_index = glGetUniformBlockIndex(program, "Camera");
+	if (camera_index != GL_INVALID_INDEX) glUniformBlockBinding(program, camera_index, CameraBinding);
+
+	GLuint light_index = glGetUniformBlockIndex(program, "Light");
+	if (light_index != GL_INVALID_INDEX) glUniformBlockBinding(program, light_index, LightBinding);
+}
+
+void FrameUniforms::set_camera(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+	Camera camera;
+	camera.WORLD_TO_CLIP = world_to_clip;
+	camera.WORLD_TO_LIGHT = glm::mat4(world_to_light);
+	camera.NORMAL_WORLD_TO_LIGHT = glm::mat3x4(glm::inverse(glm::transpose(glm::mat3(world_to_light))));
+
+	glBindBuffer(GL_UNIFORM_BUFFER, camera_buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Camera), &camera);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void FrameUniforms::set_light(Light const &light) const {
+	glBindBuffer(GL_UNIFORM_BUFFER, light_buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Light), &light);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
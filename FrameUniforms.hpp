@@ -0,0 +1,68 @@
+#pragma once
+
+/*
+ * Per-frame camera and light state, shared by every shader program through
+ *  std140 uniform buffer objects.
+ *
+ * Programs declare the blocks by pasting FrameUniforms::CameraGLSL and/or
+ *  FrameUniforms::LightGLSL into their shader source and calling
+ *  FrameUniforms::bind_program() once after linking.
+ *
+ * Scene::draw uploads the camera block; modes upload the light block
+ *  (once per frame) with set_light().
+ *
+ */
+
+#include "GL.hpp"
+#include "Load.hpp"
+
+#include <glm/glm.hpp>
+
+struct FrameUniforms {
+	FrameUniforms();
+	~FrameUniforms();
+
+	//Uniform buffer binding points used by the blocks:
+	enum : GLuint {
+		CameraBinding = 0,
+		LightBinding = 1,
+		ClustersBinding = 2, //(owned by ClusteredLights)
+	};
+
+	//CPU-side mirrors of the blocks, laid out as std140:
+	struct Camera {
+		glm::mat4 WORLD_TO_CLIP;
+		glm::mat4 WORLD_TO_LIGHT; //std140 mat4x3 has vec4-strided columns, so stored as a padded mat4
+		glm::mat3x4 NORMAL_WORLD_TO_LIGHT; //std140 mat3 -- likewise padded
+	};
+	static_assert(sizeof(Camera) == 4*16 + 4*16 + 4*12, "Camera block is std140.");
+
+	struct Light {
+		int32_t LIGHT_TYPE = 0; //0: point; 1: hemisphere; 2: spot; 3: directional
+		float LIGHT_CUTOFF = 1.0f;
+		float _pad0[2];
+		glm::vec3 LIGHT_LOCATION = glm::vec3(0.0f);
+		float _pad1;
+		glm::vec3 LIGHT_DIRECTION = glm::vec3(0.0f, 0.0f,-1.0f);
+		float _pad2;
+		glm::vec3 LIGHT_ENERGY = glm::vec3(1.0f);
+		float _pad3;
+	};
+	static_assert(sizeof(Light) == 4*16, "Light block is std140.");
+
+	//GLSL declarations of the blocks, for inclusion in shader source:
+	static char const *CameraGLSL;
+	static char const *LightGLSL;
+
+	//hook up any of the blocks that 'program' uses to the shared binding points:
+	static void bind_program(GLuint program);
+
+	//upload new block contents:
+	void set_camera(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const;
+	void set_light(Light const &light) const;
+
+	GLuint camera_buffer = 0;
+	GLuint light_buffer = 0;
+};
+
+extern Load< FrameUniforms > frame_uniforms;
@@ -1,5 +1,6 @@
 #include "LitColorTextureProgram.hpp"
 
+#include "FrameUniforms.hpp"
 #include "gl_compile_program.hpp"
 #include "gl_errors.hpp"
 #include <vector>
@@ -13,17 +14,15 @@ Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> L
 	//----- build the pipeline template -----
 	lit_color_texture_program_pipeline.program = ret->program;
 
-	lit_color_texture_program_pipeline.OBJECT_TO_CLIP_mat4 = ret->OBJECT_TO_CLIP_mat4;
-	lit_color_texture_program_pipeline.OBJECT_TO_LIGHT_mat4x3 = ret->OBJECT_TO_LIGHT_mat4x3;
-	lit_color_texture_program_pipeline.NORMAL_TO_LIGHT_mat3 = ret->NORMAL_TO_LIGHT_mat3;
+	lit_color_texture_program_pipeline.OBJECT_TO_WORLD_mat4x3 = ret->OBJECT_TO_WORLD_mat4x3;
+	lit_color_texture_program_pipeline.NORMAL_TO_WORLD_mat3 = ret->NORMAL_TO_WORLD_mat3;
 
-	/* This will be used later if/when we build a light loop into the Scene:
-	lit_color_texture_program_pipeline.LIGHT_TYPE_int = ret->LIGHT_TYPE_int;
-	lit_color_texture_program_pipeline.LIGHT_LOCATION_vec3 = ret->LIGHT_LOCATION_vec3;
-	lit_color_texture_program_pipeline.LIGHT_DIRECTION_vec3 = ret->LIGHT_DIRECTION_vec3;
-	lit_color_texture_program_pipeline.LIGHT_ENERGY_vec3 = ret->LIGHT_ENERGY_vec3;
-	lit_color_texture_program_pipeline.LIGHT_CUTOFF_float = ret->LIGHT_CUTOFF_float;
-	*/
+	lit_color_texture_program_pipeline.t_float = ret->t;
+	lit_color_texture_program_pipeline.TEX_sampler2D = ret->TEX;
+
+	lit_color_texture_program_pipeline.instanced.program = ret->instanced_program;
+	lit_color_texture_program_pipeline.instanced.t_float = ret->instanced_t;
+	lit_color_texture_program_pipeline.instanced.TEX_sampler2D = ret->instanced_TEX;
 
 	//make a 1-pixel white texture to bind by default:
 	GLuint tex;
@@ -70,13 +69,9 @@ Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> L
 });
 
 LitColorTextureProgram::LitColorTextureProgram() {
-	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
-	program = gl_compile_program(
-		//vertex shader:
-		"#version 330\n"
-		"uniform mat4 OBJECT_TO_CLIP;\n"
-		"uniform mat4x3 OBJECT_TO_LIGHT;\n"
-		"uniform mat3 NORMAL_TO_LIGHT;\n"
+	//Both variants share everything past the declaration of the object-to-* matrices:
+	std::string const vertex_shader_body =
+		std::string(FrameUniforms::CameraGLSL) +
 		"in vec4 Position;\n"
 		"in vec3 Normal;\n"
 		"in vec4 Color;\n"
@@ -86,21 +81,19 @@ LitColorTextureProgram::LitColorTextureProgram() {
 		"out vec4 color;\n"
 		"out vec2 texCoord;\n"
 		"void main() {\n"
-		"	gl_Position = OBJECT_TO_CLIP * Position;\n"
-		"	position = OBJECT_TO_LIGHT * Position;\n"
-		"	normal = NORMAL_TO_LIGHT * Normal;\n"
+		"	vec3 world_position = OBJECT_TO_WORLD * Position;\n"
+		"	gl_Position = WORLD_TO_CLIP * vec4(world_position, 1.0);\n"
+		"	position = WORLD_TO_LIGHT * vec4(world_position, 1.0);\n"
+		"	normal = NORMAL_WORLD_TO_LIGHT * (NORMAL_TO_WORLD * Normal);\n"
 		"	color = Color;\n"
 		"	texCoord = TexCoord;\n"
 		"}\n"
-		,
-		//fragment shader:
+	;
+
+	std::string const fragment_shader =
 		"#version 330\n"
+		+ std::string(FrameUniforms::LightGLSL) +
 		"uniform sampler2D TEX;\n"
-		"uniform int LIGHT_TYPE;\n"
-		"uniform vec3 LIGHT_LOCATION;\n"
-		"uniform vec3 LIGHT_DIRECTION;\n"
-		"uniform vec3 LIGHT_ENERGY;\n"
-		"uniform float LIGHT_CUTOFF;\n"
 		"uniform float t; \n"
 		"in vec3 position;\n"
 		"in vec3 normal;\n"
@@ -133,10 +126,34 @@ LitColorTextureProgram::LitColorTextureProgram() {
 		"	vec4 texColor = vec4(e*albedo.rgb, albedo.a);\n"
 		"	fragColor = vec4(1.0-t)*texColor + vec4(t)*(vec4(0.25,0.25,0.5,1.0));"
 		"}\n"
+	;
+
+	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
+	program = gl_compile_program(
+		//vertex shader:
+		"#version 330\n"
+		"uniform mat4x3 OBJECT_TO_WORLD;\n"
+		"uniform mat3 NORMAL_TO_WORLD;\n"
+		+ vertex_shader_body
+		,
+		//fragment shader:
+		fragment_shader
 	);
 	//As you can see above, adjacent strings in C/C++ are concatenated.
 	// this is very useful for writing long shader programs inline.
 
+	//instanced variant reads the matrices from (per-instance) attributes instead:
+	instanced_program = gl_compile_program(
+		//vertex shader:
+		"#version 330\n"
+		"in mat4x3 OBJECT_TO_WORLD;\n"
+		"in mat3 NORMAL_TO_WORLD;\n"
+		+ vertex_shader_body
+		,
+		//fragment shader:
+		fragment_shader
+	);
+
 	//look up the locations of vertex attributes:
 	Position_vec4 = glGetAttribLocation(program, "Position");
 	Normal_vec3 = glGetAttribLocation(program, "Normal");
@@ -144,24 +161,29 @@ LitColorTextureProgram::LitColorTextureProgram() {
 	TexCoord_vec2 = glGetAttribLocation(program, "TexCoord");
 
 	//look up the locations of uniforms:
-	OBJECT_TO_CLIP_mat4 = glGetUniformLocation(program, "OBJECT_TO_CLIP");
-	OBJECT_TO_LIGHT_mat4x3 = glGetUniformLocation(program, "OBJECT_TO_LIGHT");
-	NORMAL_TO_LIGHT_mat3 = glGetUniformLocation(program, "NORMAL_TO_LIGHT");
-
-	LIGHT_TYPE_int = glGetUniformLocation(program, "LIGHT_TYPE");
-	LIGHT_LOCATION_vec3 = glGetUniformLocation(program, "LIGHT_LOCATION");
-	LIGHT_DIRECTION_vec3 = glGetUniformLocation(program, "LIGHT_DIRECTION");
-	LIGHT_ENERGY_vec3 = glGetUniformLocation(program, "LIGHT_ENERGY");
-	LIGHT_CUTOFF_float = glGetUniformLocation(program, "LIGHT_CUTOFF");
+	OBJECT_TO_WORLD_mat4x3 = glGetUniformLocation(program, "OBJECT_TO_WORLD");
+	NORMAL_TO_WORLD_mat3 = glGetUniformLocation(program, "NORMAL_TO_WORLD");
 	t = glGetUniformLocation(program, "t");
 
+	TEX = glGetUniformLocation(program, "TEX");
+
+	//...and the same uniforms in the instanced variant:
+	instanced_t = glGetUniformLocation(instanced_program, "t");
+
+	instanced_TEX = glGetUniformLocation(instanced_program, "TEX");
 
-	GLuint TEX_sampler2D = glGetUniformLocation(program, "TEX");
+	//camera + light state come from shared uniform blocks:
+	FrameUniforms::bind_program(program);
+	FrameUniforms::bind_program(instanced_program);
 
-	//set TEX to always refer to texture binding zero:
+	//set TEX to refer to texture binding zero by default (Scene::draw switches it per-material):
 	glUseProgram(program); //bind program -- glUniform* calls refer to this program now
 
-	glUniform1i(TEX_sampler2D, 0); //set TEX to sample from GL_TEXTURE0
+	glUniform1i(TEX, 0); //set TEX to sample from GL_TEXTURE0
+
+	glUseProgram(instanced_program);
+
+	glUniform1i(instanced_TEX, 0);
 
 	glUseProgram(0); //unbind program -- glUniform* calls refer to ??? now
 }
@@ -169,5 +191,6 @@ LitColorTextureProgram::LitColorTextureProgram() {
 LitColorTextureProgram::~LitColorTextureProgram() {
 	glDeleteProgram(program);
 	program = 0;
+	glDeleteProgram(instanced_program);
+	instanced_program = 0;
 }
-
@@ -18,21 +18,22 @@ struct LitColorTextureProgram {
 	GLuint TexCoord_vec2 = -1U;
 
 	//Uniform (per-invocation variable) locations:
-	GLuint OBJECT_TO_CLIP_mat4 = -1U;
-	GLuint OBJECT_TO_LIGHT_mat4x3 = -1U;
-	GLuint NORMAL_TO_LIGHT_mat3 = -1U;
+	GLuint OBJECT_TO_WORLD_mat4x3 = -1U;
+	GLuint NORMAL_TO_WORLD_mat3 = -1U;
 	GLuint t = -1U;
 
-	//lighting:
-	GLuint LIGHT_TYPE_int = -1U;
-	GLuint LIGHT_LOCATION_vec3 = -1U;
-	GLuint LIGHT_DIRECTION_vec3 = -1U;
-	GLuint LIGHT_ENERGY_vec3 = -1U;
-	GLuint LIGHT_CUTOFF_float = -1U;
+	//camera + lighting come from the shared "Camera" and "Light" uniform blocks (see FrameUniforms.hpp)
 	
 	//Textures:
 	//TEXTURE0 - texture that is accessed by TexCoord
 	GLuint TEX = -1U;
+
+	//Instanced variant -- same shading, but OBJECT_TO_WORLD and NORMAL_TO_WORLD
+	// are per-instance attributes streamed by Scene::draw (see Scene::Instance):
+	GLuint instanced_program = 0;
+
+	GLuint instanced_t = -1U;
+	GLuint instanced_TEX = -1U;
 };
 
 extern Load< LitColorTextureProgram > lit_color_texture_program;
@@ -3,6 +3,10 @@
 #include <array>
 #include <list>
 #include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 
 namespace {
 	std::array< std::list< std::function< void() > >, MaxLoadTag > &get_load_lists() {
@@ -30,3 +34,91 @@ void call_load_functions() {
 		}
 	}
 }
+
+//------------- asynchronous loading --------------
+
+namespace {
+	//background thread that runs 'read' functions in order:
+	struct AsyncReader {
+		std::mutex mutex;
+		std::condition_variable cv;
+		std::deque< std::function< void() > > reads;
+		bool quit = false;
+		std::thread thread;
+
+		~AsyncReader() {
+			if (!thread.joinable()) return;
+			{
+				std::unique_lock< std::mutex > lock(mutex);
+				quit = true;
+			}
+			cv.notify_one();
+			thread.join();
+		}
+
+		void run() {
+			while (true) {
+				std::function< void() > fn;
+				{
+					std::unique_lock< std::mutex > lock(mutex);
+					cv.wait(lock, [this](){ return quit || !reads.empty(); });
+					if (quit) return;
+					fn = std::move(reads.front());
+					reads.pop_front();
+				}
+				fn();
+			}
+		}
+	};
+	AsyncReader &get_async_reader() {
+		static AsyncReader reader;
+		return reader;
+	}
+
+	//main-thread 'finish' functions:
+	struct AsyncFinishes {
+		std::mutex mutex;
+		std::deque< std::function< bool() > > finishes;
+	};
+	AsyncFinishes &get_async_finishes() {
+		static AsyncFinishes finishes;
+		return finishes;
+	}
+}
+
+void add_async_read(std::function< void() > const &fn) {
+	AsyncReader &reader = get_async_reader();
+	{
+		std::unique_lock< std::mutex > lock(reader.mutex);
+		if (!reader.thread.joinable()) {
+			reader.thread = std::thread(&AsyncReader::run, &reader);
+		}
+		reader.reads.emplace_back(fn);
+	}
+	reader.cv.notify_one();
+}
+
+void add_async_finish(std::function< bool() > const &fn) {
+	AsyncFinishes &finishes = get_async_finishes();
+	std::unique_lock< std::mutex > lock(finishes.mutex);
+	finishes.finishes.emplace_back(fn);
+}
+
+void update_async_loads(std::chrono::microseconds budget) {
+	AsyncFinishes &finishes = get_async_finishes();
+	auto start = std::chrono::high_resolution_clock::now();
+	do {
+		std::function< bool() > fn;
+		{
+			std::unique_lock< std::mutex > lock(finishes.mutex);
+			if (finishes.finishes.empty()) return;
+			fn = std::move(finishes.finishes.front());
+			finishes.finishes.pop_front();
+		}
+		//(the lock isn't held while calling, so finish functions may queue more work)
+		if (!fn()) {
+			std::unique_lock< std::mutex > lock(finishes.mutex);
+			finishes.finishes.emplace_front(std::move(fn));
+		}
+	} while (std::chrono::high_resolution_clock::now() - start < budget);
+}
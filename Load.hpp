@@ -20,9 +20,14 @@
  * These functions are grouped by 'tags', which allow some sequencing of calls.
  * (particularly, this is useful for loading large data blobs [e.g. Meshes] before looking up individual elements within them.)
  *
+ * For things that should load while the game keeps running (e.g., the next level), see load_async(), below.
+ *
  */
 
+#include <chrono>
 #include <functional>
+#include <future>
+#include <memory>
 #include <stdexcept>
 
 enum LoadTag : uint32_t {
@@ -79,3 +84,56 @@ struct Load< void > {
 };
 
 
+//Asynchronous loading:
+// load_async< T >(read, finish) calls 'read' on a background loading thread to do file I/O and parsing
+// (no OpenGL calls allowed there!), then calls 'finish' on the main thread -- from update_async_loads() --
+// to do any OpenGL work. 'finish' returns false if it wants to be called again (e.g., to upload a big buffer
+// a slice at a time), so that update_async_loads() can spread the work over several frames.
+// The returned future becomes ready when finish returns true, or holds whatever exception read or finish threw.
+//
+// //e.g.:
+// AsyncLoad< MeshBuffer > next_meshes = MeshBuffer::load_async(data_path("next.pnct"));
+// //later, once per frame:
+// if (next_meshes.wait_for(std::chrono::seconds(0)) == std::future_status::ready) { ... next_meshes.get() ... }
+
+template< typename T >
+using AsyncLoad = std::shared_future< std::shared_ptr< T const > >;
+
+//run a function on the (single, in-order) background loading thread:
+void add_async_read(std::function< void() > const &fn);
+//queue a function for the main thread; it is called (during update_async_loads) until it returns true:
+void add_async_finish(std::function< bool() > const &fn);
+
+//call queued 'finish' functions until 'budget' is used up (always makes some progress if anything is queued):
+// (call once per frame, from the thread that owns the OpenGL context)
+void update_async_loads(std::chrono::microseconds budget = std::chrono::microseconds(2000));
+
+template< typename T >
+AsyncLoad< T > load_async(std::function< T *() > const &read, std::function< bool(T &) > const &finish = nullptr) {
+	auto promise = std::make_shared< std::promise< std::shared_ptr< T const > > >();
+	AsyncLoad< T > ret = promise->get_future().share();
+	add_async_read([promise, read, finish]() {
+		std::shared_ptr< T > value;
+		try {
+			value.reset(read());
+			if (!value) throw std::runtime_error("Loading failed.");
+		} catch (...) {
+			promise->set_exception(std::current_exception());
+			return;
+		}
+		if (!finish) {
+			promise->set_value(value);
+			return;
+		}
+		add_async_finish([promise, value, finish]() -> bool {
+			try {
+				if (!finish(*value)) return false;
+				promise->set_value(value);
+			} catch (...) {
+				promise->set_exception(std::current_exception());
+			}
+			return true;
+		});
+	});
+	return ret;
+}
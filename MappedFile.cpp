@@ -0,0 +1,80 @@
+#include "MappedFile.hpp"
+
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+MappedFile::MappedFile(std::string const &filename) {
+	HANDLE f = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (f == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Failed to open '" + filename + "'.");
+	}
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(f, &file_size)) {
+		CloseHandle(f);
+		throw std::runtime_error("Failed to get size of '" + filename + "'.");
+	}
+	file = f;
+	size = size_t(file_size.QuadPart);
+	if (size == 0) return; //(empty files can't be mapped)
+
+	HANDLE m = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m == NULL) {
+		CloseHandle(f);
+		throw std::runtime_error("Failed to map '" + filename + "'.");
+	}
+	mapping = m;
+	data = reinterpret_cast< char const * >(MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0));
+	if (data == nullptr) {
+		CloseHandle(m);
+		CloseHandle(f);
+		throw std::runtime_error("Failed to map view of '" + filename + "'.");
+	}
+}
+
+MappedFile::~MappedFile() {
+	if (data) UnmapViewOfFile(data);
+	if (mapping) CloseHandle(mapping);
+	if (file) CloseHandle(file);
+}
+
+#else //POSIX
+
+MappedFile::MappedFile(std::string const &filename) {
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw std::runtime_error("Failed to open '" + filename + "'.");
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		close(fd);
+		throw std::runtime_error("Failed to get size of '" + filename + "'.");
+	}
+	size = size_t(info.st_size);
+	if (size == 0) { //(empty files can't be mapped)
+		close(fd);
+		return;
+	}
+
+	void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); //(mapping stays valid after the descriptor is closed)
+	if (mapped == MAP_FAILED) {
+		throw std::runtime_error("Failed to map '" + filename + "'.");
+	}
+	data = reinterpret_cast< char const * >(mapped);
+}
+
+MappedFile::~MappedFile() {
+	if (data) munmap(const_cast< char * >(data), size);
+}
+
+#endif
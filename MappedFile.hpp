@@ -0,0 +1,32 @@
+#pragma once
+
+/*
+ * MappedFile maps a whole file read-only into memory, so loaders can parse it
+ * in place instead of copying it through a stream.
+ *
+ */
+
+#include <string>
+#include <cstddef>
+
+struct MappedFile {
+	//map a file; throws on failure:
+	MappedFile(std::string const &filename);
+	~MappedFile();
+
+	//the mapping is unique, so no copying:
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+
+	char const *begin() const { return data; }
+	char const *end() const { return data + size; }
+
+	char const *data = nullptr;
+	size_t size = 0;
+
+	//platform-specific handles:
+	#if defined(_WIN32)
+	void *file = nullptr;
+	void *mapping = nullptr;
+	#endif
+};
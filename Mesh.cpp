@@ -1,5 +1,8 @@
 #include "Mesh.hpp"
+#include "MeshArena.hpp"
 #include "read_write_chunk.hpp"
+#include "mesh_optimize.hpp"
+#include "MappedFile.hpp"
 
 #include <glm/glm.hpp>
 
@@ -10,82 +13,537 @@
 #include <string>
 #include <set>
 #include <cstddef>
+#include <cassert>
+#include <algorithm>
+#include <memory>
+#include <cmath>
+#include <cstring>
 
-MeshBuffer::MeshBuffer(std::string const &filename) {
-	glGenBuffers(1, &buffer);
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MESH_SSE
+#endif
 
-	std::ifstream file(filename, std::ios::binary);
+typedef MeshBuffer::Vertex Vertex;
 
-	GLuint total = 0;
+//attach "<name>_LOD<k>" meshes to "<name>" and "<name>_LOD0" as level k:
+static void link_lods(std::string const &filename, std::map< std::string, Mesh > *meshes_) {
+	assert(meshes_);
+	auto &meshes = *meshes_;
 
-	struct Vertex {
-		glm::vec3 Position;
-		glm::vec3 Normal;
-		glm::u8vec4 Color;
-		glm::vec2 TexCoord;
-	};
-	static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
-	std::vector< Vertex > data;
+	//base name -> (level -> mesh):
+	std::map< std::string, std::map< uint32_t, Mesh * > > groups;
+	for (auto &named : meshes) {
+		std::string const &name = named.first;
+		size_t at = name.rfind("_LOD");
+		if (at == std::string::npos || at + 4 == name.size()) continue;
+		if (name.find_first_not_of("0123456789", at + 4) != std::string::npos) continue;
+		uint32_t level = uint32_t(std::stoul(name.substr(at + 4)));
+		if (level > MeshLODs::Max) {
+			std::cerr << "WARNING: mesh '" << name << "' in '" << filename << "' is past the last supported level of detail (" << MeshLODs::Max << "); ignoring." << std::endl;
+			continue;
+		}
+		groups[name.substr(0, at)][level] = &named.second;
+	}
 
-	//read + upload data chunk:
-	if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct") {
-		read_chunk(file, "pnct", &data);
+	for (auto const &group : groups) {
+		MeshLODs lods;
+		for (auto const &level : group.second) {
+			if (level.first == 0) continue;
+			lods.levels[lods.count].start = level.second->start;
+			lods.levels[lods.count].count = level.second->count;
+			lods.count += 1;
+		}
+		if (lods.count == 0) continue;
 
-		//upload data:
-		glBindBuffer(GL_ARRAY_BUFFER, buffer);
-		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		std::vector< Mesh * > members;
+		for (auto const &level : group.second) {
+			members.emplace_back(level.second);
+		}
 
-		total = GLuint(data.size()); //store total for later checks on index
+		bool attached = false;
+		for (std::string const &name : { group.first, group.first + "_LOD0" }) {
+			auto f = meshes.find(name);
+			if (f == meshes.end()) continue;
+			f->second.lods = lods;
+			members.emplace_back(&f->second);
+			attached = true;
+		}
+		if (!attached) {
+			std::cerr << "WARNING: mesh file '" << filename << "' has levels of detail for '" << group.first << "', but no '" << group.first << "' or '" << group.first << "_LOD0'." << std::endl;
+		}
 
-		//store attrib locations:
-		Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
-		Normal = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
-		Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Color));
-		TexCoord = Attrib(2, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, TexCoord));
-	} else {
+		//every level gets the bounds of the whole group:
+		// (so bounds stay conservative whichever level is drawn, and compact buffers quantize all levels alike)
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+		for (Mesh const *member : members) {
+			min = glm::min(min, member->min);
+			max = glm::max(max, member->max);
+		}
+		for (Mesh *member : members) {
+			member->min = min;
+			member->max = max;
+		}
+	}
+}
+
+//the contents of a '.pnct' file, parsed in place from a mapping of the file where possible:
+// (for indexed files, the vertices are never copied on the CPU -- they go from the mapping straight to OpenGL)
+namespace {
+struct PnctData {
+	std::unique_ptr< MappedFile > file;
+	ChunkView< Vertex > vertices; //points into the mapping, or into 'vertex_storage'
+	std::vector< Vertex > vertex_storage;
+	ChunkView< uint32_t > indices; //points into the mapping, or into 'index_storage'
+	std::vector< uint32_t > index_storage;
+	ChunkView< TriangleCluster > clusters; //(only if the file has them)
+	std::vector< TriangleCluster > cluster_storage;
+};
+}
+
+//read vertex data, indices, and mesh index (without bounds; see bound_meshes) from a file:
+// (no OpenGL calls, so tools can use it too)
+static void read_pnct(std::string const &filename, PnctData *data_, std::map< std::string, Mesh > *meshes_) {
+	assert(data_);
+	auto &data = *data_;
+	assert(meshes_);
+	auto &meshes = *meshes_;
+
+	if (!(filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct")) {
 		throw std::runtime_error("Unknown file type '" + filename + "'");
 	}
 
-	std::vector< char > strings;
-	read_chunk(file, "str0", &strings);
+	data.file.reset(new MappedFile(filename));
+	char const *at = data.file->begin();
+	char const *end = data.file->end();
 
-	{ //read index chunk, add to meshes:
-		struct IndexEntry {
-			uint32_t name_begin, name_end;
-			uint32_t vertex_begin, vertex_end;
-		};
-		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+	//read data chunk:
+	data.vertices = read_chunk(at, end, "pnct", &data.vertex_storage);
+
+	GLuint total = GLuint(data.vertices.size()); //store total for later checks on index
 
-		std::vector< IndexEntry > index;
-		read_chunk(file, "idx0", &index);
+	std::vector< char > strings_storage;
+	ChunkView< char > strings = read_chunk(at, end, "str0", &strings_storage);
 
-		for (auto const &entry : index) {
-			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
-				throw std::runtime_error("index entry has out-of-range name begin/end");
+	//read index chunk:
+	// (ranges are of vertices in soup files, and of indices in indexed files)
+	struct IndexEntry {
+		uint32_t name_begin, name_end;
+		uint32_t vertex_begin, vertex_end;
+	};
+	static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+
+	std::vector< IndexEntry > index_storage;
+	ChunkView< IndexEntry > index = read_chunk(at, end, "idx0", &index_storage);
+
+	//indexed files follow with the indices (and, perhaps, clusters):
+	bool indexed = false;
+	if (end - at >= 4 && std::string(at, 4) == "ind0") {
+		data.indices = read_chunk(at, end, "ind0", &data.index_storage);
+		indexed = true;
+		if (end - at >= 4 && std::string(at, 4) == "cls0") {
+			data.clusters = read_chunk(at, end, "cls0", &data.cluster_storage);
+		}
+	}
+
+	if (at != end) {
+		std::cerr << "WARNING: trailing data in mesh file '" << filename << "'" << std::endl;
+	}
+
+	if (indexed) {
+		for (auto i : data.indices) {
+			if (i >= total) {
+				throw std::runtime_error("mesh file '" + filename + "' has out-of-range index " + std::to_string(i));
 			}
-			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
-				throw std::runtime_error("index entry has out-of-range vertex start/count");
+		}
+		for (auto const &cluster : data.clusters) {
+			if (!(cluster.start <= data.indices.size() && cluster.count <= data.indices.size() - cluster.start && cluster.count % 3 == 0)) {
+				throw std::runtime_error("mesh file '" + filename + "' has a cluster with an out-of-range index range");
 			}
-			std::string name(&strings[0] + entry.name_begin, &strings[0] + entry.name_end);
+		}
+		for (size_t c = 1; c < data.clusters.size(); ++c) {
+			if (data.clusters[c].start < data.clusters[c-1].start + data.clusters[c-1].count) {
+				throw std::runtime_error("mesh file '" + filename + "' has clusters that overlap or are out of order");
+			}
+		}
+	}
+
+	//soup is indexed mesh-by-mesh into new vertex data:
+	std::vector< Vertex > indexed_data;
+	std::vector< uint32_t > indices;
+	//(entries that share a range share the result)
+	std::map< std::pair< uint32_t, uint32_t >, Mesh > done;
+
+	for (auto const &entry : index) {
+		if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
+			throw std::runtime_error("index entry has out-of-range name begin/end");
+		}
+		if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= (indexed ? data.indices.size() : total))) {
+			throw std::runtime_error("index entry has out-of-range vertex start/count");
+		}
+		std::string name(strings.begin() + entry.name_begin, strings.begin() + entry.name_end);
+
+		auto f = done.find(std::make_pair(entry.vertex_begin, entry.vertex_end));
+		if (f == done.end()) {
 			Mesh mesh;
 			mesh.type = GL_TRIANGLES;
-			mesh.start = entry.vertex_begin;
-			mesh.count = entry.vertex_end - entry.vertex_begin;
-			for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
-				mesh.min = glm::min(mesh.min, data[v].Position);
-				mesh.max = glm::max(mesh.max, data[v].Position);
+
+			if (indexed) {
+				mesh.start = entry.vertex_begin;
+				mesh.count = entry.vertex_end - entry.vertex_begin;
+				if (mesh.count != 0) {
+					auto range = std::minmax_element(data.indices.begin() + mesh.start, data.indices.begin() + mesh.start + mesh.count);
+					mesh.vertex_start = *range.first;
+					mesh.vertex_count = *range.second + 1 - *range.first;
+				}
+			} else {
+				Vertex const *soup = data.vertices.begin() + entry.vertex_begin;
+				uint32_t count = entry.vertex_end - entry.vertex_begin;
+
+				//merge identical vertices:
+				std::vector< uint32_t > remap;
+				uint32_t unique = index_vertices(soup, count, sizeof(Vertex), &remap);
+
+				//reorder triangles for the cache, then number vertices in the order the triangles use them:
+				std::vector< uint32_t > mesh_indices(remap);
+				if (count % 3 == 0) {
+					optimize_vertex_cache(mesh_indices.data(), mesh_indices.size(), unique);
+				} else {
+					std::cerr << "WARNING: mesh '" << name << "' in '" << filename << "' has " << count << " vertices, which isn't a whole number of triangles." << std::endl;
+				}
+				std::vector< uint32_t > fetch;
+				optimize_vertex_fetch(mesh_indices.data(), mesh_indices.size(), unique, &fetch);
+
+				mesh.vertex_start = GLuint(indexed_data.size());
+				mesh.vertex_count = unique;
+				indexed_data.resize(indexed_data.size() + unique);
+				for (uint32_t v = 0; v < count; ++v) {
+					indexed_data[mesh.vertex_start + fetch[remap[v]]] = soup[v];
+				}
+
+				mesh.start = GLuint(indices.size());
+				mesh.count = count;
+				for (uint32_t i : mesh_indices) {
+					indices.emplace_back(mesh.vertex_start + fetch[i]);
+				}
 			}
-			bool inserted = meshes.insert(std::make_pair(name, mesh)).second;
-			if (!inserted) {
-				std::cerr << "WARNING: mesh name '" + name + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
+
+			f = done.emplace(std::make_pair(entry.vertex_begin, entry.vertex_end), mesh).first;
+		}
+
+		bool inserted = meshes.insert(std::make_pair(name, f->second)).second;
+		if (!inserted) {
+			std::cerr << "WARNING: mesh name '" + name + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
+		}
+	}
+
+	if (!indexed) {
+		//nothing points into the mapping any more:
+		data.vertex_storage = std::move(indexed_data);
+		data.vertices.data = data.vertex_storage.data();
+		data.vertices.count = data.vertex_storage.size();
+		data.index_storage = std::move(indices);
+		data.indices.data = data.index_storage.data();
+		data.indices.count = data.index_storage.size();
+		data.file.reset();
+	}
+}
+
+//find the meshes' bounds (and attach levels of detail) in one pass over the vertices:
+// if 'copy_to' is given, the vertices are also copied there (e.g., to a mapped OpenGL buffer) on the way,
+// a block at a time, so the bounds are found while each block is still in cache.
+static void bound_meshes(std::string const &filename, ChunkView< Vertex > const &vertices, std::map< std::string, Mesh > *meshes_, Vertex *copy_to) {
+	assert(meshes_);
+	auto &meshes = *meshes_;
+
+	//cut the vertices into segments at the ends of every mesh's range, so each segment is in whole meshes:
+	std::vector< GLuint > cuts{ 0, GLuint(vertices.size()) };
+	for (auto const &named : meshes) {
+		Mesh const &mesh = named.second;
+		if (mesh.vertex_count == 0) continue;
+		cuts.emplace_back(mesh.vertex_start);
+		cuts.emplace_back(mesh.vertex_start + mesh.vertex_count);
+	}
+	std::sort(cuts.begin(), cuts.end());
+	cuts.erase(std::unique(cuts.begin(), cuts.end()), cuts.end());
+
+	constexpr GLuint Block = 4096; //vertices copied (and then bounded) at a time; 144k, comfortably inside L2
+	std::vector< glm::vec3 > segment_min(cuts.size() - 1);
+	std::vector< glm::vec3 > segment_max(cuts.size() - 1);
+	for (size_t s = 0; s + 1 < cuts.size(); ++s) {
+#ifdef MESH_SSE
+		//a position is the low three floats of one unaligned load (the fourth is Normal.x, and ignored):
+		static_assert(offsetof(Vertex, Position) + 4 * sizeof(float) <= sizeof(Vertex), "position loads stay inside the vertex");
+		__m128 min = _mm_set1_ps(std::numeric_limits< float >::infinity());
+		__m128 max = _mm_set1_ps(-std::numeric_limits< float >::infinity());
+#else
+		float min_x = std::numeric_limits< float >::infinity(), max_x = -min_x;
+		float min_y = min_x, max_y = max_x;
+		float min_z = min_x, max_z = max_x;
+#endif
+		for (GLuint begin = cuts[s]; begin < cuts[s+1]; begin += Block) {
+			GLuint end = std::min(cuts[s+1], begin + Block);
+			Vertex const *from = vertices.begin();
+			if (copy_to) std::memcpy(copy_to + begin, from + begin, (end - begin) * sizeof(Vertex));
+#ifdef MESH_SSE
+			//(position first, so -- like std::min/max below -- a NaN coordinate is skipped)
+			for (GLuint v = begin; v < end; ++v) {
+				__m128 p = _mm_loadu_ps(&from[v].Position.x);
+				min = _mm_min_ps(p, min);
+				max = _mm_max_ps(p, max);
+			}
+#else
+			//(separate running min/max per component, so there's no dependency between them)
+			for (GLuint v = begin; v < end; ++v) {
+				glm::vec3 const &p = from[v].Position;
+				min_x = std::min(min_x, p.x); max_x = std::max(max_x, p.x);
+				min_y = std::min(min_y, p.y); max_y = std::max(max_y, p.y);
+				min_z = std::min(min_z, p.z); max_z = std::max(max_z, p.z);
 			}
+#endif
 		}
+#ifdef MESH_SSE
+		float lanes[4];
+		_mm_storeu_ps(lanes, min);
+		segment_min[s] = glm::vec3(lanes[0], lanes[1], lanes[2]);
+		_mm_storeu_ps(lanes, max);
+		segment_max[s] = glm::vec3(lanes[0], lanes[1], lanes[2]);
+#else
+		segment_min[s] = glm::vec3(min_x, min_y, min_z);
+		segment_max[s] = glm::vec3(max_x, max_y, max_z);
+#endif
 	}
 
-	if (file.peek() != EOF) {
-		std::cerr << "WARNING: trailing data in mesh file '" << filename << "'" << std::endl;
+	//each mesh's bounds are those of the segments it covers:
+	for (auto &named : meshes) {
+		Mesh &mesh = named.second;
+		if (mesh.vertex_count == 0) continue;
+		size_t s = std::lower_bound(cuts.begin(), cuts.end(), mesh.vertex_start) - cuts.begin();
+		for (; cuts[s] < mesh.vertex_start + mesh.vertex_count; ++s) {
+			mesh.min = glm::min(mesh.min, segment_min[s]);
+			mesh.max = glm::max(mesh.max, segment_max[s]);
+		}
+	}
+
+	link_lods(filename, &meshes);
+}
+
+//copy the vertices to 'offset' in the buffer bound to GL_ARRAY_BUFFER (which must already be big enough)
+// while finding the meshes' bounds:
+static void upload_and_bound_meshes(std::string const &filename, ChunkView< Vertex > const &vertices, std::map< std::string, Mesh > *meshes, GLintptr offset) {
+	GLsizeiptr size = GLsizeiptr(vertices.size() * sizeof(Vertex));
+	void *mapped = nullptr;
+	if (size != 0) {
+		mapped = glMapBufferRange(GL_ARRAY_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+	}
+	bound_meshes(filename, vertices, meshes, reinterpret_cast< Vertex * >(mapped));
+	if (mapped && glUnmapBuffer(GL_ARRAY_BUFFER) == GL_TRUE) return;
+
+	//(couldn't map the buffer, or its contents were lost while mapped, so upload the usual way)
+	glBufferSubData(GL_ARRAY_BUFFER, offset, size, vertices.begin());
+}
+
+//attach clusters to meshes -- the file's, if it has them, and otherwise built for meshes big enough to be worth it:
+// (cluster ranges are in the same index space as the meshes' ranges)
+static void cluster_meshes(PnctData const &data, std::map< std::string, Mesh > *meshes_, std::vector< TriangleCluster > *clusters_) {
+	assert(meshes_);
+	auto &meshes = *meshes_;
+	assert(clusters_);
+	auto &clusters = *clusters_;
+
+	//mesh index range -> range in 'clusters' (so meshes that share a range share clusters):
+	std::map< std::pair< GLuint, GLuint >, std::pair< size_t, size_t > > ranges;
+	for (auto const &named : meshes) {
+		Mesh const &mesh = named.second;
+		auto key = std::make_pair(mesh.start, mesh.count);
+		if (ranges.count(key)) continue;
+		size_t begin = clusters.size();
+		if (!data.clusters.empty()) {
+			//clusters from the file that lie within the mesh's range:
+			auto first = std::lower_bound(data.clusters.begin(), data.clusters.end(), mesh.start, [](TriangleCluster const &c, GLuint start) {
+				return c.start < start;
+			});
+			for (auto c = first; c != data.clusters.end() && c->start + c->count <= mesh.start + mesh.count; ++c) {
+				clusters.emplace_back(*c);
+			}
+		} else if (mesh.count / 3 >= MeshBuffer::ClusterMinTriangles) {
+			build_clusters(data.indices.begin() + mesh.start, mesh.count, data.vertices.begin(), sizeof(Vertex), &clusters);
+			for (size_t c = begin; c < clusters.size(); ++c) {
+				clusters[c].start += mesh.start;
+			}
+		}
+		ranges.emplace(key, std::make_pair(begin, clusters.size()));
+	}
+
+	//('clusters' is done growing, so pointers into it are safe now)
+	for (auto &named : meshes) {
+		Mesh &mesh = named.second;
+		auto const &range = ranges.at(std::make_pair(mesh.start, mesh.count));
+		if (range.first == range.second) continue;
+		mesh.clusters = clusters.data() + range.first;
+		mesh.cluster_count = uint32_t(range.second - range.first);
+	}
+}
+
+//build collision meshes for the triangle meshes (meshes that share a range share one):
+// (from the file's index space, so this happens before any rebasing into an arena)
+static void collide_meshes(PnctData const &data, std::map< std::string, Mesh > *meshes_, std::vector< CollisionMesh > *collision_meshes_) {
+	assert(meshes_);
+	auto &meshes = *meshes_;
+	assert(collision_meshes_);
+	auto &collision_meshes = *collision_meshes_;
+
+	std::map< std::pair< GLuint, GLuint >, size_t > built;
+	for (auto const &named : meshes) {
+		Mesh const &mesh = named.second;
+		if (mesh.type != GL_TRIANGLES) continue;
+		auto ret = built.emplace(std::make_pair(mesh.start, mesh.count), collision_meshes.size());
+		if (!ret.second) continue;
+		collision_meshes.emplace_back(data.indices.begin() + mesh.start, mesh.count, data.vertices.begin(), sizeof(Vertex));
+	}
+
+	//('collision_meshes' is done growing, so pointers into it are safe now)
+	for (auto &named : meshes) {
+		Mesh &mesh = named.second;
+		auto f = built.find(std::make_pair(mesh.start, mesh.count));
+		if (f != built.end()) mesh.collision = &collision_meshes[f->second];
+	}
+}
+
+//vertices of the compact layout (20 bytes rather than 36):
+namespace {
+struct CompactVertex {
+	uint16_t Position[4]; //fraction of the way across the mesh's bounds, as unsigned normalized 16-bit values (+ padding)
+	uint32_t Normal; //signed normalized 10:10:10:2 (GL_INT_2_10_10_10_REV)
+	glm::u8vec4 Color;
+	uint16_t TexCoord[2]; //half floats
+};
+static_assert(sizeof(CompactVertex) == 2*4 + 4 + 4*1 + 2*2, "CompactVertex is packed.");
+}
+
+//float -> IEEE half float, rounding to nearest even:
+static uint16_t to_half(float f) {
+	uint32_t x;
+	std::memcpy(&x, &f, sizeof(x));
+	uint32_t sign = (x >> 16) & 0x8000;
+	uint32_t abs = x & 0x7fffffff;
+	if (abs >= 0x7f800000) return uint16_t(sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0)); //infinity or nan
+	if (abs >= 0x477ff000) return uint16_t(sign | 0x7c00); //rounds past the largest half: infinity
+	if (abs < 0x38800000) { //half subnormal (or zero):
+		if (abs < 0x33000000) return uint16_t(sign);
+		uint32_t shift = 126 - (abs >> 23);
+		uint32_t mantissa = (abs & 0x7fffff) | 0x800000;
+		return uint16_t(sign | ((mantissa + (1u << (shift - 1)) - 1 + ((mantissa >> shift) & 1)) >> shift));
+	}
+	//re-bias the exponent and round off the low mantissa bits (a carry correctly bumps the exponent):
+	return uint16_t(sign | ((abs - 0x38000000 + 0xfff + ((abs >> 13) & 1)) >> 13));
+}
+
+//pack a mesh buffer's vertices in the compact layout:
+// positions are quantized to the bounds of the (first) mesh using them, so Scene::draw can map them back
+// with pipeline.min / max (see Scene::Drawable::Pipeline::quantized)
+static void compact_vertices(std::string const &filename, ChunkView< Vertex > const &data, std::map< std::string, Mesh > *meshes_, std::vector< CompactVertex > *compact_) {
+	assert(meshes_);
+	auto &meshes = *meshes_;
+	assert(compact_);
+	auto &compact = *compact_;
+
+	compact.assign(data.size(), CompactVertex());
+
+	//non-position attributes don't depend on the mesh:
+	for (size_t v = 0; v < data.size(); ++v) {
+		auto snorm10 = [](float x) -> uint32_t {
+			int32_t i = int32_t(std::round(std::max(-1.0f, std::min(1.0f, x)) * 511.0f));
+			return uint32_t(i) & 0x3ff;
+		};
+		glm::vec3 const &n = data[v].Normal;
+		compact[v].Normal = snorm10(n.x) | (snorm10(n.y) << 10) | (snorm10(n.z) << 20);
+		compact[v].Color = data[v].Color;
+		compact[v].TexCoord[0] = to_half(data[v].TexCoord.x);
+		compact[v].TexCoord[1] = to_half(data[v].TexCoord.y);
+	}
+
+	//vertex range -> bounds it was quantized to:
+	std::map< GLuint, std::pair< glm::vec3, glm::vec3 > > quantized;
+	for (auto &named : meshes) {
+		Mesh &mesh = named.second;
+		if (mesh.vertex_count == 0) continue;
+
+		auto f = quantized.find(mesh.vertex_start);
+		if (f != quantized.end()) {
+			//another mesh already quantized these vertices, so draw with its bounds (they also contain this mesh):
+			if (f->second.first != mesh.min || f->second.second != mesh.max) {
+				std::cerr << "WARNING: meshes in '" << filename << "' share vertices but not bounds; '" << named.first << "' will use larger bounds." << std::endl;
+				mesh.min = f->second.first;
+				mesh.max = f->second.second;
+			}
+			continue;
+		}
+		quantized.emplace(mesh.vertex_start, std::make_pair(mesh.min, mesh.max));
+
+		glm::vec3 size = mesh.max - mesh.min;
+		glm::vec3 scale = glm::vec3(
+			(size.x > 0.0f ? 65535.0f / size.x : 0.0f),
+			(size.y > 0.0f ? 65535.0f / size.y : 0.0f),
+			(size.z > 0.0f ? 65535.0f / size.z : 0.0f)
+		);
+		for (GLuint v = mesh.vertex_start; v < mesh.vertex_start + mesh.vertex_count; ++v) {
+			glm::vec3 q = (data[v].Position - mesh.min) * scale;
+			for (uint32_t c = 0; c < 3; ++c) {
+				compact[v].Position[c] = uint16_t(std::max(0.0f, std::min(65535.0f, std::round(q[c]))));
+			}
+		}
+	}
+}
+
+//attribute locations for buffers of Vertex or CompactVertex:
+static void set_vertex_attribs(MeshBuffer *mesh_buffer) {
+	if (mesh_buffer->layout == MeshBuffer::Compact) {
+		mesh_buffer->Position = MeshBuffer::Attrib(3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex), offsetof(CompactVertex, Position));
+		mesh_buffer->Normal = MeshBuffer::Attrib(4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(CompactVertex), offsetof(CompactVertex, Normal));
+		mesh_buffer->Color = MeshBuffer::Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(CompactVertex), offsetof(CompactVertex, Color));
+		mesh_buffer->TexCoord = MeshBuffer::Attrib(2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), offsetof(CompactVertex, TexCoord));
+	} else {
+		mesh_buffer->Position = MeshBuffer::Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
+		mesh_buffer->Normal = MeshBuffer::Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
+		mesh_buffer->Color = MeshBuffer::Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Color));
+		mesh_buffer->TexCoord = MeshBuffer::Attrib(2, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, TexCoord));
+	}
+}
+
+MeshBuffer::MeshBuffer(std::string const &filename, Layout layout_, bool collision) : layout(layout_) {
+	glGenBuffers(1, &buffer);
+	glGenBuffers(1, &index_buffer);
+
+	PnctData data;
+	read_pnct(filename, &data, &meshes);
+
+	//upload data:
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	if (layout == Compact) {
+		bound_meshes(filename, data.vertices, &meshes, nullptr);
+		std::vector< CompactVertex > compact;
+		compact_vertices(filename, data.vertices, &meshes, &compact);
+		glBufferData(GL_ARRAY_BUFFER, compact.size() * sizeof(CompactVertex), compact.data(), GL_STATIC_DRAW);
+	} else {
+		glBufferData(GL_ARRAY_BUFFER, data.vertices.size() * sizeof(Vertex), nullptr, GL_STATIC_DRAW);
+		upload_and_bound_meshes(filename, data.vertices, &meshes, 0);
 	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	//(bound to GL_ARRAY_BUFFER just for the upload, since GL_ELEMENT_ARRAY_BUFFER belongs to whatever vao is bound)
+	glBindBuffer(GL_ARRAY_BUFFER, index_buffer);
+	glBufferData(GL_ARRAY_BUFFER, data.indices.size() * sizeof(uint32_t), data.indices.begin(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	cluster_meshes(data, &meshes, &clusters);
+	if (collision) collide_meshes(data, &meshes, &collision_meshes);
+
+	//store attrib locations:
+	set_vertex_attribs(this);
+
+	index_meshes();
 
 	/* //DEBUG:
 	std::cout << "File '" << filename << "' contained meshes";
@@ -98,15 +556,274 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 	*/
 }
 
-const Mesh &MeshBuffer::lookup(std::string const &name) const {
-	auto f = meshes.find(name);
-	if (f == meshes.end()) {
-		throw std::runtime_error("Looking up mesh '" + name + "' that doesn't exist.");
+MeshBuffer::MeshBuffer(std::string const &filename, MeshArena &arena_, bool collision) : layout(arena_.layout) {
+	PnctData data;
+	read_pnct(filename, &data, &meshes);
+
+	//(compact vertices are quantized to the bounds, so those come first)
+	std::vector< CompactVertex > compact;
+	if (layout == Compact) {
+		bound_meshes(filename, data.vertices, &meshes, nullptr);
+		compact_vertices(filename, data.vertices, &meshes, &compact);
 	}
-	return f->second;
+	GLuint vertex_count = GLuint(data.vertices.size());
+
+	auto starts = arena_.allocate(vertex_count, GLuint(data.indices.size()));
+	arena = &arena_;
+	arena_vertex_start = starts.first;
+	arena_vertex_count = vertex_count;
+	arena_index_start = starts.second;
+	arena_index_count = GLuint(data.indices.size());
+
+	//upload data:
+	buffer = arena->vertex_buffer;
+	index_buffer = arena->index_buffer;
+
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	if (layout == Compact) {
+		glBufferSubData(GL_ARRAY_BUFFER, arena_vertex_start * sizeof(CompactVertex), compact.size() * sizeof(CompactVertex), compact.data());
+	} else {
+		upload_and_bound_meshes(filename, data.vertices, &meshes, arena_vertex_start * sizeof(Vertex));
+	}
+
+	//indices are rebased to where the vertices landed in the arena:
+	std::vector< uint32_t > indices(data.indices.begin(), data.indices.end());
+	for (auto &i : indices) {
+		i += arena_vertex_start;
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, index_buffer);
+	glBufferSubData(GL_ARRAY_BUFFER, arena_index_start * sizeof(uint32_t), indices.size() * sizeof(uint32_t), indices.data());
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	//...as are the meshes (and their clusters):
+	cluster_meshes(data, &meshes, &clusters);
+	if (collision) collide_meshes(data, &meshes, &collision_meshes);
+	for (auto &named : meshes) {
+		Mesh &mesh = named.second;
+		mesh.start += arena_index_start;
+		mesh.vertex_start += arena_vertex_start;
+		for (uint32_t l = 0; l < mesh.lods.count; ++l) {
+			mesh.lods.levels[l].start += arena_index_start;
+		}
+	}
+	for (auto &cluster : clusters) {
+		cluster.start += arena_index_start;
+	}
+
+	set_vertex_attribs(this);
+
+	index_meshes();
 }
 
-GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
+MeshBuffer::~MeshBuffer() {
+	for (auto const &entry : vaos) {
+		glDeleteVertexArrays(1, &entry.second);
+	}
+	if (arena) {
+		arena->release(arena_vertex_start, arena_vertex_count, arena_index_start, arena_index_count);
+	}
+}
+
+size_t MeshBuffer::vertex_size(Layout layout) {
+	return (layout == Compact ? sizeof(CompactVertex) : sizeof(Vertex));
+}
+
+AsyncLoad< MeshBuffer > MeshBuffer::load_async(std::string const &filename, Layout layout, bool collision) {
+	//vertex data waiting to be uploaded:
+	struct Pending {
+		PnctData data; //(vertices are uploaded straight from the file's mapping, when possible)
+		std::vector< CompactVertex > compact; //(used instead of data for the compact layout)
+		char const *bytes = nullptr;
+		size_t size = 0;
+		size_t uploaded = 0; //(bytes)
+	};
+	auto pending = std::make_shared< Pending >();
+
+	return ::load_async< MeshBuffer >([filename, layout, collision, pending]() {
+		std::unique_ptr< MeshBuffer > ret(new MeshBuffer());
+		ret->layout = layout;
+		read_pnct(filename, &pending->data, &ret->meshes);
+		//(reading every vertex for the bounds here also pages the file in, off the main thread)
+		bound_meshes(filename, pending->data.vertices, &ret->meshes, nullptr);
+		if (layout == Compact) {
+			compact_vertices(filename, pending->data.vertices, &ret->meshes, &pending->compact);
+			pending->bytes = reinterpret_cast< char const * >(pending->compact.data());
+			pending->size = pending->compact.size() * sizeof(CompactVertex);
+		} else {
+			pending->bytes = reinterpret_cast< char const * >(pending->data.vertices.begin());
+			pending->size = pending->data.vertices.size() * sizeof(Vertex);
+		}
+		cluster_meshes(pending->data, &ret->meshes, &ret->clusters);
+		if (collision) collide_meshes(pending->data, &ret->meshes, &ret->collision_meshes);
+		set_vertex_attribs(ret.get());
+		ret->index_meshes();
+		return ret.release();
+	}, [pending](MeshBuffer &mesh_buffer) -> bool {
+		//upload in slices, so update_async_loads() can stop between them:
+		constexpr size_t UploadSlice = (4 << 20);
+
+		if (mesh_buffer.buffer == 0) {
+			//indices are much smaller than vertices, so they go up all at once, first:
+			glGenBuffers(1, &mesh_buffer.index_buffer);
+			glBindBuffer(GL_ARRAY_BUFFER, mesh_buffer.index_buffer);
+			glBufferData(GL_ARRAY_BUFFER, pending->data.indices.size() * sizeof(uint32_t), pending->data.indices.begin(), GL_STATIC_DRAW);
+
+			glGenBuffers(1, &mesh_buffer.buffer);
+			glBindBuffer(GL_ARRAY_BUFFER, mesh_buffer.buffer);
+			glBufferData(GL_ARRAY_BUFFER, pending->size, nullptr, GL_STATIC_DRAW);
+		} else {
+			glBindBuffer(GL_ARRAY_BUFFER, mesh_buffer.buffer);
+		}
+
+		size_t count = std::min(UploadSlice, pending->size - pending->uploaded);
+		glBufferSubData(GL_ARRAY_BUFFER, pending->uploaded, count, pending->bytes + pending->uploaded);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		pending->uploaded += count;
+
+		if (pending->uploaded < pending->size) return false;
+
+		//(free cpu-side copy, and unmap the file)
+		pending->data = PnctData();
+		pending->compact = std::vector< CompactVertex >();
+		return true;
+	});
+}
+
+std::map< std::string, Mesh > MeshBuffer::read_meshes(std::string const &filename) {
+	PnctData data;
+	std::map< std::string, Mesh > meshes;
+	read_pnct(filename, &data, &meshes);
+	bound_meshes(filename, data.vertices, &meshes, nullptr);
+	return meshes;
+}
+
+std::map< std::string, Mesh > MeshBuffer::read_indexed(std::string const &filename, std::vector< Vertex > *vertices_, std::vector< uint32_t > *indices_) {
+	assert(vertices_);
+	assert(indices_);
+	PnctData data;
+	std::map< std::string, Mesh > meshes;
+	read_pnct(filename, &data, &meshes);
+	bound_meshes(filename, data.vertices, &meshes, nullptr);
+	vertices_->assign(data.vertices.begin(), data.vertices.end());
+	indices_->assign(data.indices.begin(), data.indices.end());
+	return meshes;
+}
+
+uint32_t MeshBuffer::hash_name(std::string_view name) {
+	//FNV-1a:
+	uint32_t h = 2166136261u;
+	for (char c : name) {
+		h = (h ^ uint8_t(c)) * 16777619u;
+	}
+	return h;
+}
+
+void MeshBuffer::index_meshes() {
+	size_t size = 16;
+	while (size < meshes.size() * 2) size *= 2;
+	index.assign(size, IndexSlot());
+
+	for (auto const &named : meshes) {
+		IndexSlot slot;
+		slot.hash = hash_name(named.first);
+		slot.name = named.first;
+		slot.mesh = &named.second;
+
+		size_t i = slot.hash & (size - 1);
+		while (index[i].mesh) i = (i + 1) & (size - 1);
+		index[i] = slot;
+	}
+}
+
+Mesh const *MeshBuffer::find(std::string_view name) const {
+	if (index.empty()) return nullptr;
+	uint32_t hash = hash_name(name);
+	size_t mask = index.size() - 1;
+	for (size_t i = hash & mask; index[i].mesh; i = (i + 1) & mask) {
+		if (index[i].hash == hash && index[i].name == name) return index[i].mesh;
+	}
+	return nullptr;
+}
+
+const Mesh &MeshBuffer::lookup(std::string_view name) const {
+	Mesh const *mesh = find(name);
+	if (!mesh) {
+		throw std::runtime_error("Looking up mesh '" + std::string(name) + "' that doesn't exist.");
+	}
+	return *mesh;
+}
+
+void MeshBuffer::lookup_all(std::vector< std::string_view > const &names, std::vector< Mesh const * > *found_) const {
+	assert(found_);
+	auto &found = *found_;
+
+	found.assign(names.size(), nullptr);
+	if (index.empty()) return;
+
+	std::vector< uint32_t > hashes(names.size());
+	for (size_t n = 0; n < names.size(); ++n) {
+		hashes[n] = hash_name(names[n]);
+	}
+
+	size_t mask = index.size() - 1;
+	for (size_t n = 0; n < names.size(); ++n) {
+		for (size_t i = hashes[n] & mask; index[i].mesh; i = (i + 1) & mask) {
+			if (index[i].hash == hashes[n] && index[i].name == names[n]) {
+				found[n] = index[i].mesh;
+				break;
+			}
+		}
+	}
+}
+
+//attribute locations of a program, looked up once and then kept (see MeshBuffer::forget_program):
+namespace {
+struct ProgramAttribs {
+	GLint Position = -1, Normal = -1, Color = -1, TexCoord = -1;
+	std::vector< std::pair< std::string, GLint > > active; //all active attributes, with their locations
+};
+}
+static std::map< GLuint, ProgramAttribs > &program_attribs() {
+	static std::map< GLuint, ProgramAttribs > cache;
+	return cache;
+}
+
+static ProgramAttribs const &attribs_for_program(GLuint program) {
+	auto ret = program_attribs().emplace(program, ProgramAttribs());
+	ProgramAttribs &attribs = ret.first->second;
+	if (!ret.second) return attribs;
+
+	attribs.Position = glGetAttribLocation(program, "Position");
+	attribs.Normal = glGetAttribLocation(program, "Normal");
+	attribs.Color = glGetAttribLocation(program, "Color");
+	attribs.TexCoord = glGetAttribLocation(program, "TexCoord");
+
+	GLint active = 0;
+	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &active);
+	assert(active >= 0 && "Doesn't makes sense to have negative active attributes.");
+	for (GLuint i = 0; i < GLuint(active); ++i) {
+		GLchar name[100];
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveAttrib(program, i, 100, NULL, &size, &type, name);
+		name[99] = '\0';
+		attribs.active.emplace_back(name, glGetAttribLocation(program, name));
+	}
+	return attribs;
+}
+
+void MeshBuffer::forget_program(GLuint program) {
+	program_attribs().erase(program);
+}
+
+GLuint MeshBuffer::make_vao_for_program(GLuint program, std::function< void(std::set< GLuint > *bound) > const &bind_extra) const {
+	//buffers in an arena share their vaos; others keep their own:
+	std::map< GLuint, GLuint > &cache = (arena ? arena->vaos : vaos);
+	auto f = cache.find(program);
+	if (f != cache.end()) return f->second;
+
+	ProgramAttribs const &attribs = attribs_for_program(program);
+
 	//create a new vertex array object:
 	GLuint vao = 0;
 	glGenVertexArrays(1, &vao);
@@ -115,36 +832,39 @@ GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
 	//Try to bind all attributes in this buffer:
 	std::set< GLuint > bound;
 	glBindBuffer(GL_ARRAY_BUFFER, buffer);
-	auto bind_attribute = [&](char const *name, MeshBuffer::Attrib const &attrib) {
+	auto bind_attribute = [&](GLint location, MeshBuffer::Attrib const &attrib) {
 		if (attrib.size == 0) return; //don't bind empty attribs
-		GLint location = glGetAttribLocation(program, name);
 		if (location == -1) return; //can't bind missing attribs
 		glVertexAttribPointer(location, attrib.size, attrib.type, attrib.normalized, attrib.stride, (GLbyte *)0 + attrib.offset);
 		glEnableVertexAttribArray(location);
 		bound.insert(location);
 	};
-	bind_attribute("Position", Position);
-	bind_attribute("Normal", Normal);
-	bind_attribute("Color", Color);
-	bind_attribute("TexCoord", TexCoord);
+	bind_attribute(attribs.Position, Position);
+	bind_attribute(attribs.Normal, Normal);
+	bind_attribute(attribs.Color, Color);
+	bind_attribute(attribs.TexCoord, TexCoord);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer); //(part of the vao's state)
+	if (bind_extra) bind_extra(&bound);
 	glBindVertexArray(0);
 
 	//Check that all active attributes were bound:
-	GLint active = 0;
-	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &active);
-	assert(active >= 0 && "Doesn't makes sense to have negative active attributes.");
-	for (GLuint i = 0; i < GLuint(active); ++i) {
-		GLchar name[100];
-		GLint size = 0;
-		GLenum type = 0;
-		glGetActiveAttrib(program, i, 100, NULL, &size, &type, name);
-		name[99] = '\0';
-		GLint location = glGetAttribLocation(program, name);
-		if (!bound.count(GLuint(location))) {
-			throw std::runtime_error("ERROR: active attribute '" + std::string(name) + "' in program is not bound.");
+	for (auto const &attrib : attribs.active) {
+		if (!bound.count(GLuint(attrib.second))) {
+			glDeleteVertexArrays(1, &vao);
+			throw std::runtime_error("ERROR: active attribute '" + attrib.first + "' in program is not bound.");
 		}
 	}
 
+	cache.emplace(program, vao);
+
 	return vao;
 }
+
+void MeshBuffer::release_vao(GLuint program) const {
+	std::map< GLuint, GLuint > &cache = (arena ? arena->vaos : vaos);
+	auto f = cache.find(program);
+	if (f == cache.end()) return;
+	glDeleteVertexArrays(1, &f->second);
+	cache.erase(f);
+}
@@ -1,55 +1,204 @@
 #pragma once
 
 /*
- * In this code, "Mesh" is a range of vertices that should be sent through
- *  the OpenGL pipeline together.
+ * In this code, "Mesh" is a range of indices (of triangles) that should be sent
+ *  through the OpenGL pipeline together.
  * A "MeshBuffer" holds a collection of such meshes (loaded from a file) in
- *  a single OpenGL array buffer. Individual meshes can be looked up by name
- *  using the MeshBuffer::lookup() function.
+ *  a single OpenGL array buffer plus a single element buffer. Individual meshes
+ *  can be looked up by name using the MeshBuffer::lookup() function.
+ *
+ * '.pnct' files hold either triangle soup (as written by export-meshes.py) or,
+ *  with an extra "ind0" chunk, indexed triangles. Soup is indexed at load time:
+ *  duplicate vertices are merged and triangles reordered for the vertex cache
+ *  (see mesh_optimize.hpp).
+ * Meshes of at least MeshBuffer::ClusterMinTriangles triangles are also cut into
+ *  clusters of nearby triangles (see build_clusters in mesh_optimize.hpp; indexed
+ *  files may store their own clusters in a "cls0" chunk after "ind0"), so
+ *  Scene::draw can cull them piece by piece.
+ *
+ * Files are read through a memory mapping (see MappedFile.hpp); the vertices of
+ *  indexed files are copied straight from it into the OpenGL buffer, finding
+ *  the meshes' bounds on the way.
+ *
+ * Meshes named "<name>_LOD1", "<name>_LOD2", ... are also attached to "<name>"
+ *  (and "<name>_LOD0", if present) as coarser levels of detail.
+ *
+ * Vertex data lives only on the GPU once loaded, unless a buffer is loaded with
+ *  'collision' set, in which case each mesh also keeps its triangles on the CPU
+ *  for exact collision queries (see CollisionMesh.hpp).
  *
  */
 
 #include "GL.hpp"
+#include "Load.hpp"
+#include "mesh_optimize.hpp"
+#include "CollisionMesh.hpp"
 #include <glm/glm.hpp>
 #include <map>
+#include <set>
 #include <limits>
 #include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
 
+struct MeshArena;
+
+//Coarser versions of a mesh, finest first; Scene::draw switches between them by projected size:
+struct MeshLODs {
+	enum : uint32_t { Max = 3 }; //(not counting level 0, which is the mesh itself)
+	struct Level {
+		GLuint start = 0; //index range, like Mesh::start/count
+		GLuint count = 0;
+	} levels[Max];
+	uint32_t count = 0; //number of levels in use
+};
 
 struct Mesh {
-	//Meshes are vertex ranges (and primitive types) in their MeshBuffer:
+	//Meshes are index ranges (and primitive types) in their MeshBuffer:
+	// (draw with glDrawElements and GL_UNSIGNED_INT indices -- i.e., a Scene::Drawable::Pipeline with 'indexed' set)
 
 	GLenum type = GL_TRIANGLES; //type of primitives in mesh
-	GLuint start = 0; //index of first vertex
-	GLuint count = 0; //count of vertices
+	GLuint start = 0; //index of first index
+	GLuint count = 0; //count of indices
+
+	//The range of vertices those indices refer to:
+	GLuint vertex_start = 0;
+	GLuint vertex_count = 0;
 
 	//Bounding box.
 	//useful for debug visualization and (perhaps, eventually) collision detection:
 	glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
 	glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
+	//Levels of detail (all in the same MeshBuffer; bounds are those of level 0):
+	MeshLODs lods;
+
+	//Pieces of the (level 0) index range, each with its own bounds, for big meshes (otherwise none):
+	// (points into MeshBuffer::clusters)
+	TriangleCluster const *clusters = nullptr;
+	uint32_t cluster_count = 0;
+
+	//The (level 0) triangles, for collision queries in object space, if the buffer kept them (otherwise nullptr):
+	// (points into MeshBuffer::collision_meshes)
+	CollisionMesh const *collision = nullptr;
 };
 
 struct MeshBuffer {
+	//vertex layouts a buffer can be stored in:
+	enum Layout {
+		Full, //float positions, normals, and texcoords; 36 bytes per vertex
+		//16-bit positions (quantized to mesh bounds), 10:10:10 normals, half float texcoords; 20 bytes per vertex:
+		// (the conversion back to floats happens in vertex fetch, so shaders don't change -- but positions
+		//  come out as fractions of the way across the mesh's bounds, so drawables need pipeline.quantized set)
+		Compact,
+	};
+
 	//construct from a file:
 	// note: will throw if file fails to read.
-	MeshBuffer(std::string const &filename);
+	// 'collision' keeps a CPU-side copy of each mesh's triangles (see Mesh::collision).
+	MeshBuffer(std::string const &filename, Layout layout = Full, bool collision = false);
+	//...or construct from a file into space suballocated from an arena (see MeshArena.hpp):
+	// (the buffer takes the arena's layout, and its meshes' ranges are ranges in the arena's buffers)
+	MeshBuffer(std::string const &filename, MeshArena &arena, bool collision = false);
+	~MeshBuffer();
+
+	//load a file in the background: reads on the loading thread, then uploads vertex data a slice at
+	// a time from update_async_loads() (see Load.hpp), so even big files don't cause a hitch:
+	// (collision meshes, if asked for, are built on the loading thread too)
+	static AsyncLoad< MeshBuffer > load_async(std::string const &filename, Layout layout = Full, bool collision = false);
+
+	//read just the mesh index (names, ranges, bounds) of a file, without touching OpenGL:
+	// (useful for offline tools; note: will throw if file fails to read)
+	static std::map< std::string, Mesh > read_meshes(std::string const &filename);
+
+	//vertices as stored in '.pnct' files (and in Full layout buffers):
+	struct Vertex {
+		glm::vec3 Position;
+		glm::vec3 Normal;
+		glm::u8vec4 Color;
+		glm::vec2 TexCoord;
+	};
+	static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
+
+	//read the mesh index along with the (indexed) vertex data, also without touching OpenGL:
+	// (soup files are indexed just as they would be on load; mesh ranges are ranges of *indices_)
+	static std::map< std::string, Mesh > read_indexed(std::string const &filename, std::vector< Vertex > *vertices_, std::vector< uint32_t > *indices_);
 
 	//look up a particular mesh by name:
 	// note: will throw if mesh not found.
-	const Mesh &lookup(std::string const &name) const;
+	const Mesh &lookup(std::string_view name) const;
+	//...or get nullptr if it isn't found:
+	Mesh const *find(std::string_view name) const;
+
+	//look up many names at once (e.g., all the meshes a scene file uses, as views into its string table):
+	// fills *found_ with the mesh for each name, or nullptr where it isn't found.
+	// (all the names are hashed first, then all the probes happen, which keeps both loops tight)
+	void lookup_all(std::vector< std::string_view > const &names, std::vector< Mesh const * > *found_) const;
 	
-	//build a vertex array object that links this vbo to attributes to a program:
+	//build a vertex array object that links this vbo to attributes to a program (and binds the element buffer):
 	// note: will throw if program defines attributes not contained in this buffer
-	GLuint make_vao_for_program(GLuint program) const;
+	// 'bind_extra' (optional) is called with the vao bound to attach attributes from other buffers
+	//  (e.g., per-instance data) and should add the locations it binds to 'bound'
+	// vaos are cached by program: the first call for a program makes one and later calls return it
+	//  (so 'bind_extra' should do the same thing every time); the buffer owns its vaos and deletes them
+	//  when destroyed. Buffers in an arena share the arena's vaos -- one per program for all of them.
+	GLuint make_vao_for_program(GLuint program, std::function< void(std::set< GLuint > *bound) > const &bind_extra = nullptr) const;
+	//delete the cached vao for a program, if any (e.g., before reloading the program):
+	// (for buffers in an arena, this deletes the vao shared by every buffer in the arena)
+	void release_vao(GLuint program) const;
+	//drop the attribute locations cached for a program (call when deleting a program, since its name may be reused):
+	static void forget_program(GLuint program);
+
+	//empty (used by load_async):
+	MeshBuffer() = default;
+
+	//the name index points into 'meshes', so no copying:
+	MeshBuffer(MeshBuffer const &) = delete;
+	MeshBuffer &operator=(MeshBuffer const &) = delete;
+
+	Layout layout = Full;
+	//bytes per vertex in each layout:
+	static size_t vertex_size(Layout layout);
 
 	//This is the OpenGL vertex buffer object containing the mesh data:
 	GLuint buffer = 0;
+	//...and the element buffer object with the meshes' (GL_UNSIGNED_INT) indices:
+	GLuint index_buffer = 0;
 
 	//-- internals ---
 
-	//used by the lookup() function:
+	//vertex array objects made by make_vao_for_program, by program (unused for buffers in an arena):
+	mutable std::map< GLuint, GLuint > vaos;
+
+	//when suballocated from an arena, the ranges held there (released by the destructor):
+	MeshArena *arena = nullptr;
+	GLuint arena_vertex_start = 0, arena_vertex_count = 0;
+	GLuint arena_index_start = 0, arena_index_count = 0;
+
+	//all meshes, by name (in name order, for browsing):
 	std::map< std::string, Mesh > meshes;
 
+	//clusters of all meshes (see Mesh::clusters):
+	std::vector< TriangleCluster > clusters;
+	//meshes with fewer triangles than this aren't cut into clusters (unless the file says otherwise):
+	static constexpr uint32_t ClusterMinTriangles = 1024;
+
+	//collision meshes of all meshes, if kept (see Mesh::collision):
+	std::vector< CollisionMesh > collision_meshes;
+
+	//open-addressing hash table over 'meshes', used by the lookup functions:
+	// (linear probing; the size is a power of two and at least twice the number of meshes)
+	struct IndexSlot {
+		uint32_t hash = 0; //full hash of the name, so most mismatches don't need a string compare
+		std::string_view name; //view of the key in 'meshes'
+		Mesh const *mesh = nullptr; //nullptr for empty slots
+	};
+	std::vector< IndexSlot > index;
+	//rebuild 'index' (done when loading; call again after changing 'meshes'):
+	void index_meshes();
+	static uint32_t hash_name(std::string_view name);
+
 	//These 'Attrib' structures describe the location of various attributes within the buffer (in exactly format wanted by glVertexAttribPointer). They are set when the file is loaded and are used by the "make_vao_for_program" call:
 	struct Attrib {
 		GLint size = 0;
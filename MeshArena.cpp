@@ -0,0 +1,162 @@
+#include "MeshArena.hpp"
+
+#include "gl_errors.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+#include <stdexcept>
+
+MeshArena &MeshArena::shared(MeshBuffer::Layout layout) {
+	static MeshArena *arenas[2] = { nullptr, nullptr };
+	assert(uint32_t(layout) < 2);
+	if (!arenas[layout]) arenas[layout] = new MeshArena(layout);
+	return *arenas[layout];
+}
+
+MeshArena::MeshArena(MeshBuffer::Layout layout_) : layout(layout_) {
+}
+
+MeshArena::~MeshArena() {
+	for (auto const &entry : vaos) {
+		glDeleteVertexArrays(1, &entry.second);
+	}
+	if (vertex_buffer != 0) glDeleteBuffers(1, &vertex_buffer);
+	if (index_buffer != 0) glDeleteBuffers(1, &index_buffer);
+}
+
+std::pair< GLuint, GLuint > MeshArena::allocate(GLuint vertex_count, GLuint index_count) {
+	if (vertex_buffer == 0) {
+		glGenBuffers(1, &vertex_buffer);
+		glGenBuffers(1, &index_buffer);
+	}
+
+	//find room in (or make room at the end of) each buffer:
+	auto reserve = [](FreeList &list, GLuint count, GLuint buffer, size_t element_size) -> GLuint {
+		if (count == 0) return 0;
+		GLuint start = list.allocate(count);
+		if (start != -1U) return start;
+
+		//grow to at least double, so a run of loads doesn't copy the buffer every time:
+		// (the free range at the end, if any, will join up with the new space)
+		uint64_t needed = uint64_t(list.capacity) + count;
+		if (needed > uint64_t(-1U) - 1) {
+			throw std::runtime_error("mesh arena is out of room for " + std::to_string(count) + " more elements");
+		}
+		GLuint new_capacity = GLuint(std::min(std::max(needed, std::max(uint64_t(list.capacity) * 2, uint64_t(1 << 16))), uint64_t(-1U) - 1));
+		grow_buffer(buffer, GLsizeiptr(list.capacity) * element_size, GLsizeiptr(new_capacity) * element_size);
+		list.grow(new_capacity);
+
+		start = list.allocate(count);
+		assert(start != -1U);
+		return start;
+	};
+
+	GLuint vertex_start = reserve(vertices, vertex_count, vertex_buffer, MeshBuffer::vertex_size(layout));
+	GLuint index_start;
+	try {
+		index_start = reserve(indices, index_count, index_buffer, sizeof(GLuint));
+	} catch (...) {
+		//don't leak the vertex range if there's no room for the indices:
+		if (vertex_count != 0) vertices.release(vertex_start, vertex_count);
+		throw;
+	}
+	return std::make_pair(vertex_start, index_start);
+}
+
+void MeshArena::release(GLuint vertex_start, GLuint vertex_count, GLuint index_start, GLuint index_count) {
+	if (vertex_count != 0) vertices.release(vertex_start, vertex_count);
+	if (index_count != 0) indices.release(index_start, index_count);
+}
+
+void MeshArena::grow_buffer(GLuint buffer, GLsizeiptr old_size, GLsizeiptr new_size) {
+	assert(new_size >= old_size);
+
+	//(uses the copy targets, so no vertex array or array buffer binding is disturbed)
+	if (old_size == 0) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, new_size, nullptr, GL_STATIC_DRAW);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		return;
+	}
+
+	//glBufferData would discard the contents, so park them in a temporary buffer while resizing:
+	GLuint temp = 0;
+	glGenBuffers(1, &temp);
+	glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, temp);
+	glBufferData(GL_COPY_WRITE_BUFFER, old_size, nullptr, GL_STATIC_COPY);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, old_size);
+
+	glBufferData(GL_COPY_READ_BUFFER, new_size, nullptr, GL_STATIC_DRAW);
+	glCopyBufferSubData(GL_COPY_WRITE_BUFFER, GL_COPY_READ_BUFFER, 0, 0, old_size);
+
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glDeleteBuffers(1, &temp);
+
+	GL_ERRORS();
+}
+
+//--------------------------------
+
+GLuint MeshArena::FreeList::allocate(GLuint count) {
+	assert(count > 0);
+	for (auto f = free.begin(); f != free.end(); ++f) {
+		if (f->second < count) continue;
+		GLuint start = f->first;
+		GLuint left = f->second - count;
+		free.erase(f);
+		if (left > 0) free.emplace(start + count, left);
+		used += count;
+		return start;
+	}
+	return -1U;
+}
+
+void MeshArena::FreeList::release(GLuint start, GLuint count) {
+	assert(count > 0);
+	assert(start + count <= capacity);
+	assert(used >= count);
+	used -= count;
+
+	auto next = free.lower_bound(start);
+	assert((next == free.end() || start + count <= next->first) && "released range overlaps a free range");
+
+	//merge with the range after:
+	if (next != free.end() && next->first == start + count) {
+		count += next->second;
+		next = free.erase(next);
+	}
+
+	//merge with the range before:
+	if (next != free.begin()) {
+		auto prev = std::prev(next);
+		assert(prev->first + prev->second <= start && "released range overlaps a free range");
+		if (prev->first + prev->second == start) {
+			prev->second += count;
+			return;
+		}
+	}
+
+	free.emplace_hint(next, start, count);
+}
+
+void MeshArena::FreeList::grow(GLuint new_capacity) {
+	assert(new_capacity >= capacity);
+	if (new_capacity == capacity) return;
+
+	GLuint start = capacity;
+	GLuint count = new_capacity - capacity;
+	capacity = new_capacity;
+
+	//extend a free range that runs up to the old end, if there is one:
+	if (!free.empty()) {
+		auto last = std::prev(free.end());
+		if (last->first + last->second == start) {
+			last->second += count;
+			return;
+		}
+	}
+	free.emplace(start, count);
+}
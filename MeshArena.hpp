@@ -0,0 +1,72 @@
+#pragma once
+
+/*
+ * A MeshArena is a pair of large OpenGL buffers (vertices + GL_UNSIGNED_INT indices)
+ *  that many MeshBuffers suballocate from, instead of each owning buffers of its own.
+ *
+ * Since every MeshBuffer in an arena uses the same buffers (and vertex layout), they can
+ *  also share vertex array objects -- one per program -- so drawing meshes that came from
+ *  different '.pnct' files doesn't need a vertex array switch in between.
+ *
+ * Space is handed out by first-fit free lists (freed ranges are merged with their
+ *  neighbors); when nothing fits, the buffers grow (the buffer names stay the same,
+ *  so existing vertex array objects stay valid).
+ *
+ * Use:
+ *  MeshBuffer buffer(filename, MeshArena::shared(MeshBuffer::Full));
+ *
+ */
+
+#include "Mesh.hpp"
+#include "GL.hpp"
+
+#include <functional>
+#include <map>
+#include <set>
+
+struct MeshArena {
+	//the arena used by the game for each layout (created when first asked for, and never freed):
+	static MeshArena &shared(MeshBuffer::Layout layout);
+
+	//buffers are created on first allocation, so an arena can be made before OpenGL is ready:
+	MeshArena(MeshBuffer::Layout layout);
+	~MeshArena();
+
+	MeshArena(MeshArena const &) = delete;
+	MeshArena &operator=(MeshArena const &) = delete;
+
+	//reserve room for 'vertex_count' vertices and 'index_count' indices (growing the buffers if needed):
+	// returns the first vertex and first index of the reserved ranges.
+	// note: will throw if the buffers can't grow enough (in which case nothing stays reserved).
+	std::pair< GLuint, GLuint > allocate(GLuint vertex_count, GLuint index_count);
+	//return ranges from allocate() to the free lists:
+	void release(GLuint vertex_start, GLuint vertex_count, GLuint index_start, GLuint index_count);
+
+	MeshBuffer::Layout const layout;
+
+	GLuint vertex_buffer = 0;
+	GLuint index_buffer = 0;
+
+	//vertex array objects shared by all buffers in the arena, by program (see MeshBuffer::make_vao_for_program):
+	std::map< GLuint, GLuint > vaos;
+
+	//-- internals ---
+
+	//first-fit allocator over [0,capacity) elements:
+	struct FreeList {
+		GLuint capacity = 0;
+		std::map< GLuint, GLuint > free; //start -> count of free ranges (never adjacent; those get merged)
+		GLuint used = 0; //elements currently allocated
+
+		//first free range that fits 'count' elements, or -1U if none does:
+		GLuint allocate(GLuint count);
+		void release(GLuint start, GLuint count);
+		//add [capacity,new_capacity) to the free ranges:
+		void grow(GLuint new_capacity);
+	};
+	FreeList vertices;
+	FreeList indices;
+
+	//resize 'buffer' from old_size to new_size bytes, keeping its contents and its name:
+	static void grow_buffer(GLuint buffer, GLsizeiptr old_size, GLsizeiptr new_size);
+};
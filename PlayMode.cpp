@@ -1,9 +1,13 @@
 #include "PlayMode.hpp"
 
 #include "LitColorTextureProgram.hpp"
+#include "ClusteredLitColorTextureProgram.hpp"
+#include "ClusteredLights.hpp"
+#include "FrameUniforms.hpp"
 
 #include "DrawLines.hpp"
 #include "Mesh.hpp"
+#include "MeshArena.hpp"
 #include "Load.hpp"
 #include "gl_errors.hpp"
 #include "data_path.hpp"
@@ -11,56 +15,117 @@
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <fstream>
+#include <iostream>
 #include <random>
 #include <string>
 
 #define AVOID_RECOLLIDE_OFFSET 0.05f
 #define DEATH_LAYER -10.0f
 
-GLuint platformer_meshes_for_lit_color_texture_program = 0;
+GLuint platformer_meshes_for_clustered_lit_color_texture_program = 0;
+GLuint platformer_meshes_for_clustered_lit_color_texture_program_instanced = 0;
 Load< MeshBuffer > platformer_meshes(LoadTagDefault, []() -> MeshBuffer const * {
-	MeshBuffer const *ret = new MeshBuffer(data_path("platform-space.pnct"));
-	platformer_meshes_for_lit_color_texture_program = ret->make_vao_for_program(lit_color_texture_program->program);
+	//(keeping CPU-side triangles of each mesh, for collisions)
+	MeshBuffer const *ret = new MeshBuffer(data_path("platform-space.pnct"), MeshArena::shared(MeshBuffer::Compact), true);
+	platformer_meshes_for_clustered_lit_color_texture_program = ret->make_vao_for_program(clustered_lit_color_texture_program->program);
+	GLuint instanced_program = clustered_lit_color_texture_program->instanced_program;
+	platformer_meshes_for_clustered_lit_color_texture_program_instanced = ret->make_vao_for_program(instanced_program, [instanced_program](std::set< GLuint > *bound){
+		Scene::bind_instance_attributes(instanced_program, bound);
+	});
 	return ret;
 });
 
+//finish setting up a drawable whose mesh range and bounds are already filled in:
+static void setup_platformer_drawable(Scene::Drawable &drawable) {
+	Scene::Drawable::Pipeline mesh = drawable.pipeline;
+	drawable.pipeline = clustered_lit_color_texture_program_pipeline; //(adds in the scene's point and spot lights)
+	drawable.pipeline.textures[1] = lit_color_texture_program_pipeline.textures[1]; //beat texture
+
+	drawable.pipeline.vao = platformer_meshes_for_clustered_lit_color_texture_program;
+	drawable.pipeline.instanced.vao = platformer_meshes_for_clustered_lit_color_texture_program_instanced;
+	drawable.pipeline.type = mesh.type;
+	drawable.pipeline.indexed = mesh.indexed;
+	drawable.pipeline.quantized = (platformer_meshes->layout == MeshBuffer::Compact);
+	drawable.pipeline.start = mesh.start;
+	drawable.pipeline.count = mesh.count;
+	drawable.pipeline.lods = mesh.lods;
+	drawable.pipeline.clusters = mesh.clusters;
+	drawable.pipeline.cluster_count = mesh.cluster_count;
+	drawable.pipeline.min = mesh.min;
+	drawable.pipeline.max = mesh.max;
+
+	//Only platforms flash with the beat; player, goal, and gems keep their plain texture:
+	std::string const &name = drawable.transform->name;
+	if (name == "Player" || name == "Goal" || (name.size() > 3 && name.compare(0, 3, "Gem") == 0)) {
+		drawable.material = Scene::Drawable::Plain;
+	} else {
+		drawable.material = Scene::Drawable::Beat;
+	}
+}
+
 Load< Scene > platformer_scene(LoadTagDefault, []() -> Scene const * {
-	return new Scene(data_path("platform-space.scene"), [&](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
-		Mesh const &mesh = platformer_meshes->lookup(mesh_name);
+	Scene *ret = new Scene();
+
+	//prefer the baked level (made by bake-level; see scenes/Makefile), which needs no mesh lookups:
+	std::string level = data_path("platform-space.level");
+	bool baked = false;
+	if (std::ifstream(level, std::ios::binary)) {
+		try {
+			ret->load_baked(level, *platformer_meshes, [](Scene &, Scene::Drawable &drawable) {
+				setup_platformer_drawable(drawable);
+			});
+			baked = true;
+			//(baked levels come with transform bboxes and the bvh already filled in)
+		} catch (std::runtime_error const &e) {
+			//(e.g., the level is older than platform-space.pnct; the .scene still works)
+			std::cerr << "WARNING: not using baked level: " << e.what() << std::endl;
+			*ret = Scene(); //(drop whatever was loaded before the error)
+		}
+	}
+	if (!baked) {
+		ret->load(data_path("platform-space.scene"), *platformer_meshes, [](Scene &, Scene::Drawable &drawable) {
+			setup_platformer_drawable(drawable);
+		});
+
+		//Load bboxes into transformations for easier access:
+		for (auto const &drawable : ret->drawables) {
+			drawable.transform->bbox.min = drawable.pipeline.min;
+			drawable.transform->bbox.max = drawable.pipeline.max;
+		}
 
-		scene.drawables.emplace_back(transform);
-		Scene::Drawable &drawable = scene.drawables.back();
+		//build spatial index for collision queries (nothing in the shared scene moves, so this happens once):
+		ret->update_bvh();
+	}
 
-		drawable.pipeline = lit_color_texture_program_pipeline;
+	//group drawables by material so Scene::draw only switches material uniforms once per frame:
+	ret->drawables.sort([](Scene::Drawable const &a, Scene::Drawable const &b) {
+		return a.material < b.material;
+	});
 
-		drawable.pipeline.vao = platformer_meshes_for_lit_color_texture_program;
-		drawable.pipeline.type = mesh.type;
-		drawable.pipeline.start = mesh.start;
-		drawable.pipeline.count = mesh.count;
-		drawable.pipeline.min = mesh.min;
-		drawable.pipeline.max = mesh.max;
+	return ret;
+});
 
-	});
+//keyframe animation of the level (exported by scenes/export-animation.py; see scenes/Makefile):
+Load< AnimationClips > platformer_animations(LoadTagDefault, []() -> AnimationClips const * {
+	std::string filename = data_path("platform-space.anim");
+	if (!std::ifstream(filename, std::ios::binary)) {
+		std::cerr << "WARNING: '" << filename << "' not found; the level won't be animated." << std::endl;
+		return new AnimationClips();
+	}
+	return new AnimationClips(filename);
 });
 
 Load< Sound::Sample > mainMusic(LoadTagDefault, []() -> Sound::Sample const * {
 	return new Sound::Sample(data_path("A-Stellar-Jaunt.wav"));
 });
 
-PlayMode::PlayMode() : scene(*platformer_scene) {
+PlayMode::PlayMode() {
 	beatT = 0.0f;
-	auto getBBox = [this](Scene scene, std::string name) { //Load bboxes into transformations for easier access 
-		BBoxStruct newBBox;
-		newBBox.min = glm::vec3(0.0f);
-		newBBox.max = glm::vec3(0.0f);
-		for (auto whichDrawable : scene.drawables) {
-			if (whichDrawable.transform->name == name) {
-				newBBox.min = whichDrawable.pipeline.min;
-				newBBox.max = whichDrawable.pipeline.max;
-			}
-		}
-		return newBBox;
-	};
+	//share the loaded scene instead of copying it:
+	scene.set_base(*platformer_scene);
+
 	//Initialize tranformation pointer arrays
 	for (size_t c = 0; c < numPlatforms; c++) {
 		platformArray[c] = nullptr;
@@ -68,46 +133,76 @@ PlayMode::PlayMode() : scene(*platformer_scene) {
 	for (size_t c = 0; c < numGems; c++) {
 		gemArray[c] = nullptr;
 	}
-	for (auto &transform : scene.transforms) {
-		std::string transformStr = std::string(transform.name);
-		size_t whichPlat = 0;
-		size_t whichGem = 0;
-		if (transformStr.size() > 8 && transformStr.substr(0, 8) == std::string("Platform")) { //If a platformer, derive which index and load into array
-			for (size_t ind = transformStr.size() - 1; ind >= 8; ind--) {
-				whichPlat += (size_t)((uint8_t)transformStr.at(ind) - 48) * (size_t)pow(10, (transformStr.size() - 1) - ind);
-			}
-			platformArray[whichPlat] = &transform;
-			BBoxStruct useBBox = getBBox(scene, std::string(transform.name));
-			(platformArray[whichPlat])->bbox = useBBox;
-		}
-		if (transformStr.size() > 3 && transformStr.substr(0, 3) == std::string("Gem")) { //Same as above but for gems
-			for (size_t ind = transformStr.size() - 1; ind >= 3; ind--) {
-				whichGem += (size_t)((uint8_t)transformStr.at(ind) - 48) * (size_t)pow(10, (transformStr.size() - 1) - ind);
-			}
-			gemArray[whichGem] = &transform;
-			BBoxStruct useBBox = getBBox(scene, std::string(transform.name));
-			(gemArray[whichGem])->bbox = useBBox;
-		}
-		else if (transform.name == "Player") {
-			player = &transform;
-			player->bbox = getBBox(scene, std::string("Player"));
-			playerOrigin = *player;
-		}
-		else if (transform.name == "Goal") {
-			goal = &transform;
-			goal->bbox = getBBox(scene, std::string("Goal"));
-		}
+	for (auto const &numbered : platformer_scene->find_numbered("Platform")) { //Platforms, in numeric order
+		if (numbered.first >= numPlatforms) throw std::runtime_error("Unexpected platform index " + std::to_string(numbered.first) + ".");
+		platformArray[numbered.first] = numbered.second; //(platforms never change, so use the shared transform)
+		platformIndex[numbered.second] = numbered.first;
+	}
+	for (auto const &numbered : platformer_scene->find_numbered("Gem")) { //Same as above but for gems
+		if (numbered.first >= numGems) throw std::runtime_error("Unexpected gem index " + std::to_string(numbered.first) + ".");
+		gemArray[numbered.first] = scene.override_transform(numbered.second); //gems get hidden when collected
+		gemIndex[numbered.second] = numbered.first;
 	}
+	if (Scene::Transform const *found = platformer_scene->find_transform("Player")) {
+		player = scene.override_transform(found);
+	}
+	goal = platformer_scene->find_transform("Goal");
 	for (size_t c = 0; c < numPlatforms; c++) {
 		std::string errorStr = std::string("Platform").append(std::to_string(c)).append(std::string(" not found."));
 		if (platformArray[c] == nullptr) throw std::runtime_error(errorStr.c_str());
 	}
 	if (player == nullptr) throw std::runtime_error("Platform not found.");
 
-	//get pointer to camera for convenience:
-	if (scene.cameras.size() != 1) throw std::runtime_error("Expecting scene to have exactly one camera, but it has " + std::to_string(scene.cameras.size()));
+	//collide with the triangles of the platform and gem meshes:
+	for (size_t c = 0; c < numPlatforms; c++) {
+		platformCollision[c] = nullptr;
+	}
+	for (size_t c = 0; c < numGems; c++) {
+		gemCollision[c] = nullptr;
+	}
+	for (auto const &drawable : platformer_scene->drawables) {
+		auto platform = platformIndex.find(drawable.transform);
+		if (platform != platformIndex.end()) platformCollision[platform->second] = drawable.collision;
+		auto gem = gemIndex.find(drawable.transform);
+		if (gem != gemIndex.end()) gemCollision[gem->second] = drawable.collision;
+	}
+	for (size_t c = 0; c < numPlatforms; c++) {
+		if (platformCollision[c] == nullptr) throw std::runtime_error("Platform" + std::to_string(c) + " has no collision mesh.");
+	}
+
+	//get pointer to camera for convenience (the camera follows the player, so it gets a local copy):
+	if (platformer_scene->cameras.size() != 1) throw std::runtime_error("Expecting scene to have exactly one camera, but it has " + std::to_string(platformer_scene->cameras.size()));
+	scene.override_transform(platformer_scene->cameras.front().transform);
+	assert(scene.cameras.size() == 1);
 	camera = &scene.cameras.front();
 
+	//snapshot everything gameplay can change (the transforms 'scene' owns, plus 'state'):
+	std::vector< Scene::Transform * > tracked;
+	for (auto &transform : scene.transforms) {
+		tracked.emplace_back(&transform);
+	}
+	history = SnapshotRing< GameState >(tracked, HistoryFrames);
+	start = SnapshotRing< GameState >(tracked, 1);
+	state.musicSample = 0; //(music starts from the top, just below)
+	start.save(state);
+	history.save(state);
+
+	//play every clip of the level, looping:
+	// (after taking 'tracked', so snapshots skip transforms only animation moves -- update() re-poses those anyway)
+	for (auto const &clip : platformer_animations->clips) {
+		animator.play(*platformer_animations, clip, scene);
+	}
+	//...and collide with the animated copies of platforms and the goal (player and gems were already copies):
+	// (the broad phase still queries platformer_scene's bvh of un-animated poses, so clips should only turn
+	//  and bob platforms near where they were placed -- nearby queries are padded by a unit for this)
+	for (size_t c = 0; c < numPlatforms; c++) {
+		if (Scene::Transform *animated = scene.find_transform(platformArray[c]->name)) platformArray[c] = animated;
+	}
+	if (goal) {
+		if (Scene::Transform *animated = scene.find_transform(goal->name)) goal = animated;
+	}
+	animator.update(0.0f); //(pose everything for the first frame)
+
 	//start music loop playing:
 	// (note: position will be over-ridden in update())
 	bg_loop = Sound::loop_3D(*mainMusic, 1.0f, get_player_position(), 10.0f);
@@ -145,52 +240,98 @@ bool PlayMode::bboxIntersect(BBoxStruct object, BBoxStruct stationary) { //Check
 	return xBool && yBool && zBool; //Only true if all 3 axises have an intersection
 }
 
-Collision PlayMode::bboxCollide(Scene::Transform *object, Scene::Transform *stationary) {
-	auto distToSurf = [this](glm::vec3 point, glm::vec3 sideCenter) {
-		return glm::length(sideCenter - point);
-	};
-	Collision retCol;
-	retCol.sideCenter = glm::vec3(0.0f);
-
-	//Creating bbox strucuts
-	BBoxStruct objectStruct; BBoxStruct stationaryStruct;
-	glm::vec3 omin = object->bbox.min; glm::vec3 omax = object->bbox.min;
-	glm::vec3 smin = stationary->bbox.min; glm::vec3 smax = stationary->bbox.min; //Converts bboxes into world space bboxes
-	objectStruct.min = object->make_local_to_world() * glm::vec4(omin.x,omin.y,omin.z, 1.0f);
-	objectStruct.max = object->make_local_to_world() * glm::vec4(omax.x,omax.y,omax.z, 1.0f);
-	stationaryStruct.min = stationary->make_local_to_world() * glm::vec4(stationary->bbox.min, 1.0f);
-	stationaryStruct.max = stationary->make_local_to_world() * glm::vec4(stationary->bbox.max, 1.0f);
-
-	retCol.collides =  bboxIntersect(objectStruct, stationaryStruct); //Tests for collisions
-	glm::vec3 objCenter =object->make_local_to_world() *
-		glm::vec4(object->bbox.min + (object->bbox.max - object->bbox.min) / 2.f, 1.0f);
-	if (retCol.collides) { //Finds minimum distance side if there is a collision, and returns that axis
-		float minDist = INFINITY; 
-		glm::vec3 statCenter = stationary->bbox.min + stationary->make_local_to_world() * 
-			glm::vec4((stationary->bbox.max - stationary->bbox.min) / 2.f, 1.0f);
-		float statX = stationary->scale.x*(stationary->bbox.max.x - stationary->bbox.min.x)/2.f; //Getting offset of stationary
-		float statY = stationary->scale.y * (stationary->bbox.max.y - stationary->bbox.min.y) / 2.f; //on each axis
-		float statZ = stationary->scale.z * (stationary->bbox.max.z - stationary->bbox.min.z) / 2.f;
-		glm::vec3 sides[6];
-		sides[0] = statCenter + glm::vec3(statX, 0.0f, 0.0f);
-		sides[1] = statCenter - glm::vec3(statX, 0.0f, 0.0f); //Array of axis offsets from center for eachside
-		sides[2] = statCenter + glm::vec3(0.0f, statY, 0.0f);
-		sides[3] = statCenter - glm::vec3(0.0f, statY, 0.0f);
-		sides[4] = statCenter + glm::vec3(0.0f, 0.0f, statZ);
-		sides[5] = statCenter - glm::vec3(0.0f, 0.0f, statZ);
-		for (size_t sideInd = 0; sideInd < 6; sideInd++) {
-			glm::vec3 whichSide = sides[sideInd];
-			float sideDist = distToSurf(objCenter, whichSide);
-			if (sideDist < minDist) {
-				minDist = sideDist;
-				retCol.sideCenter = whichSide;
+PlayMode::Capsule PlayMode::playerCapsule() {
+	//world-space bounds of the player:
+	glm::mat4x3 toWorld = player->make_local_to_world();
+	glm::vec3 min = glm::vec3( INFINITY);
+	glm::vec3 max = glm::vec3(-INFINITY);
+	for (uint32_t c = 0; c < 8; c++) {
+		glm::vec3 corner = toWorld * glm::vec4(
+			(c & 1 ? player->bbox.max.x : player->bbox.min.x),
+			(c & 2 ? player->bbox.max.y : player->bbox.min.y),
+			(c & 4 ? player->bbox.max.z : player->bbox.min.z), 1.0f);
+		min = glm::min(min, corner);
+		max = glm::max(max, corner);
+	}
+
+	//...as wide as the narrower side, and standing up along z:
+	Capsule capsule;
+	glm::vec3 center = 0.5f * (min + max);
+	glm::vec3 half = 0.5f * (max - min);
+	capsule.radius = std::min(half.x, half.y);
+	float reach = std::max(0.0f, half.z - capsule.radius);
+	capsule.a = center - glm::vec3(0.0f, 0.0f, reach);
+	capsule.b = center + glm::vec3(0.0f, 0.0f, reach);
+	return capsule;
+}
+
+bool PlayMode::sweepPlatforms(glm::vec3 const &displacement, CollisionMesh::Hit *hit) {
+	Capsule capsule = playerCapsule();
+
+	//only platforms near the swept capsule can be hit:
+	// (padded, since platformer_scene's bvh has the platforms' un-animated poses)
+	glm::vec3 min = glm::min(glm::min(capsule.a, capsule.a + displacement), glm::min(capsule.b, capsule.b + displacement)) - glm::vec3(capsule.radius + 1.0f);
+	glm::vec3 max = glm::max(glm::max(capsule.a, capsule.a + displacement), glm::max(capsule.b, capsule.b + displacement)) + glm::vec3(capsule.radius + 1.0f);
+
+	bool found = false;
+	platformer_scene->query_box(min, max, [&](Scene::Drawable &drawable) {
+		auto platform = platformIndex.find(drawable.transform);
+		if (platform == platformIndex.end()) return true;
+		Scene::Transform const *whichTransform = platformArray[platform->second]; //(the animated copy, if any)
+		CollisionMesh::Hit platformHit;
+		if (platformCollision[platform->second]->sweep_capsule(whichTransform->make_local_to_world(), whichTransform->make_world_to_local(),
+			capsule.a, capsule.b, capsule.radius, displacement, &platformHit)) {
+			if (!found || platformHit.t < hit->t) {
+				*hit = platformHit;
+				found = true;
 			}
 		}
+		return true;
+	});
+	return found;
+}
+
+void PlayMode::movePlayer(glm::vec3 const &displacement) {
+	glm::vec3 remaining = displacement;
+	//(a few slides handle corners, where the capsule runs into a second surface while sliding along the first)
+	for (uint32_t slide = 0; slide < 4; slide++) {
+		float length = glm::length(remaining);
+		if (length == 0.0f) break;
+
+		//look a bit past the end of the move, so the player can stop short of surfaces by AVOID_RECOLLIDE_OFFSET:
+		// (then the next sweep doesn't start out touching, which would report a hit at once)
+		glm::vec3 direction = remaining / length;
+		CollisionMesh::Hit hit;
+		float distance = length;
+		if (sweepPlatforms(direction * (length + AVOID_RECOLLIDE_OFFSET), &hit)) {
+			distance = hit.t * (length + AVOID_RECOLLIDE_OFFSET) - AVOID_RECOLLIDE_OFFSET;
+		}
+		if (distance >= length) {
+			player->position += remaining;
+			break;
+		}
+
+		float t = std::max(0.0f, distance) / length;
+		player->position += t * remaining;
+		if (distance < 0.0f) {
+			player->position -= distance * hit.normal; //(already too close, so step back off the surface)
+		}
+
+		if (hit.normal.z > 0.7f) { //Landed on top of a platform
+			state.grounded = true;
+			state.jumpLock = false;
+			state.curJumpTime = 0.0f;
+			state.curPressTime = 0.0f;
+			state.walled = false;
+			state.jumped = false;
+		} else if (std::abs(hit.normal.z) < 0.3f) {
+			state.walled = true; //If not, the player is hitting a wall
+		}
 
-		glm::vec3 retAxis = glm::normalize(retCol.sideCenter - statCenter); //Returns axis that is closest to the object
-		retCol.sideCenter = retAxis;
+		//slide along the surface for the rest of the move:
+		remaining *= 1.0f - t;
+		remaining -= hit.normal * std::min(0.0f, glm::dot(remaining, hit.normal));
 	}
-	return retCol;
 }
 
 bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size) {
@@ -222,11 +363,16 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 			r.pressed = true;
 			return true;
 		}
+		else if (evt.key.keysym.sym == SDLK_BACKSPACE) {
+			rewind.downs += 1;
+			rewind.pressed = true;
+			return true;
+		}
 		else if (evt.key.keysym.sym == SDLK_SPACE) {
 			space.downs += 1;
 			space.pressed = true;
 			if (badSpace) space.pressed = false; //Guarantees player can't cheat game by holding space
-			if (!canJump) badSpace = true;
+			if (!state.canJump) badSpace = true;
 			return true;
 		}
 	} else if (evt.type == SDL_KEYUP) {
@@ -248,6 +394,10 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 			r.pressed = false;
 			return true;
 		}
+		else if (evt.key.keysym.sym == SDLK_BACKSPACE) {
+			rewind.pressed = false;
+			return true;
+		}
 		else if (evt.key.keysym.sym == SDLK_SPACE) {
 			space.pressed = false;
 			badSpace = false;
@@ -275,8 +425,8 @@ void PlayMode::songUpdate() { //Update to see if the player can jump, and if the
 
 	currentTime *= 96.f;
 	int currentInt = (int)currentTime;
-	if (currentInt % 2 == 0) canJump = true;
-	else canJump = false; //Every other measure can jump
+	if (currentInt % 2 == 0) state.canJump = true;
+	else state.canJump = false; //Every other measure can jump
 
 	float inT = currentTime - (float) currentInt;
 	if (inT < 0.0f) inT = 0.0f;
@@ -293,28 +443,32 @@ void PlayMode::songUpdate() { //Update to see if the player can jump, and if the
 }
 
 void PlayMode::resetGame() {
-	*player = playerOrigin;
-
-	//Reset gameplay vars
-	curPressTime = 0.0f;
-	curV0 = glm::vec3(0.0f); //Derived from above, used for velocity from jump, not object velocity
-	curVelocity = glm::vec3(0.0f); //Current velocity, used for motion
-	grounded = true;
-	curJumpTime = 0.0f;//Similar to press variables but for total time in air
-	canJump = false; //controlled by beat
-	jumpLock = false; //Avoids double jumps
-	walled = false; //If colliding with a wall;
-	timer = 0.f;
-	winBool = false;
-	score = 0;
-	for (size_t c = 0; c < numGems; c++) {
-		gemArray[c]->doDraw = true;
-	}
+	start.restore(0, &state); //Player, camera, gems, gameplay vars, and music back to how they started
+	restoreMusic();
+	history.clear(); //(so rewinding can't go back into the last run; update() saves the new first frame)
+}
 
+void PlayMode::restoreMusic() {
+	Sound::lock(); //(playback position is read by the audio thread)
+	bg_loop->i = std::min< uint32_t >(state.musicSample, uint32_t(bg_loop->data.size()));
+	Sound::unlock();
 }
 
 void PlayMode::update(float elapsed) {
 
+	//animation is just for show, so it keeps playing while rewinding:
+	animator.update(elapsed);
+
+	if (rewind.pressed) { //Step back one frame per update while held (stopping at the oldest saved frame)
+		if (history.size() > 1) {
+			history.discard(1);
+			history.restore(0, &state);
+			restoreMusic(); //(so the beat -- and canJump -- match the restored frame)
+		}
+		rewind.downs = 0;
+		return;
+	}
+
 	if (badSpace && space.pressed) space.pressed = false; //Guarantees player can't cheat game by holding space
 
 	auto winCheck = [this]() { //Checks if the player intersected the goal's bbox
@@ -329,70 +483,18 @@ void PlayMode::update(float elapsed) {
 		return bboxIntersect(playerStruct, goalStruct);
 	};
 
-	if(!winBool) timer += elapsed; //Timer update
-	if (timer >= endTime) resetGame();
+	if(!state.winBool) state.timer += elapsed; //Timer update
+	if (state.timer >= endTime) resetGame();
 
 	songUpdate();
 
-	auto aboveCollision = [this]() { //Simplified bbox hit that just checks if the player is above any platforms.
-		//If they are above none, they should be falling, else don't do anything more than the collision check
-		bool above = false;
-		BBoxStruct newPlayer;
-		newPlayer.min = player->make_local_to_world() * glm::vec4(player->bbox.min, 1.0);
-		newPlayer.max = player->make_local_to_world() * glm::vec4(player->bbox.max, 1.0);
-		for (size_t whichPlatform = 0; whichPlatform < numPlatforms; whichPlatform++) {
-			Scene::Transform* whichTransform = platformArray[whichPlatform];
-			BBoxStruct newPlatform;
-			newPlatform.min = whichTransform->make_local_to_world() * glm::vec4(whichTransform->bbox.min, 1.0);
-			newPlatform.max = whichTransform->make_local_to_world() * glm::vec4(whichTransform->bbox.max, 1.0);
-			if (newPlayer.min.x <= newPlatform.max.x && newPlayer.max.x >= newPlatform.min.x
-				&& newPlayer.min.y <= newPlatform.max.y && newPlayer.max.y >= newPlatform.min.y) above = true;
-		} 
-		return above;
-	};
-
-
-	//Collision check
-	for (size_t whichPlatform = 0; whichPlatform < numPlatforms; whichPlatform++) {
-		Scene::Transform* whichTransform = platformArray[whichPlatform];
-		Collision collideRes = bboxCollide(player, whichTransform); //For  each platform, check if it collides
-		if (collideRes.collides) { //If so, get the offset of the axis (side) with which it collided
-			//Get offset
-			glm::vec3 absAxis = glm::vec3(abs(collideRes.sideCenter.x), abs(collideRes.sideCenter.y), abs(collideRes.sideCenter.z));
-			glm::vec3 axisDif = whichTransform->scale * collideRes.sideCenter * (whichTransform->bbox.max - whichTransform->bbox.min) / glm::vec3(2.f);
-			glm::vec3 offset = whichTransform->make_local_to_world()*glm::vec4(axisDif,1.0f);
-			offset = absAxis * offset;
-			glm::vec3 playerDif = collideRes.sideCenter * player->scale *(
-				(player->bbox.max - player->bbox.min) / glm::vec3(2.f) ); //Scale offset by player scale on that axis
-
-			player->position *= (glm::vec3(1.0f) -absAxis);
-			player->position += offset + playerDif; //And add to position
-
-			if (collideRes.sideCenter.z > 0.0f) { //If the axis was positive z, the player is on the platform
-				grounded = true;
-				jumpLock = false;
-				curJumpTime = 0.0f;
-				curPressTime = 0.0f;
-				walled = false;
-				jumped = false;
-			}
-			else if(collideRes.sideCenter.z == 0.0f) {
-				walled = true; //If not, the player is hitting a wall
-			}
-		}
-	}
-	if (!aboveCollision()) { //Checks to see if not above a surface, if so, know not grounded
-		walled = false;
-		grounded = false;
-	}
-
-	//Gem collection check
-	for (size_t whichGem = 0; whichGem < numGems; whichGem++) {
-		Scene::Transform* whichTransform = gemArray[whichGem];
-		Collision collideRes = bboxCollide(player, whichTransform);
-		if (collideRes.collides && whichTransform->doDraw) {
-			gemArray[whichGem]->doDraw = false;
-			score += 250; //If a gem is collected, it should disappear and add 250 to the score
+	//Ground check: a player standing on a platform stays standing only while there's a platform just below
+	// (movePlayer stops the player AVOID_RECOLLIDE_OFFSET above the platform it lands on, so look twice that far)
+	if (state.grounded) {
+		state.walled = false; //(set again by movePlayer if the player is still pushing into a wall)
+		CollisionMesh::Hit hit;
+		if (!sweepPlatforms(glm::vec3(0.0f, 0.0f, -2.0f * AVOID_RECOLLIDE_OFFSET), &hit) || hit.normal.z <= 0.7f) {
+			state.grounded = false; //Walked off the edge, so start falling
 		}
 	}
 
@@ -403,12 +505,13 @@ void PlayMode::update(float elapsed) {
 
 	//Win check
 	if (winCheck()) {
-		if(!winBool) score += (size_t)(endTime - timer) * 10;
-		winBool = true; //If the player has won, pauses the game, and reset if they press R. Display win message
+		if(!state.winBool) state.score += (size_t)(endTime - state.timer) * 10;
+		state.winBool = true; //If the player has won, pauses the game, and reset if they press R. Display win message
 	}
-	if (r.pressed && winBool) resetGame(); //^^
+	if (r.pressed && state.winBool) resetGame(); //^^
 
-	if (!winBool) { //Else, play the game
+	glm::vec3 startPosition = player->position; //(for collecting gems along the way)
+	if (!state.winBool) { //Else, play the game
 		//combine inputs into a move:
 		glm::vec2 move = glm::vec2(0.0f);
 		if (left.pressed && !right.pressed) move.x = -1.0f;
@@ -418,48 +521,72 @@ void PlayMode::update(float elapsed) {
 		constexpr float PlayerSpeed = 5.0f;
 		//make it so that moving diagonally doesn't go faster:
 		if (move != glm::vec2(0.0f)) move = glm::normalize(move) * PlayerSpeed * elapsed;
-		if (!grounded && (!space.pressed || curPressTime >= maxPressTime) && !jumpLock && jumped) jumpLock = true; //Do not allow the player to jump more than once
-		if (!jumpLock && space.pressed && curPressTime < maxPressTime) {//Jump if possible
-			if (!grounded || canJump) {
-				jumped = true; //The player has jumped
-				grounded = false; //The player is in the air
-				curPressTime += elapsed; //Update how long of a jump the player uses
-				if (curPressTime > maxPressTime) curPressTime = maxPressTime;
-				float oldJumpTime = curJumpTime; //Calculate delta between old and current point in trajectory
-				glm::vec3 oldJump = glm::vec3(0.0f, 0.0f, -gAcc / 2.f) * glm::vec3((float)pow(oldJumpTime, 2)) + glm::vec3(oldJumpTime) * curV0;
-				curV0.z = curPressTime * jumpFactor;
-				curJumpTime += elapsed;
-				glm::vec3 totalJump = glm::vec3(0.0f, 0.0f, -gAcc / 2.f) * glm::vec3((float)pow(curJumpTime, 2)) + glm::vec3(curJumpTime) * curV0;
+		if (!state.grounded && (!space.pressed || state.curPressTime >= maxPressTime) && !state.jumpLock && state.jumped) state.jumpLock = true; //Do not allow the player to jump more than once
+		if (!state.jumpLock && space.pressed && state.curPressTime < maxPressTime) {//Jump if possible
+			if (!state.grounded || state.canJump) {
+				state.jumped = true; //The player has jumped
+				state.grounded = false; //The player is in the air
+				state.curPressTime += elapsed; //Update how long of a jump the player uses
+				if (state.curPressTime > maxPressTime) state.curPressTime = maxPressTime;
+				float oldJumpTime = state.curJumpTime; //Calculate delta between old and current point in trajectory
+				glm::vec3 oldJump = glm::vec3(0.0f, 0.0f, -gAcc / 2.f) * glm::vec3((float)pow(oldJumpTime, 2)) + glm::vec3(oldJumpTime) * state.curV0;
+				state.curV0.z = state.curPressTime * jumpFactor;
+				state.curJumpTime += elapsed;
+				glm::vec3 totalJump = glm::vec3(0.0f, 0.0f, -gAcc / 2.f) * glm::vec3((float)pow(state.curJumpTime, 2)) + glm::vec3(state.curJumpTime) * state.curV0;
 				glm::vec3 jumpDelta = totalJump - oldJump;
-				player->position += jumpDelta; //Update position
-				if (!walled) player->position += glm::vec3(move.x, move.y, 0.0f); //Allow horizontal movement if not against a wall
+				if (!state.walled) jumpDelta += glm::vec3(move.x, move.y, 0.0f); //Allow horizontal movement if not against a wall
+				movePlayer(jumpDelta); //Update position
 			}
 		}
-		else  if (!grounded && jumpLock) { //In air
-			float oldJumpTime = curJumpTime; //Calculates rest of trajectory, not increasing jump, only if jump is finished, and not on the ground
-			glm::vec3 oldJump = (glm::vec3(0.0f, 0.0f, -gAcc / 2.f)) * glm::vec3((float)pow(oldJumpTime, 2)) + (curV0)*glm::vec3(oldJumpTime);
-			curJumpTime += elapsed;
-			glm::vec3 totalJump = glm::vec3(0.0f, 0.0f, -gAcc / 2.f) * glm::vec3((float)pow(curJumpTime, 2)) + glm::vec3(curJumpTime) * curV0;
+		else  if (!state.grounded && state.jumpLock) { //In air
+			float oldJumpTime = state.curJumpTime; //Calculates rest of trajectory, not increasing jump, only if jump is finished, and not on the ground
+			glm::vec3 oldJump = (glm::vec3(0.0f, 0.0f, -gAcc / 2.f)) * glm::vec3((float)pow(oldJumpTime, 2)) + (state.curV0)*glm::vec3(oldJumpTime);
+			state.curJumpTime += elapsed;
+			glm::vec3 totalJump = glm::vec3(0.0f, 0.0f, -gAcc / 2.f) * glm::vec3((float)pow(state.curJumpTime, 2)) + glm::vec3(state.curJumpTime) * state.curV0;
 			glm::vec3 jumpDelta = totalJump - oldJump;
-			player->position += jumpDelta;
-			if (!walled) player->position += glm::vec3(move.x, move.y, 0.0f);
+			if (!state.walled) jumpDelta += glm::vec3(move.x, move.y, 0.0f);
+			movePlayer(jumpDelta);
 		}
-		else if (!grounded) {//falling //Falling and not jumping
-			float oldJumpTime = curJumpTime;
+		else if (!state.grounded) {//falling //Falling and not jumping
+			float oldJumpTime = state.curJumpTime;
 			glm::vec3 oldJump = (glm::vec3(0.0f, 0.0f, -gAcc / 2.f)) * glm::vec3((float)pow(oldJumpTime, 2));
-			curJumpTime += elapsed;
-			glm::vec3 totalJump = glm::vec3(0.0f, 0.0f, -gAcc / 2.f) * glm::vec3((float)pow(curJumpTime, 2));
+			state.curJumpTime += elapsed;
+			glm::vec3 totalJump = glm::vec3(0.0f, 0.0f, -gAcc / 2.f) * glm::vec3((float)pow(state.curJumpTime, 2));
 			glm::vec3 jumpDelta = totalJump - oldJump;
-			player->position += jumpDelta;
-			if (!walled) player->position += glm::vec3(move.x, move.y, 0.0f);
+			if (!state.walled) jumpDelta += glm::vec3(move.x, move.y, 0.0f);
+			movePlayer(jumpDelta);
 
 		}
 		else {//Move player if not jump
-			player->position += glm::vec3(move.x, move.y, 0.0f);
+			movePlayer(glm::vec3(move.x, move.y, 0.0f));
 		}
 		camera->transform->position = player->position + glm::vec3(0.0, -15.0f, 3.0f); //Camera follows player
 	}
 
+	//Gem collection check, along the path the player moved this frame:
+	{
+		Capsule capsule = playerCapsule();
+		glm::vec3 moved = player->position - startPosition;
+		capsule.a -= moved;
+		capsule.b -= moved;
+		//(padded like sweepPlatforms' query, since gems may be animated away from where the bvh has them)
+		glm::vec3 min = glm::min(glm::min(capsule.a, capsule.a + moved), glm::min(capsule.b, capsule.b + moved)) - glm::vec3(capsule.radius + 1.0f);
+		glm::vec3 max = glm::max(glm::max(capsule.a, capsule.a + moved), glm::max(capsule.b, capsule.b + moved)) + glm::vec3(capsule.radius + 1.0f);
+		platformer_scene->query_box(min, max, [&](Scene::Drawable &drawable) {
+			auto gem = gemIndex.find(drawable.transform);
+			if (gem == gemIndex.end()) return true;
+			Scene::Transform *whichTransform = gemArray[gem->second];
+			CollisionMesh const *collision = gemCollision[gem->second];
+			CollisionMesh::Hit hit;
+			if (whichTransform->doDraw && collision && collision->sweep_capsule(whichTransform->make_local_to_world(), whichTransform->make_world_to_local(),
+				capsule.a, capsule.b, capsule.radius, moved, &hit)) {
+				whichTransform->doDraw = false;
+				state.score += 250; //If a gem is collected, it should disappear and add 250 to the score
+			}
+			return true;
+		});
+	}
+
 
 	{ //update listener to camera position:
 		glm::mat4x3 frame = camera->transform->make_local_to_parent();
@@ -472,6 +599,11 @@ void PlayMode::update(float elapsed) {
 		bg_loop->set_position(get_player_position(),bg_loop->pan.ramp);
 	}
 
+	Sound::lock();
+	state.musicSample = bg_loop->i;
+	Sound::unlock();
+	history.save(state);
+
 	//reset button press counters:
 	left.downs = 0;
 	right.downs = 0;
@@ -483,13 +615,15 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 	//update camera aspect ratio for drawable:
 	camera->aspect = float(drawable_size.x) / float(drawable_size.y);
 
-	//set up light type and position for lit_color_texture_program:
-	glUseProgram(lit_color_texture_program->program);
-	glUniform1i(lit_color_texture_program->LIGHT_TYPE_int, 1);
-	glUniform3fv(lit_color_texture_program->LIGHT_DIRECTION_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f,-1.0f)));
-	glUniform3fv(lit_color_texture_program->LIGHT_ENERGY_vec3, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 0.95f)));
+	//set up light type and position (shared by all programs through the "Light" uniform block):
+	FrameUniforms::Light light;
+	light.LIGHT_TYPE = 1;
+	light.LIGHT_DIRECTION = glm::vec3(0.0f, 0.0f,-1.0f);
+	light.LIGHT_ENERGY = glm::vec3(1.0f, 1.0f, 0.95f);
+	frame_uniforms->set_light(light);
+	//...the scene's own point and spot lights are sorted into clusters for the lit program:
+	clustered_lights->update(scene, *camera, drawable_size);
 	scene.t = beatT; //Loads current beat time into scene for rendering
-	glUseProgram(0);
 
 	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 	glClearDepth(1.0f); //1.0 is actually the default value to clear the depth buffer to, but FYI you can change it.
@@ -511,11 +645,11 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 		));
 
 		constexpr float H = 0.09f; 
-		std::string timerStr = (std::string("; Time left: ")).append(std::to_string(int(endTime - timer)));
-		std::string scoreStr = (std::string("; Score: ")).append(std::to_string(score + 10*(int)(endTime - timer)));
-		std::string useStr = (std::string("WASD moves; space jumps")).append(timerStr).append(scoreStr);
-		if (winBool) { //Display win message if the player has won
-			useStr = (std::string("You won! You got: ")).append(std::to_string(score)).append(std::string(" points! Press R to replay!"));
+		std::string timerStr = (std::string("; Time left: ")).append(std::to_string(int(endTime - state.timer)));
+		std::string scoreStr = (std::string("; Score: ")).append(std::to_string(state.score + 10*(int)(endTime - state.timer)));
+		std::string useStr = (std::string("WASD moves; space jumps; backspace rewinds")).append(timerStr).append(scoreStr);
+		if (state.winBool) { //Display win message if the player has won
+			useStr = (std::string("You won! You got: ")).append(std::to_string(state.score)).append(std::string(" points! Press R to replay!"));
 		}
 		lines.draw_text(useStr.c_str(),
 			glm::vec3(-aspect + 0.1f * H, -1.0 + 0.1f * H, 0.0),
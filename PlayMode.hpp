@@ -1,17 +1,15 @@
 #include "Mode.hpp"
 
+#include "Animation.hpp"
 #include "Scene.hpp"
+#include "SnapshotRing.hpp"
 #include "Sound.hpp"
 
 #include <glm/glm.hpp>
 
 #include <vector>
 #include <deque>
-
-struct Collision{
-	bool collides = false;
-	glm::vec3 sideCenter; //Which side is closest to the object
-};
+#include <unordered_map>
 
 struct PlayMode : Mode {
 	PlayMode();
@@ -28,46 +26,59 @@ struct PlayMode : Mode {
 	struct Button {
 		uint8_t downs = 0;
 		uint8_t pressed = 0;
-	} left, right, down, up, space,r;
+	} left, right, down, up, space,r, rewind;
 
-	//local copy of the game scene (so code can change it during gameplay):
+	//copy-on-write instance of the game scene; only the transforms gameplay changes
+	// (player, camera, gems) are copied, everything else is shared with platformer_scene:
 	Scene scene;
 
 	//Player, goal, and platforms
 	size_t numPlatforms = 26;
-	Scene::Transform *platformArray[26];
-	glm::quat platform_rotationArray[26];
+	Scene::Transform const *platformArray[26];
 	Scene::Transform *player = nullptr;
-	glm::quat player_rotation;
-	Scene::Transform playerOrigin;
-	Scene::Transform* goal = nullptr;
-	glm::quat goal_rotation;
+	Scene::Transform const *goal = nullptr;
 	size_t numGems = 3;
 	Scene::Transform* gemArray[3];
-	glm::quat gem_rotationArray[3];
-	float wobble = 0.0f;
+	//index into platformArray / gemArray of each (shared) transform, for platformer_scene bvh queries:
+	std::unordered_map< Scene::Transform const *, size_t > platformIndex;
+	std::unordered_map< Scene::Transform const *, size_t > gemIndex;
+
+	//plays the level's exported clips (spinning gems, turning platforms, ...) on 'scene':
+	// (platformArray and goal point at the animated copies, so collisions see what's drawn)
+	Animator animator;
 
 	//Gameplay
 	float maxPressTime = 0.13f; //Maximal # of seconds that jump press can increase
-	float curPressTime = 0.0f;
-	glm::vec3 curV0 = glm::vec3(0.0f); //Derived from above, used for velocity from jump, not object velocity
-	glm::vec3 curVelocity = glm::vec3(0.0f); //Current velocity, used for motion
 	float gAcc = 9.81f; //9.81 m/s^2
-	bool grounded = true;
 	float jumpFactor = 45.0f;//How much 1 second of jump adds to velocity (holding space)
-	float curJumpTime = 0.0f;//Similar to press variables but for total time in air
-	bool canJump = false; //controlled by beat
-	bool jumpLock = false; //Avoids double jumps
-	bool walled = false; //If colliding with a wall;
-	float timer = 0;
 	float endTime = 80.f;
-	bool winBool = false;
-	bool jumped = false; //Has a jump occured
-	size_t score = 0;
+
+	//Everything gameplay changes from frame to frame (plain old data, so it can be snapshotted):
+	struct GameState {
+		float curPressTime = 0.0f;
+		glm::vec3 curV0 = glm::vec3(0.0f); //Derived from above, used for velocity from jump, not object velocity
+		glm::vec3 curVelocity = glm::vec3(0.0f); //Current velocity, used for motion
+		bool grounded = true;
+		float curJumpTime = 0.0f;//Similar to press variables but for total time in air
+		bool canJump = false; //controlled by beat
+		bool jumpLock = false; //Avoids double jumps
+		bool walled = false; //If colliding with a wall;
+		float timer = 0;
+		bool winBool = false;
+		bool jumped = false; //Has a jump occured
+		size_t score = 0;
+		uint32_t musicSample = 0; //bg_loop's playback position (canJump and the beat are derived from it)
+	} state;
+
+	//Snapshots of 'state' and of the transforms owned by 'scene' (player, camera, gems):
+	static constexpr uint32_t HistoryFrames = 600; //about ten seconds at 60fps
+	SnapshotRing< GameState > history; //last HistoryFrames frames, for rewinding
+	SnapshotRing< GameState > start; //the first frame, for resetting
 
 	bool badSpace = false;// Player tries to jump during off-beat
 
 	void resetGame();
+	void restoreMusic(); //seek bg_loop to state.musicSample (after restoring a snapshot)
 
 	void songUpdate();
 
@@ -81,7 +92,20 @@ struct PlayMode : Mode {
 
 	//Meshes:
 	bool bboxIntersect(BBoxStruct object, BBoxStruct stationary); //Intersect bboxes and return true if collision
-	Collision bboxCollide(Scene::Transform* object, Scene::Transform* stationary);
+
+	//Collision, against the triangles of the platform and gem meshes (see CollisionMesh.hpp):
+	// the player is an upright capsule fit to its world-space bounds
+	CollisionMesh const *platformCollision[26];
+	CollisionMesh const *gemCollision[3];
+	struct Capsule {
+		glm::vec3 a, b; //ends of the center segment
+		float radius;
+	};
+	Capsule playerCapsule();
+	//first platform the player touches moving by 'displacement' (false if none):
+	bool sweepPlatforms(glm::vec3 const &displacement, CollisionMesh::Hit *hit);
+	//move the player by 'displacement', sliding along the platforms it runs into (and landing on them):
+	void movePlayer(glm::vec3 const &displacement);
 
 	//Shader
 	float beatT = 0.0f;
@@ -1,11 +1,23 @@
 #include "Scene.hpp"
 
+#include "FrameUniforms.hpp"
+#include "ColorProgram.hpp"
 #include "gl_errors.hpp"
 #include "read_write_chunk.hpp"
+#include "MappedFile.hpp"
+#include "SceneFile.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
-#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <istream>
+#include <mutex>
+#include <thread>
+#include <tuple>
 
 //-------------------------
 
@@ -87,93 +99,654 @@ void Scene::draw(Camera const &camera) const {
 	draw(world_to_clip, world_to_light);
 }
 
-void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+namespace {
+	//Small persistent pool of worker threads used to build draw commands in parallel.
+	// parallel_for() hands out [begin,end) chunks to the workers *and* the calling thread,
+	// and returns once every chunk has been processed.
+	struct DrawWorkers {
+		DrawWorkers() {
+			uint32_t count = std::max(1U, std::thread::hardware_concurrency()) - 1; //calling thread also works
+			for (uint32_t i = 0; i < count; ++i) {
+				threads.emplace_back([this](){ work(); });
+			}
+		}
+		~DrawWorkers() {
+			{
+				std::unique_lock< std::mutex > lock(mutex);
+				quit = true;
+			}
+			start_cv.notify_all();
+			for (auto &thread : threads) thread.join();
+		}
 
-	//Iterate through all drawables, sending each one to OpenGL:
-	for (auto const &drawable : drawables) {
-		//Reference to drawable's pipeline for convenience:
+		void parallel_for(size_t count, size_t chunk, std::function< void(size_t, size_t) > const &fn) {
+			if (threads.empty() || count <= chunk) {
+				fn(0, count);
+				return;
+			}
+			{
+				std::unique_lock< std::mutex > lock(mutex);
+				job = &fn;
+				job_count = count;
+				job_chunk = chunk;
+				next = 0;
+				active = uint32_t(threads.size());
+				generation += 1;
+			}
+			start_cv.notify_all();
+			run_chunks();
+			std::unique_lock< std::mutex > lock(mutex);
+			done_cv.wait(lock, [this](){ return active == 0; });
+			job = nullptr;
+		}
+
+	private:
+		void work() {
+			uint64_t seen = 0;
+			while (true) {
+				{
+					std::unique_lock< std::mutex > lock(mutex);
+					start_cv.wait(lock, [&](){ return quit || generation != seen; });
+					if (quit) return;
+					seen = generation;
+				}
+				run_chunks();
+				{
+					std::unique_lock< std::mutex > lock(mutex);
+					active -= 1;
+					if (active == 0) done_cv.notify_one();
+				}
+			}
+		}
+
+		void run_chunks() {
+			while (true) {
+				size_t begin = next.fetch_add(job_chunk);
+				if (begin >= job_count) break;
+				(*job)(begin, std::min(begin + job_chunk, job_count));
+			}
+		}
+
+		std::vector< std::thread > threads;
+		std::mutex mutex;
+		std::condition_variable start_cv;
+		std::condition_variable done_cv;
+		bool quit = false;
+		uint64_t generation = 0;
+		uint32_t active = 0;
+
+		//current job:
+		std::function< void(size_t, size_t) > const *job = nullptr;
+		size_t job_count = 0;
+		size_t job_chunk = 1;
+		std::atomic< size_t > next{0};
+	};
+
+	//command buffer entry, filled in by the workers and read by the GL thread:
+	struct DrawCommand {
+		Scene::Drawable const *drawable;
+		Scene::Instance instance;
+		GLuint start, count; //vertex (or index) range of the chosen level of detail
+		bool culled;
+		bool queryable; //has bounds which don't cross the near plane, so can be occlusion tested
+		bool clustered; //draws state->visible_ranges rather than [start,count)
+		Scene::DrawState *state; //(for drawables with levels of detail or clusters; otherwise nullptr)
+	};
+
+	//commands with equal state keys share all pipeline state except the range they draw:
+	auto state_key(DrawCommand const &command) {
+		Scene::Drawable const &drawable = *command.drawable;
 		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+		return std::make_tuple(
+			pipeline.program, pipeline.instanced.program, pipeline.vao, drawable.material,
+			pipeline.type, pipeline.indexed,
+			pipeline.textures[0].texture, pipeline.textures[1].texture, pipeline.textures[2].texture, pipeline.textures[3].texture
+		);
+	}
+	//...and commands with equal batch keys draw the same range too, so they can be drawn with a single instanced call:
+	auto batch_key(DrawCommand const &command) {
+		//(range last, so that runs which differ only in range -- candidates for glMultiDraw* -- are adjacent too)
+		return std::tuple_cat(state_key(command), std::make_tuple(command.start, command.count));
+	}
+
+	//OBJECT_TO_WORLD for a pipeline, given its transform's local-to-world matrix:
+	// quantized positions are fractions of the way across the bounds, so map that range back first.
+	// (NORMAL_TO_WORLD doesn't change, since normals aren't quantized to the bounds)
+	glm::mat4x3 object_to_world(Scene::Drawable::Pipeline const &pipeline, glm::mat4x3 const &local_to_world) {
+		if (!pipeline.quantized) return local_to_world;
+		glm::vec3 size = pipeline.max - pipeline.min;
+		return glm::mat4x3(
+			local_to_world[0] * size.x,
+			local_to_world[1] * size.y,
+			local_to_world[2] * size.z,
+			local_to_world * glm::vec4(pipeline.min, 1.0f)
+		);
+	}
+
+	//fill *ranges_ with (start, count) pairs of the index ranges of clusters that might be visible:
+	// (clusters that are next to each other in the index buffer share a range)
+	// 'mirrored' says the object-to-world transform flips handedness (negative determinant), which reverses
+	// every triangle's winding -- and so which side of it is the front.
+	void cull_clusters(glm::mat4 const &object_to_clip, bool mirrored, TriangleCluster const *clusters, uint32_t cluster_count, bool backfaces, std::vector< GLuint > *ranges_) {
+		assert(ranges_);
+		auto &ranges = *ranges_;
+		ranges.clear();
+
+		//clip planes in object space (p is inside plane k when dot(planes[k], vec4(p, 1)) >= 0):
+		glm::vec4 row[4];
+		for (uint32_t r = 0; r < 4; ++r) {
+			row[r] = glm::vec4(object_to_clip[0][r], object_to_clip[1][r], object_to_clip[2][r], object_to_clip[3][r]);
+		}
+		glm::vec4 const planes[6] = {
+			row[3] + row[0], row[3] - row[0],
+			row[3] + row[1], row[3] - row[1],
+			row[3] + row[2], row[3] - row[2],
+		};
+		float plane_length[6];
+		for (uint32_t k = 0; k < 6; ++k) {
+			plane_length[k] = glm::length(glm::vec3(planes[k]));
+		}
+
+		//the camera, in object space, is where clip x, y, and w are all zero:
+		// (for orthographic projections there's no such point, so clusters are never backface culled)
+		glm::mat3 xyw = glm::transpose(glm::mat3(glm::vec3(row[0]), glm::vec3(row[1]), glm::vec3(row[3])));
+		bool have_eye = backfaces && std::abs(glm::determinant(xyw)) > 1e-12f;
+		glm::vec3 eye = glm::vec3(0.0f);
+		if (have_eye) eye = glm::inverse(xyw) * -glm::vec3(row[0].w, row[1].w, row[3].w);
+		float const facing = (mirrored ? -1.0f : 1.0f); //(flips the cone axes of mirrored instances)
+
+		for (uint32_t c = 0; c < cluster_count; ++c) {
+			TriangleCluster const &cluster = clusters[c];
+
+			bool visible = true;
+			for (uint32_t k = 0; k < 6; ++k) {
+				if (glm::dot(glm::vec3(planes[k]), cluster.center) + planes[k].w < -cluster.radius * plane_length[k]) {
+					visible = false;
+					break;
+				}
+			}
 
+			//a triangle faces away when its normal points along the view ray; that holds for every point in the
+			// cluster's sphere and every normal in its cone when the ray to the center is close enough to the axis:
+			// (the sign of dot(normal, ray) is kept by any invertible affine transform -- normals transform by the
+			//  inverse transpose -- so the test works in object space; but a mirroring transform also reverses the
+			//  winding GL uses to pick the front face, so then the faces pointing *toward* the eye are the back faces)
+			if (visible && have_eye && cluster.cone_cutoff < 1.0f) {
+				glm::vec3 to_center = cluster.center - eye;
+				float distance = glm::length(to_center);
+				if (facing * glm::dot(to_center, cluster.cone_axis) >= cluster.cone_cutoff * distance + cluster.radius * (1.0f + cluster.cone_cutoff)) {
+					visible = false;
+				}
+			}
+
+			if (!visible) continue;
+			if (!ranges.empty() && ranges[ranges.size()-2] + ranges.back() == cluster.start) {
+				ranges.back() += cluster.count;
+			} else {
+				ranges.emplace_back(cluster.start);
+				ranges.emplace_back(cluster.count);
+			}
+		}
+	}
+
+	//with fewer drawables than this, building the command buffer isn't worth waking the workers:
+	constexpr size_t ParallelDrawChunk = 256;
+}
+
+//vertex array with a unit box ([0,1]^3, 36 vertices, outward-facing triangles) for occlusion queries:
+static GLuint occlusion_box_vao() {
+	static GLuint vao = 0;
+	if (vao == 0) {
+		std::vector< glm::vec3 > corners;
+		for (uint32_t c = 0; c < 8; ++c) {
+			corners.emplace_back(float(c & 1), float((c >> 1) & 1), float((c >> 2) & 1));
+		}
+		//faces as counter-clockwise (seen from outside) quads of corner indices:
+		static uint8_t const faces[6][4] = {
+			{0,4,6,2}, {1,3,7,5}, //-x, +x
+			{0,1,5,4}, {2,6,7,3}, //-y, +y
+			{0,2,3,1}, {4,5,7,6}, //-z, +z
+		};
+		std::vector< glm::vec3 > positions;
+		for (auto const &f : faces) {
+			for (uint32_t i : { 0, 1, 2, 0, 2, 3 }) {
+				positions.emplace_back(corners[f[i]]);
+			}
+		}
+		assert(positions.size() == 36);
+
+		GLuint buffer = 0;
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), positions.data(), GL_STATIC_DRAW);
+
+		glGenVertexArrays(1, &vao);
+		glBindVertexArray(vao);
+		glVertexAttribPointer(color_program->Position_vec4, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLbyte *)0);
+		glEnableVertexAttribArray(color_program->Position_vec4);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	return vao;
+}
+
+void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+
+	//Camera state is shared by all programs, so it is uploaded once per draw:
+	frame_uniforms->set_camera(world_to_clip, world_to_light);
+
+	//--- phase 1: build a flat command buffer (matrices + culling), in parallel ---
+
+	//Gather the drawables that might be drawn:
+	std::vector< DrawCommand > commands;
+	commands.reserve(drawables.size() + (base ? base->drawables.size() : 0));
+	auto gather = [this, &commands](Drawable const &drawable) {
 		//skip any drawables without a shader program set:
-		if (pipeline.program == 0) continue;
+		if (drawable.pipeline.program == 0) return;
 		//skip any drawables that don't reference any vertex array:
-		if (pipeline.vao == 0) continue;
+		if (drawable.pipeline.vao == 0) return;
 		//skip any drawables that don't contain any vertices:
-		if (pipeline.count == 0) continue;
-
-		if (!drawable.transform->doDraw) continue;
+		if (drawable.pipeline.count == 0) return;
 
-		//Set shader program:
-		glUseProgram(pipeline.program);
+		assert(drawable.transform); //drawables *must* have a transform
+		if (!drawable.transform->doDraw) return;
 
-		//Set attribute sources:
-		glBindVertexArray(pipeline.vao);
+		commands.emplace_back();
+		commands.back().drawable = &drawable;
+		//(state is looked up here, since workers can't add entries to draw_states)
+		bool stateful = (drawable.pipeline.lods.count != 0 || drawable.pipeline.cluster_count != 0);
+		commands.back().state = (stateful ? &draw_states[&drawable] : nullptr);
+	};
+	if (base) {
+		//base drawables attached to overridden transforms have local copies, so skip them:
+		for (auto const &drawable : base->drawables) {
+			if (overrides.count(drawable.transform)) continue;
+			gather(drawable);
+		}
+	}
+	for (auto const &drawable : drawables) {
+		gather(drawable);
+	}
 
-		//Configure program uniforms:
+	//for level of detail: world-space length -> fraction of half the viewport height, once divided by clip w
+	// (for a perspective camera, this is the length of the y row of world_to_clip's rotation part):
+	float const lod_scale = glm::length(glm::vec3(world_to_clip[0][1], world_to_clip[1][1], world_to_clip[2][1]));
+
+	//Compute matrices, cull against the view frustum, and pick levels of detail (pure CPU work -- no GL calls allowed here):
+	auto build_commands = [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			DrawCommand &command = commands[i];
+			Drawable const &drawable = *command.drawable;
+
+			//OBJECT_TO_WORLD takes vertices from object space to world space:
+			command.instance.OBJECT_TO_WORLD = drawable.transform->make_local_to_world();
+
+			//NORMAL_TO_WORLD takes normals from object space to world space:
+			command.instance.NORMAL_TO_WORLD = glm::inverse(glm::transpose(glm::mat3(command.instance.OBJECT_TO_WORLD)));
+
+			//cull if all corners of the bounding box are outside the same clip plane:
+			// (drawables with an empty box have unknown bounds and are never culled)
+			command.culled = false;
+			command.queryable = false;
+			command.clustered = false;
+			glm::vec3 const &min = drawable.pipeline.min;
+			glm::vec3 const &max = drawable.pipeline.max;
+			if (min.x <= max.x && min.y <= max.y && min.z <= max.z) {
+				glm::mat4 object_to_clip = world_to_clip * glm::mat4(command.instance.OBJECT_TO_WORLD);
+				uint32_t outside_all = 0x3f; //bit per plane: -x, +x, -y, +y, -z, +z
+				uint32_t outside_any = 0;
+				for (uint32_t c = 0; c < 8; ++c) {
+					glm::vec4 clip = object_to_clip * glm::vec4(
+						(c & 1 ? max.x : min.x),
+						(c & 2 ? max.y : min.y),
+						(c & 4 ? max.z : min.z),
+						1.0f
+					);
+					uint32_t outside = 0;
+					if (clip.x < -clip.w) outside |= 0x01;
+					if (clip.x >  clip.w) outside |= 0x02;
+					if (clip.y < -clip.w) outside |= 0x04;
+					if (clip.y >  clip.w) outside |= 0x08;
+					if (clip.z < -clip.w) outside |= 0x10;
+					if (clip.z >  clip.w) outside |= 0x20;
+					outside_all &= outside;
+					outside_any |= outside;
+				}
+				command.culled = (outside_all != 0);
+				command.queryable = !(outside_any & 0x10);
+			}
 
-		//the object-to-world matrix is used in all three of these uniforms:
-		assert(drawable.transform); //drawables *must* have a transform
-		glm::mat4x3 object_to_world = drawable.transform->make_local_to_world();
+			//pick a level of detail by the projected size of the bounding sphere:
+			command.start = drawable.pipeline.start;
+			command.count = drawable.pipeline.count;
+			MeshLODs const &lods = drawable.pipeline.lods;
+			if (lods.count != 0 && !command.culled && min.x <= max.x && min.y <= max.y && min.z <= max.z) {
+				glm::mat4x3 const &to_world = command.instance.OBJECT_TO_WORLD;
+				glm::vec3 center = to_world * glm::vec4(0.5f * (min + max), 1.0f);
+				float scale = std::max(glm::length(to_world[0]), std::max(glm::length(to_world[1]), glm::length(to_world[2])));
+				float radius = 0.5f * glm::length(max - min) * scale;
+				float w = (world_to_clip * glm::vec4(center, 1.0f)).w;
+
+				uint32_t level = std::min< uint32_t >(command.state->lod, lods.count);
+				if (w > radius) {
+					float size = radius * lod_scale / w;
+					while (level < lods.count && size < lod_size * std::ldexp(1.0f, -int(level))) {
+						level += 1;
+					}
+					while (level > 0 && size > lod_size * std::ldexp(1.0f, -int(level - 1)) * lod_hysteresis) {
+						level -= 1;
+					}
+				} else {
+					level = 0; //camera is (nearly) inside the bounds
+				}
+				command.state->lod = uint8_t(level); //(each drawable has one command, so workers never share states)
+
+				if (level > 0) {
+					command.start = lods.levels[level - 1].start;
+					command.count = lods.levels[level - 1].count;
+				}
+			}
 
-		//OBJECT_TO_CLIP takes vertices from object space to clip space:
-		if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
-			glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
-			glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
+			//cull big meshes a cluster at a time (coarser levels of detail are small enough to draw whole):
+			if (cluster_culling && drawable.pipeline.cluster_count != 0 && !command.culled && command.start == drawable.pipeline.start) {
+				std::vector< GLuint > &ranges = command.state->visible_ranges;
+				bool mirrored = (glm::determinant(glm::mat3(command.instance.OBJECT_TO_WORLD)) < 0.0f);
+				cull_clusters(world_to_clip * glm::mat4(command.instance.OBJECT_TO_WORLD), mirrored, drawable.pipeline.clusters, drawable.pipeline.cluster_count, cluster_backface_culling, &ranges);
+				if (ranges.empty()) {
+					command.culled = true;
+				} else if (!(ranges.size() == 2 && ranges[0] == command.start && ranges[1] == command.count)) {
+					command.clustered = true;
+				}
+			}
 		}
+	};
+	if (commands.size() > ParallelDrawChunk) {
+		static DrawWorkers workers;
+		workers.parallel_for(commands.size(), ParallelDrawChunk, build_commands);
+	} else {
+		build_commands(0, commands.size());
+	}
 
-		//the object-to-light matrix is used in the next two uniforms:
-		glm::mat4x3 object_to_light = world_to_light * glm::mat4(object_to_world);
+	//Drop culled commands:
+	commands.erase(std::remove_if(commands.begin(), commands.end(), [](DrawCommand const &command){
+		return command.culled;
+	}), commands.end());
+
+	//Skip drawables whose box was hidden when last tested:
+	occlusion_stats = OcclusionStats();
+	std::vector< DrawCommand > hidden;
+	if (occlusion_culling) {
+		for (auto const &command : commands) {
+			if (!command.queryable) continue;
+			OcclusionQuery &q = occlusion_queries[command.drawable];
+			if (q.pending) {
+				//read the result only if it is ready (never wait on the GPU):
+				GLuint available = GL_FALSE;
+				glGetQueryObjectuiv(q.query, GL_QUERY_RESULT_AVAILABLE, &available);
+				if (available) {
+					GLuint any = GL_TRUE;
+					glGetQueryObjectuiv(q.query, GL_QUERY_RESULT, &any);
+					q.visible = (any != GL_FALSE);
+					q.pending = false;
+					occlusion_stats.results += 1;
+				}
+			}
+			if (!q.visible) hidden.emplace_back(command);
+		}
+		if (!hidden.empty()) {
+			commands.erase(std::remove_if(commands.begin(), commands.end(), [this](DrawCommand const &command){
+				if (!command.queryable) return false;
+				return !occlusion_queries[command.drawable].visible;
+			}), commands.end());
+		}
+		occlusion_stats.culled = uint32_t(hidden.size());
+	}
 
-		//OBJECT_TO_CLIP takes vertices from object space to light space:
-		if (pipeline.OBJECT_TO_LIGHT_mat4x3 != -1U) {
-			glUniformMatrix4x3fv(pipeline.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(object_to_light));
+	//Sort so that drawables which can share a draw call are adjacent:
+	// (stable, so that the original order is otherwise kept)
+	std::stable_sort(commands.begin(), commands.end(), [](DrawCommand const &a, DrawCommand const &b) {
+		return batch_key(a) < batch_key(b);
+	});
+
+	//--- phase 2: walk the command buffer, issuing only GL calls ---
+
+	//Track bound program + material so that uniforms shared by many drawables are only uploaded when they change:
+	GLuint current_program = 0;
+	int current_material = -1;
+	auto use_program = [&](GLuint program, GLuint t_float, GLuint TEX_sampler2D, Drawable::Material material) {
+		if (program != current_program) {
+			glUseProgram(program);
+			current_program = program;
+			current_material = -1; //uniform values are per-program, so material must be re-sent
 		}
+		if (int(material) != current_material) {
+			current_material = int(material);
+			if (t_float != -1U) {
+				glUniform1f(t_float, (material == Drawable::Beat ? t : 0.0f));
+			}
+			if (TEX_sampler2D != -1U) {
+				glUniform1i(TEX_sampler2D, (material == Drawable::Beat ? 1 : 0));
+			}
+		}
+	};
 
-		//NORMAL_TO_CLIP takes normals from object space to light space:
-		if (pipeline.NORMAL_TO_LIGHT_mat3 != -1U) {
-			glm::mat3 normal_to_light = glm::inverse(glm::transpose(glm::mat3(object_to_light)));
-			glUniformMatrix3fv(pipeline.NORMAL_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(normal_to_light));
+	//...and likewise the vertex array and textures (meshes from a MeshArena all share one vao per program, so runs often continue across meshes):
+	GLuint current_vao = 0;
+	auto use_vao = [&](GLuint vao) {
+		if (vao != current_vao) {
+			glBindVertexArray(vao);
+			current_vao = vao;
 		}
+	};
 
-		//set any requested custom uniforms:
-		if (pipeline.set_uniforms) pipeline.set_uniforms();
+	Drawable::Pipeline::TextureInfo bound_textures[Drawable::Pipeline::TextureCount];
+	auto set_texture = [&](uint32_t i, Drawable::Pipeline::TextureInfo const &info) {
+		Drawable::Pipeline::TextureInfo &bound = bound_textures[i];
+		if (bound.texture == info.texture && (info.texture == 0 || bound.target == info.target)) return;
+		glActiveTexture(GL_TEXTURE0 + i);
+		if (bound.texture != 0 && (info.texture == 0 || bound.target != info.target)) {
+			glBindTexture(bound.target, 0);
+		}
+		if (info.texture != 0) {
+			glBindTexture(info.target, info.texture);
+		}
+		bound = info;
+	};
 
-		//set up textures:
+	auto bind_textures = [&](Drawable::Pipeline const &pipeline) {
 		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, pipeline.textures[i].texture);
+			set_texture(i, pipeline.textures[i]);
+		}
+		glActiveTexture(GL_TEXTURE0);
+	};
+
+	//end of the run of drawables starting at 'begin' that can be drawn with one instanced call:
+	// (drawables with custom uniforms or culled clusters are always drawn alone)
+	auto instanced_run_end = [&](size_t begin) {
+		size_t end = begin + 1;
+		Drawable::Pipeline const &pipeline = commands[begin].drawable->pipeline;
+		if (pipeline.instanced.program != 0 && !pipeline.set_uniforms && !commands[begin].clustered) {
+			auto key = batch_key(commands[begin]);
+			while (end < commands.size()
+				&& !commands[end].drawable->pipeline.set_uniforms
+				&& !commands[end].clustered
+				&& batch_key(commands[end]) == key) {
+				++end;
 			}
 		}
+		return end;
+	};
 
+	//Walk runs of drawables that share pipeline state, sending each run to OpenGL:
+	std::vector< Instance > instances;
+	std::vector< GLsizei > multi_counts;
+	std::vector< GLint > multi_firsts;
+	std::vector< void const * > multi_offsets;
+	for (size_t begin = 0; begin < commands.size(); /* later */) {
+		Drawable const &first = *commands[begin].drawable;
+		//Reference to drawable's pipeline for convenience:
+		Scene::Drawable::Pipeline const &pipeline = first.pipeline;
 
-		if (drawable.transform->name == std::string("Player") || drawable.transform->name
-			== std::string("Goal") || (drawable.transform->name.size() > 3
-				&& drawable.transform->name.substr(0, 3) == std::string("Gem"))) { //Only change platform color
-			glUniform1f(glGetUniformLocation(pipeline.program, "t"), 0.0);
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(pipeline.textures[0].target, pipeline.textures[0].texture);
-			glUniform1i(glGetUniformLocation(pipeline.program, "TEX"), 0);
-		}
-		else {
-			glUniform1f(glGetUniformLocation(pipeline.program, "t"), t);
-			glActiveTexture(GL_TEXTURE1);
-			glBindTexture(pipeline.textures[1].target, pipeline.textures[1].texture);
-			glUniform1i(glGetUniformLocation(pipeline.program, "TEX"), 1);
-		}
+		size_t end = instanced_run_end(begin);
 
-		//draw the object:
-		glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
+		if (end - begin > 1) {
+			//--- draw the whole run with one instanced call ---
+			use_program(pipeline.instanced.program, pipeline.instanced.t_float, pipeline.instanced.TEX_sampler2D, first.material);
 
-		//un-bind textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, 0);
+			//stream per-instance matrices:
+			instances.clear();
+			for (size_t i = begin; i < end; ++i) {
+				instances.emplace_back(commands[i].instance);
+				instances.back().OBJECT_TO_WORLD = object_to_world(commands[i].drawable->pipeline, commands[i].instance.OBJECT_TO_WORLD);
+			}
+			glBindBuffer(GL_ARRAY_BUFFER, instance_buffer());
+			glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(Instance), instances.data(), GL_STREAM_DRAW);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+			//Set attribute sources (mesh + per-instance):
+			use_vao(pipeline.instanced.vao);
+
+			bind_textures(pipeline);
+
+			//draw all of the objects:
+			if (pipeline.indexed) {
+				glDrawElementsInstanced(pipeline.type, commands[begin].count, GL_UNSIGNED_INT, (GLbyte *)0 + commands[begin].start * sizeof(GLuint), GLsizei(instances.size()));
+			} else {
+				glDrawArraysInstanced(pipeline.type, commands[begin].start, commands[begin].count, GLsizei(instances.size()));
+			}
+		} else {
+			//--- draw a single drawable ---
+			use_program(pipeline.program, pipeline.t_float, pipeline.TEX_sampler2D, first.material);
+
+			//Set attribute sources:
+			use_vao(pipeline.vao);
+
+			//Configure program uniforms:
+			Instance const &instance = commands[begin].instance;
+			glm::mat4x3 to_world = object_to_world(pipeline, instance.OBJECT_TO_WORLD);
+			if (pipeline.OBJECT_TO_WORLD_mat4x3 != -1U) {
+				glUniformMatrix4x3fv(pipeline.OBJECT_TO_WORLD_mat4x3, 1, GL_FALSE, glm::value_ptr(to_world));
+			}
+			if (pipeline.NORMAL_TO_WORLD_mat3 != -1U) {
+				glUniformMatrix3fv(pipeline.NORMAL_TO_WORLD_mat3, 1, GL_FALSE, glm::value_ptr(instance.NORMAL_TO_WORLD));
+			}
+
+			//set any requested custom uniforms:
+			if (pipeline.set_uniforms) pipeline.set_uniforms();
+
+			bind_textures(pipeline);
+
+			//following drawables that differ only in which range they draw can go in the same call:
+			// (since OpenGL 3.3 has no way for a shader to tell the draws of a glMultiDraw* call apart,
+			//  that takes the same uniforms -- e.g., meshes sharing a transform, or uniforms that don't use it)
+			if (!pipeline.set_uniforms && !commands[begin].clustered) {
+				auto key = state_key(commands[begin]);
+				while (end < commands.size()) {
+					DrawCommand const &next = commands[end];
+					Drawable::Pipeline const &next_pipeline = next.drawable->pipeline;
+					if (next_pipeline.set_uniforms || next.clustered || state_key(next) != key) break;
+					if (pipeline.OBJECT_TO_WORLD_mat4x3 != -1U && object_to_world(next_pipeline, next.instance.OBJECT_TO_WORLD) != to_world) break;
+					if (pipeline.NORMAL_TO_WORLD_mat3 != -1U && next.instance.NORMAL_TO_WORLD != instance.NORMAL_TO_WORLD) break;
+					if (instanced_run_end(end) != end + 1) break; //(leave instanceable runs to be instanced)
+					++end;
+				}
+			}
+
+			//draw the object(s):
+			if (commands[begin].clustered) {
+				//just the visible clusters:
+				std::vector< GLuint > const &ranges = commands[begin].state->visible_ranges;
+				multi_counts.clear();
+				multi_firsts.clear();
+				multi_offsets.clear();
+				for (size_t r = 0; r + 1 < ranges.size(); r += 2) {
+					multi_counts.emplace_back(GLsizei(ranges[r+1]));
+					multi_firsts.emplace_back(GLint(ranges[r]));
+					multi_offsets.emplace_back((GLbyte *)0 + ranges[r] * sizeof(GLuint));
+				}
+				if (pipeline.indexed) {
+					glMultiDrawElements(pipeline.type, multi_counts.data(), GL_UNSIGNED_INT, multi_offsets.data(), GLsizei(multi_counts.size()));
+				} else {
+					glMultiDrawArrays(pipeline.type, multi_firsts.data(), multi_counts.data(), GLsizei(multi_counts.size()));
+				}
+			} else if (end - begin == 1) {
+				if (pipeline.indexed) {
+					glDrawElements(pipeline.type, commands[begin].count, GL_UNSIGNED_INT, (GLbyte *)0 + commands[begin].start * sizeof(GLuint));
+				} else {
+					glDrawArrays(pipeline.type, commands[begin].start, commands[begin].count);
+				}
+			} else {
+				multi_counts.clear();
+				multi_firsts.clear();
+				multi_offsets.clear();
+				for (size_t i = begin; i < end; ++i) {
+					multi_counts.emplace_back(GLsizei(commands[i].count));
+					multi_firsts.emplace_back(GLint(commands[i].start));
+					multi_offsets.emplace_back((GLbyte *)0 + commands[i].start * sizeof(GLuint));
+				}
+				if (pipeline.indexed) {
+					glMultiDrawElements(pipeline.type, multi_counts.data(), GL_UNSIGNED_INT, multi_offsets.data(), GLsizei(multi_counts.size()));
+				} else {
+					glMultiDrawArrays(pipeline.type, multi_firsts.data(), multi_counts.data(), GLsizei(multi_counts.size()));
+				}
 			}
 		}
-		glActiveTexture(GL_TEXTURE0);
 
+		begin = end;
+	}
+
+	//leave texture units as they were found:
+	for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+		set_texture(i, Drawable::Pipeline::TextureInfo());
+	}
+	glActiveTexture(GL_TEXTURE0);
+
+	//Test boxes against this frame's depth buffer (results are used by later frames):
+	if (occlusion_culling) {
+		GLint depth_func = GL_LESS;
+		glGetIntegerv(GL_DEPTH_FUNC, &depth_func);
+		glDepthFunc(GL_LEQUAL); //(boxes of flat objects coincide with their faces)
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		glDepthMask(GL_FALSE);
+		glUseProgram(color_program->program);
+		glBindVertexArray(occlusion_box_vao());
+
+		auto issue = [&](DrawCommand const &command) {
+			if (!command.queryable) return;
+			OcclusionQuery &q = occlusion_queries[command.drawable];
+			if (q.pending) return; //(previous result hasn't arrived yet)
+			if (q.query == 0) glGenQueries(1, &q.query);
+
+			//unit box -> (slightly padded) object-space bounds:
+			glm::vec3 const &min = command.drawable->pipeline.min;
+			glm::vec3 const &max = command.drawable->pipeline.max;
+			glm::vec3 pad = 0.01f * (max - min) + glm::vec3(0.001f);
+			glm::vec3 size = max - min + 2.0f * pad;
+			glm::mat4 box_to_object(
+				size.x, 0.0f, 0.0f, 0.0f,
+				0.0f, size.y, 0.0f, 0.0f,
+				0.0f, 0.0f, size.z, 0.0f,
+				min.x - pad.x, min.y - pad.y, min.z - pad.z, 1.0f
+			);
+			glm::mat4 object_to_clip = world_to_clip * glm::mat4(command.instance.OBJECT_TO_WORLD) * box_to_object;
+			glUniformMatrix4fv(color_program->OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
+
+			glBeginQuery(GL_ANY_SAMPLES_PASSED, q.query);
+			glDrawArrays(GL_TRIANGLES, 0, 36);
+			glEndQuery(GL_ANY_SAMPLES_PASSED);
+			q.pending = true;
+			occlusion_stats.issued += 1;
+		};
+		for (auto const &command : commands) {
+			issue(command);
+		}
+		for (auto const &command : hidden) {
+			issue(command);
+		}
+
+		glDepthMask(GL_TRUE);
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		glDepthFunc(GLenum(depth_func));
 	}
 
 	glUseProgram(0);
@@ -182,68 +755,62 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 	GL_ERRORS();
 }
 
+void Scene::clear_occlusion_queries() {
+	for (auto const &entry : occlusion_queries) {
+		if (entry.second.query != 0) glDeleteQueries(1, &entry.second.query);
+	}
+	occlusion_queries.clear();
+}
 
-void Scene::load(std::string const &filename,
-	std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable) {
+GLuint Scene::instance_buffer() {
+	static GLuint buffer = 0;
+	if (buffer == 0) {
+		glGenBuffers(1, &buffer);
+		//for now, buffer will be un-filled; Scene::draw streams into it.
+	}
+	return buffer;
+}
 
-	std::ifstream file(filename, std::ios::binary);
+void Scene::bind_instance_attributes(GLuint program, std::set< GLuint > *bound) {
+	glBindBuffer(GL_ARRAY_BUFFER, instance_buffer());
+
+	//matrix attributes occupy one location per column:
+	auto bind_matrix = [&](char const *name, GLuint columns, GLint rows, size_t offset) {
+		GLint location = glGetAttribLocation(program, name);
+		if (location == -1) return; //can't bind missing attribs
+		for (GLuint c = 0; c < columns; ++c) {
+			glVertexAttribPointer(location + c, rows, GL_FLOAT, GL_FALSE, sizeof(Instance), (GLbyte *)0 + offset + c * rows * sizeof(float));
+			glEnableVertexAttribArray(location + c);
+			glVertexAttribDivisor(location + c, 1); //advance once per instance, not per vertex
+		}
+		if (bound) bound->insert(GLuint(location));
+	};
+	bind_matrix("OBJECT_TO_WORLD", 4, 3, offsetof(Instance, OBJECT_TO_WORLD));
+	bind_matrix("NORMAL_TO_WORLD", 3, 3, offsetof(Instance, NORMAL_TO_WORLD));
 
-	std::vector< char > names;
-	read_chunk(file, "str0", &names);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-	struct HierarchyEntry {
-		uint32_t parent;
-		uint32_t name_begin;
-		uint32_t name_end;
-		glm::vec3 position;
-		glm::quat rotation;
-		glm::vec3 scale;
-	};
-	static_assert(sizeof(HierarchyEntry) == 4 + 4 + 4 + 4*3 + 4*4 + 4*3, "HierarchyEntry is packed.");
-	std::vector< HierarchyEntry > hierarchy;
-	read_chunk(file, "xfh0", &hierarchy);
-
-	struct MeshEntry {
-		uint32_t transform;
-		uint32_t name_begin;
-		uint32_t name_end;
-	};
-	static_assert(sizeof(MeshEntry) == 4 + 4 + 4, "MeshEntry is packed.");
-	std::vector< MeshEntry > meshes;
-	read_chunk(file, "msh0", &meshes);
-
-	struct CameraEntry {
-		uint32_t transform;
-		char type[4]; //"pers" or "orth"
-		float data; //fov in degrees for 'pers', scale for 'orth'
-		float clip_near, clip_far;
-	};
-	static_assert(sizeof(CameraEntry) == 4 + 4 + 4 + 4 + 4, "CameraEntry is packed.");
-	std::vector< CameraEntry > cameras;
-	read_chunk(file, "cam0", &cameras);
-
-	struct LightEntry {
-		uint32_t transform;
-		char type;
-		glm::u8vec3 color;
-		float energy;
-		float distance;
-		float fov;
-	};
-	static_assert(sizeof(LightEntry) == 4 + 1 + 3 + 4 + 4 + 4, "LightEntry is packed.");
-	std::vector< LightEntry > lights;
-	read_chunk(file, "lmp0", &lights);
 
+//read-only stream buffer over a range of memory (lets load_extra read from a mapped file without copying):
+struct MemoryStreambuf : std::streambuf {
+	MemoryStreambuf(char const *begin, char const *end) {
+		char *b = const_cast< char * >(begin); //(streambuf wants non-const pointers, but never writes through get area pointers)
+		setg(b, b, b + (end - begin));
+	}
+};
 
-	//--------------------------------
-	//Now that file is loaded, create transforms for hierarchy entries:
+//helpers shared by load() and load_baked():
+namespace {
 
-	std::vector< Transform * > hierarchy_transforms;
+//create transforms for hierarchy entries:
+std::vector< Scene::Transform * > make_hierarchy(Scene &scene, std::string const &filename, ChunkView< char > const &names, ChunkView< SceneFile::HierarchyEntry > const &hierarchy) {
+	std::vector< Scene::Transform * > hierarchy_transforms;
 	hierarchy_transforms.reserve(hierarchy.size());
 
 	for (auto const &h : hierarchy) {
-		transforms.emplace_back();
-		Transform *t = &transforms.back();
+		scene.transforms.emplace_back();
+		Scene::Transform *t = &scene.transforms.back();
 		if (h.parent != -1U) {
 			if (h.parent >= hierarchy_transforms.size()) {
 				throw std::runtime_error("scene file '" + filename + "' did not contain transforms in topological-sort order.");
@@ -252,7 +819,7 @@ void Scene::load(std::string const &filename,
 		}
 
 		if (h.name_begin <= h.name_end && h.name_end <= names.size()) {
-			t->name = std::string(names.begin() + h.name_begin, names.begin() + h.name_end);
+			t->name.assign(names.begin() + h.name_begin, h.name_end - h.name_begin);
 		} else {
 				throw std::runtime_error("scene file '" + filename + "' contains hierarchy entry with invalid name indices");
 		}
@@ -265,21 +832,10 @@ void Scene::load(std::string const &filename,
 	}
 	assert(hierarchy_transforms.size() == hierarchy.size());
 
-	for (auto const &m : meshes) {
-		if (m.transform >= hierarchy_transforms.size()) {
-			throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid transform index (" + std::to_string(m.transform) + ")");
-		}
-		if (!(m.name_begin <= m.name_end && m.name_end <= names.size())) {
-			throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid name indices");
-		}
-		std::string name = std::string(names.begin() + m.name_begin, names.begin() + m.name_end);
-
-		if (on_drawable) {
-			on_drawable(*this, hierarchy_transforms[m.transform], name);
-		}
-
-	}
+	return hierarchy_transforms;
+}
 
+void make_cameras(Scene &scene, std::string const &filename, ChunkView< SceneFile::CameraEntry > const &cameras, std::vector< Scene::Transform * > const &hierarchy_transforms) {
 	for (auto const &c : cameras) {
 		if (c.transform >= hierarchy_transforms.size()) {
 			throw std::runtime_error("scene file '" + filename + "' contains camera entry with invalid transform index (" + std::to_string(c.transform) + ")");
@@ -288,13 +844,15 @@ void Scene::load(std::string const &filename,
 			std::cout << "Ignoring non-perspective camera (" + std::string(c.type, 4) + ") stored in file." << std::endl;
 			continue;
 		}
-		this->cameras.emplace_back(hierarchy_transforms[c.transform]);
-		Camera *camera = &this->cameras.back();
+		scene.cameras.emplace_back(hierarchy_transforms[c.transform]);
+		Scene::Camera *camera = &scene.cameras.back();
 		camera->fovy = c.data / 180.0f * 3.1415926f; //FOV is stored in degrees; convert to radians.
 		camera->near = c.clip_near;
 		//N.b. far plane is ignored because cameras use infinite perspective matrices.
 	}
+}
 
+void make_lights(Scene &scene, std::string const &filename, ChunkView< SceneFile::LightEntry > const &lights, std::vector< Scene::Transform * > const &hierarchy_transforms) {
 	for (auto const &l : lights) {
 		if (l.transform >= hierarchy_transforms.size()) {
 			throw std::runtime_error("scene file '" + filename + "' contains lamp entry with invalid transform index (" + std::to_string(l.transform) + ")");
@@ -311,22 +869,277 @@ void Scene::load(std::string const &filename,
 			std::cout << "Ignoring unrecognized lamp type (" + std::string(&l.type, 1) + ") stored in file." << std::endl;
 			continue;
 		}
-		this->lights.emplace_back(hierarchy_transforms[l.transform]);
-		Light *light = &this->lights.back();
-		light->type = static_cast<Light::Type>(l.type);
+		scene.lights.emplace_back(hierarchy_transforms[l.transform]);
+		Scene::Light *light = &scene.lights.back();
+		light->type = static_cast< Scene::Light::Type >(l.type);
 		light->energy = glm::vec3(l.color) / 255.0f * l.energy;
+		light->distance = l.distance;
 		light->spot_fov = l.fov / 180.0f * 3.1415926f; //FOV is stored in degrees; convert to radians.
 	}
+}
+
+
+//read a '.scene' file into 'scene'; 'make_drawables' handles the msh0 entries (checked to have valid indices):
+void load_scene(Scene &scene, std::string const &filename,
+	std::function< void(ChunkView< char > const &names, ChunkView< SceneFile::MeshEntry > const &meshes, std::vector< Scene::Transform * > const &hierarchy_transforms) > const &make_drawables) {
+
+	//map the file and parse chunks in place (the storage vectors are only used if a chunk is misaligned):
+	MappedFile file(filename);
+	char const *at = file.begin();
+
+	std::vector< char > names_storage;
+	ChunkView< char > names = read_chunk(at, file.end(), "str0", &names_storage);
+
+	std::vector< SceneFile::HierarchyEntry > hierarchy_storage;
+	ChunkView< SceneFile::HierarchyEntry > hierarchy = read_chunk(at, file.end(), "xfh0", &hierarchy_storage);
+
+	std::vector< SceneFile::MeshEntry > meshes_storage;
+	ChunkView< SceneFile::MeshEntry > meshes = read_chunk(at, file.end(), "msh0", &meshes_storage);
+
+	std::vector< SceneFile::CameraEntry > cameras_storage;
+	ChunkView< SceneFile::CameraEntry > cameras = read_chunk(at, file.end(), "cam0", &cameras_storage);
+
+	std::vector< SceneFile::LightEntry > lights_storage;
+	ChunkView< SceneFile::LightEntry > lights = read_chunk(at, file.end(), "lmp0", &lights_storage);
+
+
+	//--------------------------------
+	//Now that file is loaded, create transforms for hierarchy entries:
+
+	std::vector< Scene::Transform * > hierarchy_transforms = make_hierarchy(scene, filename, names, hierarchy);
+
+	for (auto const &m : meshes) {
+		if (m.transform >= hierarchy_transforms.size()) {
+			throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid transform index (" + std::to_string(m.transform) + ")");
+		}
+		if (!(m.name_begin <= m.name_end && m.name_end <= names.size())) {
+			throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid name indices");
+		}
+	}
+	make_drawables(names, meshes, hierarchy_transforms);
+
+	make_cameras(scene, filename, cameras, hierarchy_transforms);
+	make_lights(scene, filename, lights, hierarchy_transforms);
 
-	//load any extra that a subclass wants:
-	load_extra(file, names, hierarchy_transforms);
+	//load any extra that a subclass wants (from a stream over the rest of the mapping):
+	MemoryStreambuf rest(at, file.end());
+	std::istream rest_stream(&rest);
+	scene.load_extra(rest_stream, names, hierarchy_transforms);
 
-	if (file.peek() != EOF) {
+	if (rest_stream.peek() != EOF) {
 		std::cerr << "WARNING: trailing data in scene file '" << filename << "'" << std::endl;
 	}
 
+	scene.index_names();
+}
+
+}
+
+void Scene::load(std::string const &filename,
+	std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable) {
+
+	load_scene(*this, filename, [&](ChunkView< char > const &names, ChunkView< SceneFile::MeshEntry > const &meshes, std::vector< Transform * > const &hierarchy_transforms) {
+		if (!on_drawable) return;
+		for (auto const &m : meshes) {
+			std::string name(names.begin() + m.name_begin, m.name_end - m.name_begin);
+			on_drawable(*this, hierarchy_transforms[m.transform], name);
+		}
+	});
+}
+
+void Scene::load(std::string const &filename, MeshBuffer const &buffer,
+	std::function< void(Scene &, Drawable &) > const &on_drawable) {
 
+	load_scene(*this, filename, [&](ChunkView< char > const &names, ChunkView< SceneFile::MeshEntry > const &meshes, std::vector< Transform * > const &hierarchy_transforms) {
+		//resolve every mesh name in one go (as views into str0, so no strings are built):
+		std::vector< std::string_view > mesh_names;
+		mesh_names.reserve(meshes.size());
+		for (auto const &m : meshes) {
+			mesh_names.emplace_back(names.begin() + m.name_begin, m.name_end - m.name_begin);
+		}
+		std::vector< Mesh const * > found;
+		buffer.lookup_all(mesh_names, &found);
 
+		for (size_t i = 0; i < meshes.size(); ++i) {
+			if (!found[i]) {
+				throw std::runtime_error("scene file '" + filename + "' uses mesh '" + std::string(mesh_names[i]) + "', which doesn't exist.");
+			}
+			Mesh const &mesh = *found[i];
+
+			drawables.emplace_back(hierarchy_transforms[meshes[i].transform]);
+			Drawable &drawable = drawables.back();
+			drawable.pipeline.type = mesh.type;
+			drawable.pipeline.indexed = true;
+			drawable.pipeline.start = mesh.start;
+			drawable.pipeline.count = mesh.count;
+			drawable.pipeline.quantized = (buffer.layout == MeshBuffer::Compact);
+			drawable.pipeline.lods = mesh.lods;
+			drawable.pipeline.clusters = mesh.clusters;
+			drawable.pipeline.cluster_count = mesh.cluster_count;
+			drawable.pipeline.min = mesh.min;
+			drawable.pipeline.max = mesh.max;
+			drawable.collision = mesh.collision;
+
+			if (on_drawable) on_drawable(*this, drawable);
+		}
+	});
+}
+
+void Scene::load_baked(std::string const &filename, MeshBuffer const &buffer,
+	std::function< void(Scene &, Drawable &) > const &on_drawable) {
+
+	MappedFile file(filename);
+	char const *at = file.begin();
+
+	std::vector< char > names_storage;
+	ChunkView< char > names = read_chunk(at, file.end(), "str0", &names_storage);
+
+	std::vector< SceneFile::HierarchyEntry > hierarchy_storage;
+	ChunkView< SceneFile::HierarchyEntry > hierarchy = read_chunk(at, file.end(), "xfh0", &hierarchy_storage);
+
+	std::vector< SceneFile::DrawableEntry > baked_storage;
+	ChunkView< SceneFile::DrawableEntry > baked = read_chunk(at, file.end(), "drw1", &baked_storage);
+
+	std::vector< SceneFile::LODEntry > baked_lods_storage;
+	ChunkView< SceneFile::LODEntry > baked_lods = read_chunk(at, file.end(), "lod0", &baked_lods_storage);
+
+	std::vector< uint32_t > name_ids_storage;
+	ChunkView< uint32_t > name_ids = read_chunk(at, file.end(), "nid0", &name_ids_storage);
+
+	std::vector< uint32_t > sorted_storage;
+	ChunkView< uint32_t > sorted = read_chunk(at, file.end(), "nam0", &sorted_storage);
+
+	std::vector< SceneFile::CameraEntry > cameras_storage;
+	ChunkView< SceneFile::CameraEntry > cameras = read_chunk(at, file.end(), "cam0", &cameras_storage);
+
+	std::vector< SceneFile::LightEntry > lights_storage;
+	ChunkView< SceneFile::LightEntry > lights = read_chunk(at, file.end(), "lmp0", &lights_storage);
+
+	if (at != file.end()) {
+		std::cerr << "WARNING: trailing data in level file '" << filename << "'" << std::endl;
+	}
+
+	//--------------------------------
+
+	std::vector< Transform * > hierarchy_transforms = make_hierarchy(*this, filename, names, hierarchy);
+
+	//drawables arrive in draw order with mesh ranges already resolved; those are ranges in the .pnct file,
+	// so find the buffer's mesh for each (shifted to where the buffer landed in its arena, if any), which also
+	// checks that the level was baked against the file the buffer was loaded from:
+	if (baked_lods.size() != baked.size()) {
+		throw std::runtime_error("level file '" + filename + "' has " + std::to_string(baked_lods.size()) + " level-of-detail entries for " + std::to_string(baked.size()) + " drawables");
+	}
+	static_assert(MeshLODs::Max == sizeof(SceneFile::LODEntry::levels) / sizeof(SceneFile::LODEntry::levels[0]), "LODEntry matches MeshLODs.");
+	std::multimap< std::pair< GLuint, GLuint >, Mesh const * > by_range; //(names may share a range, with or without levels of detail)
+	for (auto const &named : buffer.meshes) {
+		by_range.emplace(std::make_pair(named.second.start, named.second.count), &named.second);
+	}
+	for (auto const &b : baked) {
+		SceneFile::LODEntry const &l = baked_lods[&b - baked.begin()];
+		if (b.transform >= hierarchy_transforms.size()) {
+			throw std::runtime_error("level file '" + filename + "' contains drawable entry with invalid transform index (" + std::to_string(b.transform) + ")");
+		}
+		if (l.count > MeshLODs::Max) {
+			throw std::runtime_error("level file '" + filename + "' contains level-of-detail entry with too many levels (" + std::to_string(l.count) + ")");
+		}
+
+		Mesh const *mesh = nullptr;
+		auto range = by_range.equal_range(std::make_pair(b.start + buffer.arena_index_start, b.count));
+		for (auto r = range.first; r != range.second && !mesh; ++r) {
+			Mesh const &m = *r->second;
+			if (m.type != b.type || m.lods.count != l.count) continue;
+			bool same = true;
+			for (uint32_t i = 0; i < l.count; ++i) {
+				same = same && m.lods.levels[i].start == l.levels[i].start + buffer.arena_index_start && m.lods.levels[i].count == l.levels[i].count;
+			}
+			//(compact buffers may widen bounds of meshes that share vertices, but never shrink them)
+			for (uint32_t c = 0; c < 3; ++c) {
+				same = same && m.min[c] <= b.min[c] && m.max[c] >= b.max[c];
+			}
+			if (same) mesh = &m;
+		}
+		if (!mesh) {
+			throw std::runtime_error("level file '" + filename + "' contains a drawable (index range " + std::to_string(b.start) + "+" + std::to_string(b.count) + ") that isn't a mesh of the buffer it is loaded with; it was probably baked from an older .pnct file, so re-bake it");
+		}
+
+		drawables.emplace_back(hierarchy_transforms[b.transform]);
+		Drawable &drawable = drawables.back();
+		drawable.pipeline.type = mesh->type;
+		drawable.pipeline.indexed = true; //(levels are baked from MeshBuffer meshes)
+		drawable.pipeline.start = mesh->start;
+		drawable.pipeline.count = mesh->count;
+		drawable.pipeline.quantized = (buffer.layout == MeshBuffer::Compact);
+		drawable.pipeline.lods = mesh->lods;
+		drawable.pipeline.clusters = mesh->clusters; //(clusters aren't baked, since the buffer has them for the matched mesh)
+		drawable.pipeline.cluster_count = mesh->cluster_count;
+		drawable.pipeline.min = mesh->min;
+		drawable.pipeline.max = mesh->max;
+		drawable.transform->bbox.min = mesh->min;
+		drawable.transform->bbox.max = mesh->max;
+		drawable.collision = mesh->collision;
+
+		if (on_drawable) {
+			on_drawable(*this, drawable);
+		}
+
+		if (mesh->min == b.min && mesh->max == b.max) {
+			//world bounds were computed by the baking tool:
+			if (b.min.x <= b.max.x && b.min.y <= b.max.y && b.min.z <= b.max.z) {
+				drawable.bvh_proxy = bvh.insert(b.world_min, b.world_max, &drawable);
+			}
+		} else {
+			update_bvh(drawable); //(...for the bounds it was baked with, so recompute them)
+		}
+	}
+
+	make_cameras(*this, filename, cameras, hierarchy_transforms);
+	make_lights(*this, filename, lights, hierarchy_transforms);
+
+	//name index, from the precomputed ids and order (only the hash table needs to be filled in):
+	if (name_ids.size() != hierarchy_transforms.size()) {
+		throw std::runtime_error("level file '" + filename + "' has " + std::to_string(name_ids.size()) + " name ids for " + std::to_string(hierarchy_transforms.size()) + " transforms");
+	}
+	name_index = NameIndex();
+	name_index.names.resize(sorted.size());
+	name_index.transforms.resize(sorted.size(), nullptr);
+	name_index.sorted.assign(sorted.begin(), sorted.end());
+	for (uint32_t i = 0; i < hierarchy_transforms.size(); ++i) {
+		Transform *t = hierarchy_transforms[i];
+		uint32_t id = name_ids[i];
+		if (id >= sorted.size()) {
+			throw std::runtime_error("level file '" + filename + "' contains invalid name id (" + std::to_string(id) + ")");
+		}
+		t->name_id = id;
+		if (!name_index.transforms[id]) {
+			name_index.names[id] = t->name;
+			name_index.transforms[id] = t;
+		}
+	}
+	name_index.ids.reserve(name_index.names.size());
+	for (uint32_t id = 0; id < name_index.names.size(); ++id) {
+		name_index.ids.emplace(name_index.names[id], id);
+	}
+	for (auto &d : drawables) {
+		name_index.drawables.emplace(d.transform, &d);
+	}
+}
+
+AsyncLoad< Scene > Scene::load_async(std::string const &filename,
+	std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable) {
+	return ::load_async< Scene >([filename, on_drawable]() {
+		std::unique_ptr< Scene > ret(new Scene());
+		ret->load(filename, on_drawable);
+		return ret.release();
+	});
+}
+
+AsyncLoad< Scene > Scene::load_baked_async(std::string const &filename, MeshBuffer const &buffer,
+	std::function< void(Scene &, Drawable &) > const &on_drawable) {
+	return ::load_async< Scene >([filename, &buffer, on_drawable]() { //(buffer must outlive the load)
+		std::unique_ptr< Scene > ret(new Scene());
+		ret->load_baked(filename, buffer, on_drawable);
+		return ret.release();
+	});
 }
 
 //-------------------------
@@ -363,32 +1176,355 @@ void Scene::set(Scene const &other, std::unordered_map< Transform const *, Trans
 		transforms.back().rotation = t.rotation;
 		transforms.back().scale = t.scale;
 		transforms.back().parent = t.parent; //will update later
+		transforms.back().bbox = t.bbox;
+		transforms.back().doDraw = t.doDraw;
 
 		//store mapping between transforms old and new:
 		auto ret = transform_to_transform.insert(std::make_pair(&t, &transforms.back()));
 		assert(ret.second);
 	}
 
+	//pointers into other's base scene (if any) are shared, so they map to themselves:
+	auto map_transform = [&transform_to_transform,&other](Transform *t) -> Transform * {
+		auto f = transform_to_transform.find(t);
+		if (f != transform_to_transform.end()) return f->second;
+		assert(other.base && "transform pointers should be in the scene or its base");
+		return t;
+	};
+
 	//update transform parents:
 	for (auto &t : transforms) {
-		t.parent = transform_to_transform.at(t.parent);
+		t.parent = map_transform(t.parent);
 	}
 
 	//copy other's drawables, updating transform pointers:
+	// (the bvh, occlusion queries, and draw states are not copied; call update_bvh() to build a bvh for this scene)
+	bvh.clear();
+	clear_occlusion_queries();
+	draw_states.clear();
 	drawables = other.drawables;
 	for (auto &d : drawables) {
-		d.transform = transform_to_transform.at(d.transform);
+		d.transform = map_transform(d.transform);
+		d.bvh_proxy = DynamicBVH::Null;
 	}
 
 	//copy other's cameras, updating transform pointers:
 	cameras = other.cameras;
 	for (auto &c : cameras) {
-		c.transform = transform_to_transform.at(c.transform);
+		c.transform = map_transform(c.transform);
 	}
 
 	//copy other's lights, updating transform pointers:
 	lights = other.lights;
 	for (auto &l : lights) {
-		l.transform = transform_to_transform.at(l.transform);
+		l.transform = map_transform(l.transform);
+	}
+
+	//share other's base (if any), pointing overrides at the new copies:
+	// (before indexing names, since instanced scenes share their base's name ids)
+	base = other.base;
+	index_names();
+	overrides.clear();
+	for (auto const &o : other.overrides) {
+		overrides.emplace(o.first, transform_to_transform.at(o.second));
+	}
+}
+
+void Scene::set_base(Scene const &base_) {
+	transforms.clear();
+	drawables.clear();
+	cameras.clear();
+	lights.clear();
+	overrides.clear();
+
+	bvh.clear();
+	clear_occlusion_queries();
+	draw_states.clear();
+
+	base = &base_;
+	t = base->t;
+
+	index_names(); //(just the base's name ids, until transforms get overridden)
+}
+
+Scene::Transform *Scene::override_transform(Transform const *base_transform) {
+	assert(base && "only instanced scenes have transforms to override");
+	assert(base_transform);
+
+	{ //already overridden?
+		auto f = overrides.find(base_transform);
+		if (f != overrides.end()) return f->second;
+	}
+
+	//Copy the transform and (since base is in topological order) every descendant that follows it:
+	std::unordered_map< Transform const *, Transform * > copied; //base -> local, for the whole subtree
+	std::unordered_map< Transform const *, Transform * > added; //...just the ones copied by this call
+	for (auto const &bt : base->transforms) {
+		bool is_root = (&bt == base_transform);
+		if (!is_root && !(bt.parent && copied.count(bt.parent))) continue;
+		{ //descendant already overridden on its own? re-parent its copy under the new one:
+			// (its attachments were copied along with it, and its descendants get re-parented in turn)
+			auto f = overrides.find(&bt);
+			if (f != overrides.end()) {
+				f->second->parent = copied.at(bt.parent);
+				copied.emplace(&bt, f->second);
+				continue;
+			}
+		}
+
+		transforms.emplace_back();
+		Transform &t = transforms.back();
+		t.name = bt.name;
+		t.position = bt.position;
+		t.rotation = bt.rotation;
+		t.scale = bt.scale;
+		//parents outside the copied subtree stay pointed at (unchanging) base transforms:
+		t.parent = (is_root ? bt.parent : copied.at(bt.parent));
+		t.bbox = bt.bbox;
+		t.doDraw = bt.doDraw;
+
+		copied.emplace(&bt, &t);
+		added.emplace(&bt, &t);
+		overrides.emplace(&bt, &t);
+
+		//the copy takes the name id of the transform it overrides:
+		// (and stands in for it in name lookups if it was the first with that name)
+		assert(bt.name_id < name_index.transforms.size());
+		t.name_id = bt.name_id;
+		Transform *&named = name_index.transforms[t.name_id];
+		if (!named || base->name_index.transforms[t.name_id] == &bt) named = &t;
+	}
+	assert(copied.count(base_transform) && "transform to override should be in base");
+
+	//Copy objects attached to the new copies, re-pointed at them:
+	for (auto const &d : base->drawables) {
+		auto f = added.find(d.transform);
+		if (f == added.end()) continue;
+		drawables.emplace_back(d);
+		drawables.back().transform = f->second;
+		drawables.back().bvh_proxy = DynamicBVH::Null;
+		name_index.drawables.emplace(f->second, &drawables.back());
+	}
+	for (auto const &c : base->cameras) {
+		auto f = added.find(c.transform);
+		if (f == added.end()) continue;
+		cameras.emplace_back(c);
+		cameras.back().transform = f->second;
+	}
+	for (auto const &l : base->lights) {
+		auto f = added.find(l.transform);
+		if (f == added.end()) continue;
+		lights.emplace_back(l);
+		lights.back().transform = f->second;
+	}
+
+	return copied.at(base_transform);
+}
+
+void Scene::index_names() {
+	name_index = NameIndex();
+
+	//instanced scenes share their base's name ids, so overrides keep the ids of the transforms they copy:
+	// (names only the base has map to no local transform; the const lookups fall back to the base for those)
+	if (base) {
+		name_index.ids = base->name_index.ids;
+		name_index.names = base->name_index.names;
+		name_index.transforms.assign(name_index.names.size(), nullptr);
+		name_index.sorted = base->name_index.sorted;
 	}
+	size_t shared = name_index.names.size();
+
+	for (auto &t : transforms) {
+		auto ret = name_index.ids.emplace(t.name, uint32_t(name_index.names.size()));
+		if (ret.second) {
+			name_index.names.emplace_back(t.name);
+			name_index.transforms.emplace_back(&t);
+		} else if (!name_index.transforms[ret.first->second]) {
+			name_index.transforms[ret.first->second] = &t; //(first local transform with a base name)
+		}
+		t.name_id = ret.first->second;
+	}
+
+	if (name_index.names.size() != shared) {
+		name_index.sorted.clear();
+		name_index.sorted.reserve(name_index.names.size());
+		for (uint32_t id = 0; id < name_index.names.size(); ++id) {
+			name_index.sorted.emplace_back(id);
+		}
+		std::sort(name_index.sorted.begin(), name_index.sorted.end(), [this](uint32_t a, uint32_t b) {
+			return name_index.names[a] < name_index.names[b];
+		});
+	}
+
+	for (auto &d : drawables) {
+		name_index.drawables.emplace(d.transform, &d);
+	}
+}
+
+uint32_t Scene::find_name(std::string const &name) const {
+	auto f = name_index.ids.find(std::string_view(name));
+	if (f == name_index.ids.end()) return InvalidName;
+	return f->second;
+}
+
+Scene::Transform *Scene::find_transform(std::string const &name) {
+	uint32_t id = find_name(name);
+	if (id == InvalidName) return nullptr;
+	return name_index.transforms[id];
+}
+
+Scene::Transform const *Scene::find_transform(std::string const &name) const {
+	uint32_t id = find_name(name);
+	if (id == InvalidName) return nullptr;
+	return find_transform(id);
+}
+
+Scene::Transform const *Scene::find_transform(uint32_t id) const {
+	if (name_index.transforms[id]) return name_index.transforms[id];
+	//not overridden, so (if instanced) the base's:
+	if (base && id < base->name_index.transforms.size()) return base->name_index.transforms[id];
+	return nullptr;
+}
+
+Scene::Drawable *Scene::find_drawable(Transform const *transform) {
+	auto f = name_index.drawables.find(transform);
+	if (f == name_index.drawables.end()) return nullptr;
+	return f->second;
+}
+
+Scene::Drawable const *Scene::find_drawable(Transform const *transform) const {
+	auto f = name_index.drawables.find(transform);
+	if (f == name_index.drawables.end()) return (base ? base->find_drawable(transform) : nullptr);
+	return f->second;
+}
+
+std::vector< std::pair< uint32_t, uint32_t > > Scene::find_numbered_ids(std::string const &prefix) const {
+	std::vector< std::pair< uint32_t, uint32_t > > ret;
+
+	//names starting with 'prefix' form a contiguous range of the sorted ids:
+	auto begin = std::lower_bound(name_index.sorted.begin(), name_index.sorted.end(), prefix, [this](uint32_t id, std::string const &p) {
+		return name_index.names[id] < p;
+	});
+	for (auto i = begin; i != name_index.sorted.end(); ++i) {
+		std::string_view name = name_index.names[*i];
+		if (name.compare(0, prefix.size(), prefix) != 0) break;
+		if (name.size() == prefix.size()) continue;
+
+		//parse the (all-digit) suffix:
+		uint32_t number = 0;
+		bool digits = true;
+		for (size_t c = prefix.size(); c < name.size(); ++c) {
+			if (name[c] < '0' || name[c] > '9') {
+				digits = false;
+				break;
+			}
+			number = number * 10 + uint32_t(name[c] - '0');
+		}
+		if (!digits) continue;
+
+		ret.emplace_back(number, *i);
+	}
+
+	std::sort(ret.begin(), ret.end(), [](std::pair< uint32_t, uint32_t > const &a, std::pair< uint32_t, uint32_t > const &b) {
+		return a.first < b.first;
+	});
+
+	return ret;
+}
+
+std::vector< std::pair< uint32_t, Scene::Transform * > > Scene::find_numbered(std::string const &prefix) {
+	std::vector< std::pair< uint32_t, Transform * > > ret;
+	for (auto const &numbered : find_numbered_ids(prefix)) {
+		if (Transform *t = name_index.transforms[numbered.second]) ret.emplace_back(numbered.first, t);
+	}
+	return ret;
+}
+
+std::vector< std::pair< uint32_t, Scene::Transform const * > > Scene::find_numbered(std::string const &prefix) const {
+	std::vector< std::pair< uint32_t, Transform const * > > ret;
+	for (auto const &numbered : find_numbered_ids(prefix)) {
+		if (Transform const *t = find_transform(numbered.second)) ret.emplace_back(numbered.first, t);
+	}
+	return ret;
+}
+
+//world-space bounding box of a drawable's object-space bounds:
+static void world_bounds(Scene::Drawable const &drawable, glm::vec3 *min_, glm::vec3 *max_) {
+	glm::vec3 const &min = drawable.pipeline.min;
+	glm::vec3 const &max = drawable.pipeline.max;
+	glm::mat4x3 to_world = drawable.transform->make_local_to_world();
+	glm::vec3 world_min = glm::vec3( std::numeric_limits< float >::infinity());
+	glm::vec3 world_max = glm::vec3(-std::numeric_limits< float >::infinity());
+	for (uint32_t c = 0; c < 8; ++c) {
+		glm::vec3 corner = to_world * glm::vec4(
+			(c & 1 ? max.x : min.x),
+			(c & 2 ? max.y : min.y),
+			(c & 4 ? max.z : min.z),
+			1.0f
+		);
+		world_min = glm::min(world_min, corner);
+		world_max = glm::max(world_max, corner);
+	}
+	*min_ = world_min;
+	*max_ = world_max;
+}
+
+void Scene::update_bvh(Drawable &drawable) {
+	if (!(drawable.pipeline.min.x <= drawable.pipeline.max.x
+	   && drawable.pipeline.min.y <= drawable.pipeline.max.y
+	   && drawable.pipeline.min.z <= drawable.pipeline.max.z)) {
+		//no bounds, so not in the bvh:
+		if (drawable.bvh_proxy != DynamicBVH::Null) {
+			bvh.remove(drawable.bvh_proxy);
+			drawable.bvh_proxy = DynamicBVH::Null;
+		}
+		return;
+	}
+
+	glm::vec3 min, max;
+	world_bounds(drawable, &min, &max);
+	if (drawable.bvh_proxy == DynamicBVH::Null) {
+		drawable.bvh_proxy = bvh.insert(min, max, &drawable);
+	} else {
+		bvh.move(drawable.bvh_proxy, min, max);
+	}
+}
+
+void Scene::update_bvh() {
+	for (auto &drawable : drawables) {
+		update_bvh(drawable);
+	}
+}
+
+void Scene::query_box(glm::vec3 const &min, glm::vec3 const &max, std::function< bool(Drawable &) > const &callback) const {
+	bvh.query_box(min, max, [this,&callback](DynamicBVH::Proxy proxy) {
+		return callback(*static_cast< Drawable * >(bvh.user(proxy)));
+	});
+}
+
+void Scene::query_sphere(glm::vec3 const &center, float radius, std::function< bool(Drawable &) > const &callback) const {
+	bvh.query_sphere(center, radius, [this,&callback](DynamicBVH::Proxy proxy) {
+		return callback(*static_cast< Drawable * >(bvh.user(proxy)));
+	});
+}
+
+Scene::Drawable *Scene::ray_cast(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, float *t) const {
+	DynamicBVH::Proxy best = DynamicBVH::Null;
+	float best_t = max_t;
+	bvh.ray_cast(origin, direction, max_t, [&](DynamicBVH::Proxy proxy, float hit_t) {
+		if (hit_t <= best_t) {
+			best = proxy;
+			best_t = hit_t;
+		}
+		return best_t; //only look for closer hits from here on
+	});
+	if (best == DynamicBVH::Null) return nullptr;
+	if (t) *t = best_t;
+	return static_cast< Drawable * >(bvh.user(best));
+}
+
+Scene::Drawable *Scene::nearest(glm::vec3 const &point, float max_distance, float *distance) const {
+	DynamicBVH::Proxy proxy = bvh.nearest(point, max_distance, distance);
+	if (proxy == DynamicBVH::Null) return nullptr;
+	return static_cast< Drawable * >(bvh.user(proxy));
 }
@@ -11,14 +11,20 @@
  */
 
 #include "GL.hpp"
+#include "Load.hpp"
+#include "Mesh.hpp"
+#include "DynamicBVH.hpp"
+#include "read_write_chunk.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
 #include <list>
+#include <set>
 #include <memory>
 #include <functional>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <unordered_map>
 
@@ -32,6 +38,7 @@ struct Scene {
 	struct Transform {
 		//Transform names are useful for debugging and looking up locations in a loaded scene:
 		std::string name;
+		uint32_t name_id = -1U; //interned name (see name_index, below)
 
 		//The core function of a transform is to store a transformation in the world:
 		glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
@@ -63,25 +70,41 @@ struct Scene {
 		Drawable(Transform *transform_) : transform(transform_) { assert(transform); }
 		Transform * transform;
 
+		//this drawable's entry in the scene's bvh (if any):
+		DynamicBVH::Proxy bvh_proxy = DynamicBVH::Null;
+
+		//the mesh's triangles, for exact collision queries, if its MeshBuffer kept them (see Mesh::collision):
+		CollisionMesh const *collision = nullptr;
+
 		//Contains all the data needed to run the OpenGL pipeline:
 		struct Pipeline {
-			//Purely storage to pass bbox info the transform
-			glm::vec3 min = glm::vec3(0.0f);
-			glm::vec3 max = glm::vec3(0.0f);
+			//Object-space bounding box of the mesh; used for frustum culling and to pass bbox info to the transform
+			// (left empty -- min > max -- when bounds are unknown; such drawables are never culled)
+			glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+			glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
 
 			GLuint program = 0; //shader program; passed to glUseProgram
 
 			//attributes:
 			GLuint vao = 0; //attrib->buffer mapping; passed to glBindVertexArray
 
-			GLenum type = GL_TRIANGLES; //what sort of primitive to draw; passed to glDrawArrays
-			GLuint start = 0; //first vertex to draw; passed to glDrawArrays
-			GLuint count = 0; //number of vertices to draw; passed to glDrawArrays
+			GLenum type = GL_TRIANGLES; //what sort of primitive to draw; passed to glDrawArrays / glDrawElements
+			bool indexed = false; //draw with glDrawElements from the vao's element buffer (GL_UNSIGNED_INT indices), as for MeshBuffer meshes
+			GLuint start = 0; //first vertex (or index, if indexed) to draw
+			GLuint count = 0; //number of vertices (or indices) to draw
+			bool quantized = false; //vertex positions are fractions of the way across [min,max] (MeshBuffer::Compact); draw() scales them back
+			MeshLODs lods; //(optional) coarser ranges to draw instead when far away; see Scene::lod_size
+			TriangleCluster const *clusters = nullptr; //(optional) pieces of [start,count) that draw() culls one by one; see Scene::cluster_culling
+			uint32_t cluster_count = 0;
 
 			//uniforms:
-			GLuint OBJECT_TO_CLIP_mat4 = -1U; //uniform location for object to clip space matrix
-			GLuint OBJECT_TO_LIGHT_mat4x3 = -1U; //uniform location for object to light space (== world space) matrix
-			GLuint NORMAL_TO_LIGHT_mat3 = -1U; //uniform location for normal to light space (== world space) matrix
+			// (world-to-clip and world-to-light come from the shared "Camera" block; see FrameUniforms.hpp)
+			GLuint OBJECT_TO_WORLD_mat4x3 = -1U; //uniform location for object to world space matrix
+			GLuint NORMAL_TO_WORLD_mat3 = -1U; //uniform location for normal to world space matrix
+
+			//material uniforms (resolved once when the program is loaded; see Drawable::Material):
+			GLuint t_float = -1U; //uniform location for the shared beat fade value (Scene::t)
+			GLuint TEX_sampler2D = -1U; //uniform location for the sampler that reads the material's texture unit
 
 			std::function< void() > set_uniforms; //(optional) function to set any other useful uniforms
 
@@ -91,7 +114,23 @@ struct Scene {
 				GLuint texture = 0;
 				GLenum target = GL_TEXTURE_2D;
 			} textures[TextureCount];
+
+			//(optional) instanced variant of this pipeline:
+			// drawables that share all of the above state are drawn in one glDrawArraysInstanced call
+			// with their matrices streamed through Scene::instance_buffer() (see Scene::Instance)
+			struct {
+				GLuint program = 0; //instanced shader program (0 => never instance this drawable)
+				GLuint vao = 0; //like 'vao', but also sourcing per-instance attributes
+				GLuint t_float = -1U; //material uniforms for the instanced program
+				GLuint TEX_sampler2D = -1U;
+			} instanced;
 		} pipeline;
+
+		//Material variant used when drawing; chosen once at load time (rather than by name every frame):
+		enum Material : uint8_t {
+			Plain = 0, //samples texture 0, never fades with the beat
+			Beat = 1, //samples texture 1, fades toward the beat color by Scene::t
+		} material = Plain;
 	};
 
 	struct Camera {
@@ -125,6 +164,9 @@ struct Scene {
 		//  (i.e., "red, gree, blue" light color)
 		glm::vec3 energy = glm::vec3(1.0f);
 
+		//Point and spot lights contribute nothing beyond this distance:
+		float distance = 40.0f;
+
 		//Spotlight specific:
 		float spot_fov = glm::radians(45.0f); //spot cone fov (in radians)
 	};
@@ -135,12 +177,144 @@ struct Scene {
 	std::list< Camera > cameras;
 	std::list< Light > lights;
 
+	//Name index:
+	// transform names are interned to small integer ids when a scene is loaded, so lookups
+	// by name happen once through a hash table rather than by comparing strings.
+	// (only covers this scene's own transforms -- not those of 'base' -- and is rebuilt by
+	//  load() and set(); call index_names() after adding objects by hand)
+	static constexpr uint32_t InvalidName = -1U;
+	struct NameIndex {
+		//(names are views of the transforms' own name strings, so rebuild the index after renaming)
+		std::unordered_map< std::string_view, uint32_t > ids; //name -> id
+		std::vector< std::string_view > names; //id -> name
+		std::vector< Transform * > transforms; //id -> (first) transform with that name
+		std::vector< uint32_t > sorted; //ids, sorted by name (for prefix queries)
+		std::unordered_map< Transform const *, Drawable * > drawables; //transform -> (first) attached drawable
+	} name_index;
+
+	void index_names();
+
+	//id of an interned name, or InvalidName:
+	uint32_t find_name(std::string const &name) const;
+	//In instanced scenes (see set_base), the name index covers the base's names too, and overridden copies
+	// keep the name ids of the transforms they copy. The non-const lookups only find local (mutable) transforms
+	// and drawables -- i.e., overridden ones; the const lookups fall back to the base's for the rest.
+
+	//transform with a given name, or nullptr:
+	// (const scenes -- e.g., a shared base -- only hand out const pointers)
+	Transform *find_transform(std::string const &name);
+	Transform const *find_transform(std::string const &name) const;
+	Transform const *find_transform(uint32_t name_id) const; //...by name id
+	//drawable attached to a given transform, or nullptr:
+	// (for an overridden transform, pass the local copy)
+	Drawable *find_drawable(Transform const *transform);
+	Drawable const *find_drawable(Transform const *transform) const;
+	//all transforms named 'prefix' followed by a decimal number (e.g., "Platform12"),
+	// as (number, transform) pairs in increasing numeric order:
+	std::vector< std::pair< uint32_t, Transform * > > find_numbered(std::string const &prefix);
+	std::vector< std::pair< uint32_t, Transform const * > > find_numbered(std::string const &prefix) const;
+	//...as (number, name id) pairs:
+	std::vector< std::pair< uint32_t, uint32_t > > find_numbered_ids(std::string const &prefix) const;
+
+	//Spatial index over the world-space bounds of this scene's own drawables:
+	// not built automatically -- call update_bvh() after loading and after moving transforms;
+	// the tree is only restructured for drawables that move outside their (slightly enlarged) bounds.
+	// drawables without bounds (pipeline.min > pipeline.max) are left out.
+	// n.b. remove a drawable from the bvh (bvh.remove(drawable.bvh_proxy)) before erasing it
+	DynamicBVH bvh;
+	void update_bvh(); //all drawables
+	void update_bvh(Drawable &drawable); //just one
+
+	//Spatial queries (against world-space drawable bounds); callbacks return false to stop early:
+	void query_box(glm::vec3 const &min, glm::vec3 const &max, std::function< bool(Drawable &) > const &callback) const;
+	void query_sphere(glm::vec3 const &center, float radius, std::function< bool(Drawable &) > const &callback) const;
+	//closest drawable whose bounds are hit by the ray origin + t * direction (0 <= t <= max_t), or nullptr:
+	Drawable *ray_cast(glm::vec3 const &origin, glm::vec3 const &direction, float max_t = std::numeric_limits< float >::infinity(), float *t = nullptr) const;
+	//drawable whose bounds are closest to point, or nullptr:
+	Drawable *nearest(glm::vec3 const &point, float max_distance = std::numeric_limits< float >::infinity(), float *distance = nullptr) const;
+
+	//Copy-on-write instancing:
+	// a scene may sit on top of an immutable, shared 'base' scene. Base drawables are drawn as
+	// if they were part of this scene, and only transforms that gameplay needs to change are
+	// copied in (with override_transform), along with their descendants and attachments.
+	Scene const *base = nullptr; //(not owned; must outlive this scene and not change while instanced)
+	std::unordered_map< Transform const *, Transform * > overrides; //base transform -> local copy
+
+	//make this scene an (empty) copy-on-write instance of 'base':
+	void set_base(Scene const &base);
+
+	//get a local, mutable copy of a transform from 'base':
+	// copies its descendants and any attached drawables, cameras, and lights as well;
+	// returns the existing copy if the transform has already been overridden.
+	Transform *override_transform(Transform const *base_transform);
+
+	//Level of detail selection:
+	// a drawable switches from level k to the coarser level k+1 when the radius of its bounding sphere
+	// projects to less than lod_size * 0.5^k (as a fraction of half the viewport height), and back once it
+	// is lod_hysteresis times larger than that, so objects near a threshold don't flicker between levels.
+	float lod_size = 0.2f;
+	float lod_hysteresis = 1.25f;
+
+	//Cluster culling:
+	// drawables drawn at full detail whose pipelines have clusters (big meshes; see Mesh::clusters) have
+	// each cluster checked against the view frustum, and only the index ranges of the clusters that
+	// might be visible are drawn (with one glMultiDrawElements call).
+	// Clusters can also be culled when all of their triangles face away from the camera, but since
+	// nothing here turns on GL_CULL_FACE (so back faces of open meshes do show), that is off by default.
+	bool cluster_culling = true;
+	bool cluster_backface_culling = false;
+
+	//What draw() remembers about a drawable between frames:
+	// (kept per scene rather than per drawable, so instances sharing a base each have their own)
+	struct DrawState {
+		uint8_t lod = 0; //level of detail drawn last frame (0 = pipeline.start/count), for hysteresis
+		std::vector< GLuint > visible_ranges; //(start, count) pairs of the index ranges of pipeline.clusters found visible
+	};
+	mutable std::unordered_map< Drawable const *, DrawState > draw_states;
+
+	//Occlusion culling (optional):
+	// after drawing, draw() tests the bounding box of each drawable that passed frustum culling against the
+	// depth buffer with an occlusion query (drawn depth-only with ColorProgram), and skips drawables whose
+	// box was hidden. Results are only read once the GPU has them, so draw() never waits on a query -- the
+	// price is that objects coming out from behind an occluder show up a frame (or so) late.
+	bool occlusion_culling = false;
+	struct OcclusionStats {
+		uint32_t results = 0; //query results that arrived this frame
+		uint32_t culled = 0; //drawables skipped because their box was hidden
+		uint32_t issued = 0; //queries issued this frame
+	};
+	mutable OcclusionStats occlusion_stats; //(filled in by draw())
+	struct OcclusionQuery {
+		GLuint query = 0;
+		bool pending = false; //issued, result not read yet
+		bool visible = true; //last result
+	};
+	//(kept per scene rather than per drawable, so instances sharing a base each have their own)
+	mutable std::unordered_map< Drawable const *, OcclusionQuery > occlusion_queries;
+	//delete all queries (call before erasing drawables that have been drawn with occlusion culling on):
+	void clear_occlusion_queries();
+
 	//The "draw" function provides a convenient way to pass all the things in a scene to OpenGL:
 	void draw(Camera const &camera) const;
 
 	//..sometimes, you want to draw with a custom projection matrix and/or light space:
 	void draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f)) const;
 
+	//Per-instance data streamed to instanced pipelines; matches the per-instance attributes
+	// (OBJECT_TO_WORLD, NORMAL_TO_WORLD) of instanced programs:
+	struct Instance {
+		glm::mat4x3 OBJECT_TO_WORLD;
+		glm::mat3 NORMAL_TO_WORLD;
+	};
+	static_assert(sizeof(Instance) == 4*12 + 4*9, "Instance is packed.");
+
+	//buffer that Instance data is streamed into (shared by all scenes; created on first use):
+	static GLuint instance_buffer();
+
+	//point per-instance attributes of 'program' at instance_buffer() in the currently-bound vertex array:
+	// (adds the locations it binds to 'bound', if given -- handy with MeshBuffer::make_vao_for_program)
+	static void bind_instance_attributes(GLuint program, std::set< GLuint > *bound = nullptr);
+
 	//add transforms/objects/cameras from a scene file to this scene:
 	// the 'on_drawable' callback gives your code a chance to look up mesh data and make Drawables:
 	// throws on file format errors
@@ -148,9 +322,35 @@ struct Scene {
 		std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable = nullptr
 	);
 
+	//add transforms/objects/cameras from a scene file, drawing its meshes from 'buffer':
+	// mesh names are resolved all together through the buffer's hash index (with no per-mesh strings), and
+	// drawables are created with mesh ranges and bounds filled in; 'on_drawable' sets up the rest of their pipelines.
+	// throws on file format errors and on meshes missing from 'buffer'
+	void load(std::string const &filename, MeshBuffer const &buffer,
+		std::function< void(Scene &, Drawable &) > const &on_drawable = nullptr
+	);
+
+	//add transforms/drawables/cameras/lights from a baked level file (see bake-level.cpp), drawing its meshes from 'buffer':
+	// drawables are created with mesh ranges, bounds, and clusters already filled in (matched to 'buffer's meshes by
+	// their baked index ranges -- no name lookups), and added to the bvh; 'on_drawable' sets up the rest of their pipelines.
+	// throws on file format errors and on levels baked against a different .pnct file than 'buffer' was loaded from
+	void load_baked(std::string const &filename, MeshBuffer const &buffer,
+		std::function< void(Scene &, Drawable &) > const &on_drawable = nullptr
+	);
+
+	//load a scene or baked level on the background loading thread (see load_async() in Load.hpp):
+	// n.b. 'on_drawable' runs on the loading thread, so it must not make OpenGL calls
+	static AsyncLoad< Scene > load_async(std::string const &filename,
+		std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable = nullptr
+	);
+	static AsyncLoad< Scene > load_baked_async(std::string const &filename, MeshBuffer const &buffer,
+		std::function< void(Scene &, Drawable &) > const &on_drawable = nullptr
+	);
+
 	//this function is called to read extra chunks from the scene file after the main chunks are read:
 	// this is useful if you, e.g., subclassing scene to represent a game level/area
-	virtual void load_extra(std::istream &from, std::vector< char > const &str0, std::vector< Transform * > const &xfh0) { }
+	// (str0 is a view into the scene file, which is only mapped while load() runs)
+	virtual void load_extra(std::istream &from, ChunkView< char > const &str0, std::vector< Transform * > const &xfh0) { }
 
 	//empty scene:
 	Scene() = default;
@@ -0,0 +1,106 @@
+#pragma once
+
+/*
+ * On-disk structures of the chunks in ".scene" files (written by scenes/export-scene.py)
+ * and baked ".level" files (written by bake-level).
+ *
+ * A ".scene" file contains, in order:
+ *  str0 - names (char)
+ *  xfh0 - transform hierarchy (HierarchyEntry), in topological order
+ *  msh0 - meshes to draw, by name (MeshEntry)
+ *  cam0 - cameras (CameraEntry)
+ *  lmp0 - lights (LightEntry)
+ *
+ * A ".level" file has everything resolved ahead of time, and contains, in order:
+ *  str0, xfh0 - as above
+ *  drw1 - drawables, with mesh index ranges and bounds already looked up, in draw order (DrawableEntry)
+ *  lod0 - levels of detail of each drawable (LODEntry; same order as drw1)
+ *  nid0 - name id of each transform (uint32_t; ids are dense and assigned in order of first use)
+ *  nam0 - name ids, in name order (uint32_t)
+ *  cam0, lmp0 - as above
+ *
+ * An ".anim" file (written by scenes/export-animation.py) contains, in order:
+ *  str0 - names (char)
+ *  anm0 - clips (ClipEntry)
+ *  trk0 - tracks (TrackEntry), grouped by clip
+ *  tim0 - keyframe times in seconds (float), increasing within each track
+ *  key0 - keyframe values (glm::vec4; rotations as x,y,z,w), one per time
+ *
+ */
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstdint>
+
+namespace SceneFile {
+
+struct HierarchyEntry {
+	uint32_t parent;
+	uint32_t name_begin;
+	uint32_t name_end;
+	glm::vec3 position;
+	glm::quat rotation;
+	glm::vec3 scale;
+};
+static_assert(sizeof(HierarchyEntry) == 4 + 4 + 4 + 4*3 + 4*4 + 4*3, "HierarchyEntry is packed.");
+
+struct MeshEntry {
+	uint32_t transform;
+	uint32_t name_begin;
+	uint32_t name_end;
+};
+static_assert(sizeof(MeshEntry) == 4 + 4 + 4, "MeshEntry is packed.");
+
+struct CameraEntry {
+	uint32_t transform;
+	char type[4]; //"pers" or "orth"
+	float data; //fov in degrees for 'pers', scale for 'orth'
+	float clip_near, clip_far;
+};
+static_assert(sizeof(CameraEntry) == 4 + 4 + 4 + 4 + 4, "CameraEntry is packed.");
+
+struct LightEntry {
+	uint32_t transform;
+	char type;
+	glm::u8vec3 color;
+	float energy;
+	float distance;
+	float fov;
+};
+static_assert(sizeof(LightEntry) == 4 + 1 + 3 + 4 + 4 + 4, "LightEntry is packed.");
+
+struct DrawableEntry {
+	uint32_t transform;
+	uint32_t type; //primitive type (GLenum)
+	uint32_t start, count; //index range in the .pnct file the level was baked against
+	glm::vec3 min, max; //object-space bounds
+	glm::vec3 world_min, world_max; //world-space bounds (at load-time transform values)
+};
+static_assert(sizeof(DrawableEntry) == 4*4 + 4*3*4, "DrawableEntry is packed.");
+
+struct LODEntry {
+	uint32_t count; //number of levels used below
+	struct {
+		uint32_t start, count; //index range of a coarser level (finest first)
+	} levels[3];
+};
+static_assert(sizeof(LODEntry) == 4 + 3*2*4, "LODEntry is packed.");
+
+struct ClipEntry {
+	uint32_t name_begin;
+	uint32_t name_end;
+	uint32_t track_begin, track_end; //range in trk0
+	float duration; //seconds
+};
+static_assert(sizeof(ClipEntry) == 4*5, "ClipEntry is packed.");
+
+struct TrackEntry {
+	uint32_t name_begin; //name of the transform the track animates
+	uint32_t name_end;
+	uint32_t channel; //0: position; 1: rotation; 2: scale
+	uint32_t key_begin, key_end; //range in tim0/key0
+};
+static_assert(sizeof(TrackEntry) == 4*5, "TrackEntry is packed.");
+
+}
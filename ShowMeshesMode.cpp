@@ -24,6 +24,7 @@ ShowMeshesMode::ShowMeshesMode(MeshBuffer const &buffer_) : buffer(buffer_) {
 
 		scene_drawable->pipeline = show_meshes_program_pipeline;
 		scene_drawable->pipeline.vao = vao;
+		scene_drawable->pipeline.indexed = true;
 		//these will be updated by the mesh selection code:
 		scene_drawable->pipeline.type = GL_TRIANGLES;
 		scene_drawable->pipeline.start = 0;
@@ -1,5 +1,6 @@
 #include "ShowMeshesProgram.hpp"
 
+#include "FrameUniforms.hpp"
 #include "gl_compile_program.hpp"
 #include "gl_errors.hpp"
 
@@ -10,9 +11,8 @@ Load< ShowMeshesProgram > show_meshes_program(LoadTagEarly, []() -> ShowMeshesPr
 
 	show_meshes_program_pipeline.program = ret->program;
 
-	show_meshes_program_pipeline.OBJECT_TO_CLIP_mat4 = ret->OBJECT_TO_CLIP_mat4;
-	show_meshes_program_pipeline.OBJECT_TO_LIGHT_mat4x3 = ret->OBJECT_TO_LIGHT_mat4x3;
-	show_meshes_program_pipeline.NORMAL_TO_LIGHT_mat3 = ret->NORMAL_TO_LIGHT_mat3;
+	show_meshes_program_pipeline.OBJECT_TO_WORLD_mat4x3 = ret->OBJECT_TO_WORLD_mat4x3;
+	show_meshes_program_pipeline.NORMAL_TO_WORLD_mat3 = ret->NORMAL_TO_WORLD_mat3;
 
 	return ret;
 });
@@ -22,9 +22,9 @@ ShowMeshesProgram::ShowMeshesProgram() {
 	program = gl_compile_program(
 		//vertex shader:
 		"#version 330\n"
-		"uniform mat4 OBJECT_TO_CLIP;\n"
-		"uniform mat4x3 OBJECT_TO_LIGHT;\n"
-		"uniform mat3 NORMAL_TO_LIGHT;\n"
+		+ std::string(FrameUniforms::CameraGLSL) +
+		"uniform mat4x3 OBJECT_TO_WORLD;\n"
+		"uniform mat3 NORMAL_TO_WORLD;\n"
 		"in vec4 Position;\n"
 		"in vec3 Normal;\n"
 		"in vec4 Color;\n"
@@ -34,9 +34,10 @@ ShowMeshesProgram::ShowMeshesProgram() {
 		"out vec4 color;\n"
 		"out vec2 texCoord;\n"
 		"void main() {\n"
-		"	gl_Position = OBJECT_TO_CLIP * Position;\n"
-		"	position = OBJECT_TO_LIGHT * Position;\n"
-		"	normal = NORMAL_TO_LIGHT * Normal;\n"
+		"	vec3 world_position = OBJECT_TO_WORLD * Position;\n"
+		"	gl_Position = WORLD_TO_CLIP * vec4(world_position, 1.0);\n"
+		"	position = WORLD_TO_LIGHT * vec4(world_position, 1.0);\n"
+		"	normal = NORMAL_WORLD_TO_LIGHT * (NORMAL_TO_WORLD * Normal);\n"
 		"	color = Color;\n"
 		"	texCoord = TexCoord;\n"
 		"}\n"
@@ -80,11 +81,13 @@ ShowMeshesProgram::ShowMeshesProgram() {
 	TexCoord_vec2 = glGetAttribLocation(program, "TexCoord");
 
 	//look up the locations of uniforms:
-	OBJECT_TO_CLIP_mat4 = glGetUniformLocation(program, "OBJECT_TO_CLIP");
-	OBJECT_TO_LIGHT_mat4x3 = glGetUniformLocation(program, "OBJECT_TO_LIGHT");
-	NORMAL_TO_LIGHT_mat3 = glGetUniformLocation(program, "NORMAL_TO_LIGHT");
+	OBJECT_TO_WORLD_mat4x3 = glGetUniformLocation(program, "OBJECT_TO_WORLD");
+	NORMAL_TO_WORLD_mat3 = glGetUniformLocation(program, "NORMAL_TO_WORLD");
 
 	INSPECT_MODE_int = glGetUniformLocation(program, "INSPECT_MODE");
+
+	//camera state comes from the shared uniform block:
+	FrameUniforms::bind_program(program);
 }
 
 ShowMeshesProgram::~ShowMeshesProgram() {
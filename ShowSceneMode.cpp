@@ -136,4 +136,25 @@ void ShowSceneMode::draw(glm::uvec2 const &drawable_size) {
 		*/
 	}
 
+	if (scene.occlusion_culling) { //report occlusion culling results:
+		glDisable(GL_DEPTH_TEST);
+		{ //(DrawLines draws when it goes out of scope, so keep that inside the depth test being off)
+			float aspect = float(drawable_size.x) / float(drawable_size.y);
+			DrawLines draw_lines(glm::mat4(
+				1.0f / aspect, 0.0f, 0.0f, 0.0f,
+				0.0f, 1.0f, 0.0f, 0.0f,
+				0.0f, 0.0f, 1.0f, 0.0f,
+				0.0f, 0.0f, 0.0f, 1.0f
+			));
+			constexpr float H = 0.06f;
+			Scene::OcclusionStats const &stats = scene.occlusion_stats;
+			draw_lines.draw_text("occluded: " + std::to_string(stats.culled) + "; queries issued: " + std::to_string(stats.issued) + ", answered: " + std::to_string(stats.results),
+				glm::vec3(-aspect + 0.1f * H, -1.0f + 0.1f * H, 0.0f),
+				glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
+				glm::u8vec4(0xff, 0xff, 0xff, 0xff)
+			);
+		}
+		glEnable(GL_DEPTH_TEST);
+	}
+
 }
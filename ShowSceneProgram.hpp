@@ -20,9 +20,9 @@ struct ShowSceneProgram {
 	GLuint TexCoord_vec2 = -1U;
 
 	//Uniform (per-invocation variable) locations:
-	GLuint OBJECT_TO_CLIP_mat4 = -1U;
-	GLuint OBJECT_TO_LIGHT_mat4x3 = -1U;
-	GLuint NORMAL_TO_LIGHT_mat3 = -1U;
+	GLuint OBJECT_TO_WORLD_mat4x3 = -1U;
+	GLuint NORMAL_TO_WORLD_mat3 = -1U;
+	//(camera comes from the shared "Camera" uniform block; see FrameUniforms.hpp)
 
 	GLuint INSPECT_MODE_int = -1U; //0: basic lighting; 1: position only; 2: normal only; 3: color only; 4: texcoord only
 
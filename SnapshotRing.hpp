@@ -0,0 +1,102 @@
+#pragma once
+
+/*
+ * SnapshotRing< State > keeps the last 'capacity' snapshots of a set of transforms
+ *  (position, rotation, scale, doDraw) along with a plain-old-data gameplay State.
+ *
+ * Storage is allocated once, up front, as one array per attribute (so saving and restoring
+ *  are tight copy loops, and the State is a single memcpy); once full, saving overwrites
+ *  the oldest snapshot.
+ *
+ * //e.g.:
+ * SnapshotRing< GameState > history(transforms, 600);
+ * history.save(state); //every frame
+ * history.restore(0, &state); history.discard(1); //step back a frame
+ *
+ */
+
+#include "Scene.hpp"
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+template< typename State >
+struct SnapshotRing {
+	static_assert(std::is_trivially_copyable< State >::value, "SnapshotRing state must be memcpy-able.");
+
+	SnapshotRing() = default;
+	SnapshotRing(std::vector< Scene::Transform * > const &transforms_, uint32_t capacity_)
+		: transforms(transforms_), capacity(capacity_),
+		  positions(size_t(capacity_) * transforms_.size()),
+		  rotations(size_t(capacity_) * transforms_.size()),
+		  scales(size_t(capacity_) * transforms_.size()),
+		  doDraws(size_t(capacity_) * transforms_.size()),
+		  states(capacity_) {
+		assert(capacity > 0);
+	}
+
+	//number of snapshots currently stored:
+	uint32_t size() const { return count; }
+
+	//record a snapshot (overwriting the oldest once full):
+	void save(State const &state) {
+		size_t n = transforms.size();
+		size_t base = size_t(head) * n;
+		for (size_t i = 0; i < n; ++i) {
+			Scene::Transform const &t = *transforms[i];
+			positions[base + i] = t.position;
+			rotations[base + i] = t.rotation;
+			scales[base + i] = t.scale;
+			doDraws[base + i] = t.doDraw;
+		}
+		std::memcpy(&states[head], &state, sizeof(State));
+
+		head = (head + 1) % capacity;
+		if (count < capacity) ++count;
+	}
+
+	//restore the snapshot from 'back' saves ago (0 is the most recent):
+	void restore(uint32_t back, State *state) const {
+		assert(back < count);
+		uint32_t slot = (head + capacity - 1 - back) % capacity;
+		size_t n = transforms.size();
+		size_t base = size_t(slot) * n;
+		for (size_t i = 0; i < n; ++i) {
+			Scene::Transform &t = *transforms[i];
+			t.position = positions[base + i];
+			t.rotation = rotations[base + i];
+			t.scale = scales[base + i];
+			t.doDraw = doDraws[base + i];
+		}
+		if (state) std::memcpy(state, &states[slot], sizeof(State));
+	}
+
+	//forget the 'n' most recent snapshots (e.g., after rewinding past them):
+	void discard(uint32_t n) {
+		if (n > count) n = count;
+		head = (head + capacity - n) % capacity;
+		count -= n;
+	}
+
+	void clear() {
+		head = 0;
+		count = 0;
+	}
+
+	//what is tracked:
+	std::vector< Scene::Transform * > transforms;
+	uint32_t capacity = 0;
+
+	//storage, one block per attribute; snapshot 's' of transform 'i' is at [s * transforms.size() + i]:
+	std::vector< glm::vec3 > positions;
+	std::vector< glm::quat > rotations;
+	std::vector< glm::vec3 > scales;
+	std::vector< uint8_t > doDraws;
+	std::vector< State > states;
+
+	uint32_t head = 0; //slot the next save goes into
+	uint32_t count = 0;
+};
@@ -0,0 +1,192 @@
+//bake-level: resolves a .scene file against the .pnct file it will be drawn with and
+// writes a ".level" file (see SceneFile.hpp) that Scene::load_baked can read without
+// looking anything up by name.
+//
+//usage:
+//  bake-level <in.scene> <in.pnct> <out.level>
+
+#include "Scene.hpp"
+#include "Mesh.hpp"
+#include "MappedFile.hpp"
+#include "SceneFile.hpp"
+#include "read_write_chunk.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+
+	if (argc != 4) {
+		std::cerr << "Usage:\n\t" << argv[0] << " <in.scene> <in.pnct> <out.level>" << std::endl;
+		return 1;
+	}
+	std::string scene_file = argv[1];
+	std::string mesh_file = argv[2];
+	std::string level_file = argv[3];
+
+	std::map< std::string, Mesh > meshes = MeshBuffer::read_meshes(mesh_file);
+
+	//load the scene (to compute world transforms), remembering which meshes it asks for:
+	Scene scene;
+	std::vector< std::pair< Scene::Transform *, std::string > > mesh_refs;
+	scene.load(scene_file, [&](Scene &, Scene::Transform *transform, std::string const &mesh_name) {
+		mesh_refs.emplace_back(transform, mesh_name);
+	});
+
+	//index of each transform (Scene::load creates them in hierarchy order):
+	std::unordered_map< Scene::Transform const *, uint32_t > transform_index;
+	std::vector< Scene::Transform const * > hierarchy_transforms;
+	for (auto const &t : scene.transforms) {
+		transform_index.emplace(&t, uint32_t(hierarchy_transforms.size()));
+		hierarchy_transforms.emplace_back(&t);
+	}
+
+	//also read the raw chunks that are passed through unchanged:
+	MappedFile file(scene_file);
+	char const *at = file.begin();
+	std::vector< char > names_storage;
+	ChunkView< char > names = read_chunk(at, file.end(), "str0", &names_storage);
+	std::vector< SceneFile::HierarchyEntry > hierarchy_storage;
+	ChunkView< SceneFile::HierarchyEntry > hierarchy = read_chunk(at, file.end(), "xfh0", &hierarchy_storage);
+	std::vector< SceneFile::MeshEntry > meshes_storage;
+	read_chunk(at, file.end(), "msh0", &meshes_storage);
+	std::vector< SceneFile::CameraEntry > cameras_storage;
+	ChunkView< SceneFile::CameraEntry > cameras = read_chunk(at, file.end(), "cam0", &cameras_storage);
+	std::vector< SceneFile::LightEntry > lights_storage;
+	ChunkView< SceneFile::LightEntry > lights = read_chunk(at, file.end(), "lmp0", &lights_storage);
+
+	if (hierarchy.size() != hierarchy_transforms.size()) {
+		throw std::runtime_error("Scene '" + scene_file + "' loaded " + std::to_string(hierarchy_transforms.size()) + " transforms from " + std::to_string(hierarchy.size()) + " hierarchy entries.");
+	}
+
+	//resolve drawables:
+	std::vector< SceneFile::DrawableEntry > drawables;
+	std::vector< SceneFile::LODEntry > lods;
+	drawables.reserve(mesh_refs.size());
+	lods.reserve(mesh_refs.size());
+	for (auto const &ref : mesh_refs) {
+		auto f = meshes.find(ref.second);
+		if (f == meshes.end()) {
+			throw std::runtime_error("Scene '" + scene_file + "' uses mesh '" + ref.second + "', which is not in '" + mesh_file + "'.");
+		}
+		Mesh const &mesh = f->second;
+
+		SceneFile::DrawableEntry entry;
+		entry.transform = transform_index.at(ref.first);
+		entry.type = mesh.type;
+		entry.start = mesh.start;
+		entry.count = mesh.count;
+		entry.min = mesh.min;
+		entry.max = mesh.max;
+
+		//world-space bounds of the object-space box's corners:
+		glm::mat4x3 to_world = ref.first->make_local_to_world();
+		entry.world_min = glm::vec3( std::numeric_limits< float >::infinity());
+		entry.world_max = glm::vec3(-std::numeric_limits< float >::infinity());
+		if (mesh.min.x <= mesh.max.x && mesh.min.y <= mesh.max.y && mesh.min.z <= mesh.max.z) {
+			for (uint32_t c = 0; c < 8; ++c) {
+				glm::vec3 corner = to_world * glm::vec4(
+					(c & 1 ? mesh.max.x : mesh.min.x),
+					(c & 2 ? mesh.max.y : mesh.min.y),
+					(c & 4 ? mesh.max.z : mesh.min.z),
+					1.0f
+				);
+				entry.world_min = glm::min(entry.world_min, corner);
+				entry.world_max = glm::max(entry.world_max, corner);
+			}
+		}
+
+		drawables.emplace_back(entry);
+
+		SceneFile::LODEntry lod;
+		lod.count = mesh.lods.count;
+		for (uint32_t i = 0; i < MeshLODs::Max; ++i) {
+			lod.levels[i].start = (i < mesh.lods.count ? mesh.lods.levels[i].start : 0);
+			lod.levels[i].count = (i < mesh.lods.count ? mesh.lods.levels[i].count : 0);
+		}
+		lods.emplace_back(lod);
+	}
+
+	//draw order: drawables sharing a mesh end up next to each other (so Scene::draw can instance them):
+	std::vector< uint32_t > order;
+	order.reserve(drawables.size());
+	for (uint32_t i = 0; i < drawables.size(); ++i) {
+		order.emplace_back(i);
+	}
+	std::stable_sort(order.begin(), order.end(), [&drawables](uint32_t ai, uint32_t bi) {
+		SceneFile::DrawableEntry const &a = drawables[ai];
+		SceneFile::DrawableEntry const &b = drawables[bi];
+		if (a.type != b.type) return a.type < b.type;
+		if (a.start != b.start) return a.start < b.start;
+		return a.count < b.count;
+	});
+	{
+		std::vector< SceneFile::DrawableEntry > sorted_drawables;
+		std::vector< SceneFile::LODEntry > sorted_lods;
+		sorted_drawables.reserve(order.size());
+		sorted_lods.reserve(order.size());
+		for (uint32_t i : order) {
+			sorted_drawables.emplace_back(drawables[i]);
+			sorted_lods.emplace_back(lods[i]);
+		}
+		drawables = std::move(sorted_drawables);
+		lods = std::move(sorted_lods);
+	}
+
+	//name ids, in order of first use, and ids in name order:
+	std::vector< uint32_t > name_ids;
+	std::vector< std::string const * > id_names;
+	{
+		std::unordered_map< std::string, uint32_t > ids;
+		for (auto const *t : hierarchy_transforms) {
+			auto ret = ids.emplace(t->name, uint32_t(id_names.size()));
+			if (ret.second) id_names.emplace_back(&t->name);
+			name_ids.emplace_back(ret.first->second);
+		}
+	}
+	std::vector< uint32_t > sorted;
+	sorted.reserve(id_names.size());
+	for (uint32_t id = 0; id < id_names.size(); ++id) {
+		sorted.emplace_back(id);
+	}
+	std::sort(sorted.begin(), sorted.end(), [&](uint32_t a, uint32_t b) {
+		return *id_names[a] < *id_names[b];
+	});
+
+	//write it all out:
+	std::ofstream out(level_file, std::ios::binary);
+	write_chunk("str0", std::vector< char >(names.begin(), names.end()), &out);
+	write_chunk("xfh0", std::vector< SceneFile::HierarchyEntry >(hierarchy.begin(), hierarchy.end()), &out);
+	write_chunk("drw1", drawables, &out);
+	write_chunk("lod0", lods, &out);
+	write_chunk("nid0", name_ids, &out);
+	write_chunk("nam0", sorted, &out);
+	write_chunk("cam0", std::vector< SceneFile::CameraEntry >(cameras.begin(), cameras.end()), &out);
+	write_chunk("lmp0", std::vector< SceneFile::LightEntry >(lights.begin(), lights.end()), &out);
+	if (!out) {
+		throw std::runtime_error("Failed to write '" + level_file + "'.");
+	}
+
+	std::cout << "Wrote " << level_file << ": " << hierarchy_transforms.size() << " transforms, " << drawables.size() << " drawables." << std::endl;
+
+	return 0;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
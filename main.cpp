@@ -168,6 +168,9 @@ int main(int argc, char **argv) {
 			if (!Mode::current) break;
 		}
 
+		//finish any asynchronous loads (OpenGL uploads) that are waiting, within a small time budget:
+		update_async_loads();
+
 		{ //(2) call the current mode's "update" function to deal with elapsed time:
 			auto current_time = std::chrono::high_resolution_clock::now();
 			static auto previous_time = current_time;
@@ -0,0 +1,616 @@
+#include "mesh_optimize.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+uint32_t index_vertices(void const *vertices_, size_t count, size_t stride, std::vector< uint32_t > *remap_) {
+	assert(remap_);
+	auto &remap = *remap_;
+	unsigned char const *vertices = reinterpret_cast< unsigned char const * >(vertices_);
+
+	remap.assign(count, -1U);
+
+	//open-addressing table of (first) vertex with each distinct value, sized to stay under half full:
+	size_t table_size = 16;
+	while (table_size < count * 2) table_size *= 2;
+	std::vector< uint32_t > table(table_size, -1U);
+
+	auto hash = [&](unsigned char const *vertex) -> size_t {
+		//FNV-1a:
+		uint32_t h = 2166136261u;
+		for (size_t b = 0; b < stride; ++b) {
+			h = (h ^ vertex[b]) * 16777619u;
+		}
+		return h;
+	};
+
+	uint32_t unique = 0;
+	for (size_t v = 0; v < count; ++v) {
+		unsigned char const *vertex = vertices + v * stride;
+		size_t slot = hash(vertex) & (table_size - 1);
+		while (true) {
+			uint32_t other = table[slot];
+			if (other == -1U) {
+				table[slot] = uint32_t(v);
+				remap[v] = unique++;
+				break;
+			}
+			if (std::memcmp(vertices + other * stride, vertex, stride) == 0) {
+				remap[v] = remap[other];
+				break;
+			}
+			slot = (slot + 1) & (table_size - 1);
+		}
+	}
+	return unique;
+}
+
+//--------------------------------
+//Forsyth's vertex cache optimization:
+// repeatedly emit the triangle with the best score, where a triangle's score is the sum of its
+// vertices' scores, and a vertex scores higher when it is recently used (in a simulated LRU cache)
+// and when it has few triangles left (so lone vertices get finished off rather than left behind).
+
+namespace {
+	constexpr uint32_t CacheSize = 32;
+	constexpr float CacheDecayPower = 1.5f;
+	constexpr float LastTriangleScore = 0.75f;
+	constexpr float ValenceBoostScale = 2.0f;
+	constexpr float ValenceBoostPower = 0.5f;
+
+	float vertex_score(int32_t cache_position, uint32_t remaining) {
+		if (remaining == 0) return -1.0f; //no triangles left; score doesn't matter
+
+		float score = 0.0f;
+		if (cache_position >= 0) {
+			if (cache_position < 3) {
+				//used by the last triangle; fixed score so there's no incentive to re-use it right away:
+				score = LastTriangleScore;
+			} else {
+				float scaler = 1.0f / float(CacheSize - 3);
+				score = std::pow(1.0f - float(cache_position - 3) * scaler, CacheDecayPower);
+			}
+		}
+		score += ValenceBoostScale * std::pow(float(remaining), -ValenceBoostPower);
+		return score;
+	}
+}
+
+void optimize_vertex_cache(uint32_t *indices, size_t index_count, uint32_t vertex_count) {
+	assert(index_count % 3 == 0);
+	size_t const triangle_count = index_count / 3;
+	if (triangle_count == 0) return;
+
+	//triangles using each vertex, as ranges in 'adjacency' (the first 'remaining' of each are not yet emitted):
+	std::vector< uint32_t > adjacency_begin(vertex_count + 1, 0);
+	for (size_t i = 0; i < index_count; ++i) {
+		assert(indices[i] < vertex_count);
+		adjacency_begin[indices[i] + 1] += 1;
+	}
+	for (uint32_t v = 0; v < vertex_count; ++v) {
+		adjacency_begin[v + 1] += adjacency_begin[v];
+	}
+	std::vector< uint32_t > remaining(vertex_count, 0);
+	std::vector< uint32_t > adjacency(index_count);
+	for (size_t i = 0; i < index_count; ++i) {
+		uint32_t v = indices[i];
+		adjacency[adjacency_begin[v] + remaining[v]] = uint32_t(i / 3);
+		remaining[v] += 1;
+	}
+
+	std::vector< int32_t > cache_position(vertex_count, -1);
+	std::vector< float > score(vertex_count);
+	for (uint32_t v = 0; v < vertex_count; ++v) {
+		score[v] = vertex_score(-1, remaining[v]);
+	}
+
+	std::vector< float > triangle_score(triangle_count);
+	std::vector< bool > emitted(triangle_count, false);
+	for (size_t t = 0; t < triangle_count; ++t) {
+		triangle_score[t] = score[indices[3*t+0]] + score[indices[3*t+1]] + score[indices[3*t+2]];
+	}
+
+	//cache contents (with room for the three vertices pushed in by each triangle):
+	uint32_t cache[CacheSize + 3];
+	uint32_t cache_count = 0;
+
+	std::vector< uint32_t > output;
+	output.reserve(index_count);
+
+	size_t best = 0;
+	for (size_t t = 1; t < triangle_count; ++t) {
+		if (triangle_score[t] > triangle_score[best]) best = t;
+	}
+	size_t scan = 0; //all triangles before this have been emitted (for finding a new start when stuck)
+
+	while (true) {
+		if (best == size_t(-1)) {
+			//nothing touching the cache is left; continue from any remaining triangle:
+			while (scan < triangle_count && emitted[scan]) ++scan;
+			if (scan == triangle_count) break;
+			best = scan;
+		}
+
+		//emit the triangle:
+		emitted[best] = true;
+		uint32_t const *tri = indices + 3 * best;
+		output.insert(output.end(), tri, tri + 3);
+
+		//remove it from its vertices' lists of remaining triangles:
+		for (uint32_t c = 0; c < 3; ++c) {
+			uint32_t v = tri[c];
+			uint32_t *list = adjacency.data() + adjacency_begin[v];
+			uint32_t *last = list + remaining[v] - 1;
+			*std::find(list, last + 1, uint32_t(best)) = *last;
+			remaining[v] -= 1;
+		}
+
+		//move its vertices to the front of the cache:
+		uint32_t new_cache[CacheSize + 3];
+		uint32_t new_count = 0;
+		for (uint32_t c = 0; c < 3; ++c) {
+			new_cache[new_count++] = tri[c];
+		}
+		for (uint32_t i = 0; i < cache_count; ++i) {
+			uint32_t v = cache[i];
+			if (v != tri[0] && v != tri[1] && v != tri[2]) new_cache[new_count++] = v;
+		}
+
+		//rescore the vertices that were in (or have just dropped out of) the cache, and their triangles:
+		best = size_t(-1);
+		float best_score = -1.0f;
+		for (uint32_t i = 0; i < new_count; ++i) {
+			uint32_t v = new_cache[i];
+			cache_position[v] = (i < CacheSize ? int32_t(i) : -1);
+			float delta = vertex_score(cache_position[v], remaining[v]) - score[v];
+			score[v] += delta;
+			uint32_t const *list = adjacency.data() + adjacency_begin[v];
+			for (uint32_t j = 0; j < remaining[v]; ++j) {
+				uint32_t t = list[j];
+				triangle_score[t] += delta;
+				if (triangle_score[t] > best_score) {
+					best_score = triangle_score[t];
+					best = t;
+				}
+			}
+		}
+
+		cache_count = std::min(new_count, CacheSize);
+		std::copy(new_cache, new_cache + cache_count, cache);
+	}
+
+	assert(output.size() == index_count);
+	std::copy(output.begin(), output.end(), indices);
+}
+
+//--------------------------------
+
+uint32_t optimize_vertex_fetch(uint32_t const *indices, size_t index_count, uint32_t vertex_count, std::vector< uint32_t > *remap_) {
+	assert(remap_);
+	auto &remap = *remap_;
+
+	remap.assign(vertex_count, -1U);
+	uint32_t next = 0;
+	for (size_t i = 0; i < index_count; ++i) {
+		assert(indices[i] < vertex_count);
+		if (remap[indices[i]] == -1U) remap[indices[i]] = next++;
+	}
+	uint32_t used = next;
+	for (auto &r : remap) {
+		if (r == -1U) r = next++;
+	}
+	return used;
+}
+
+float vertex_cache_acmr(uint32_t const *indices, size_t index_count, uint32_t vertex_count, uint32_t cache_size) {
+	if (index_count < 3) return 0.0f;
+
+	//FIFO cache, tracked by the time each vertex was last brought in:
+	std::vector< size_t > loaded(vertex_count, 0);
+	size_t misses = 0;
+	for (size_t i = 0; i < index_count; ++i) {
+		assert(indices[i] < vertex_count);
+		size_t &at = loaded[indices[i]];
+		if (at == 0 || misses + 1 - at > cache_size) {
+			misses += 1;
+			at = misses;
+		}
+	}
+	return float(misses) / float(index_count / 3);
+}
+
+//--------------------------------
+
+void build_clusters(uint32_t const *indices, size_t index_count, void const *positions_, size_t position_stride,
+	std::vector< TriangleCluster > *clusters_, uint32_t max_vertices, uint32_t max_triangles) {
+	assert(clusters_);
+	auto &clusters = *clusters_;
+	assert(max_vertices >= 3 && max_triangles >= 1);
+	unsigned char const *positions = reinterpret_cast< unsigned char const * >(positions_);
+	auto position = [&](uint32_t v) -> glm::vec3 {
+		glm::vec3 p;
+		std::memcpy(&p, positions + v * position_stride, sizeof(p));
+		return p;
+	};
+
+	//fill in bounds of the triangles in [begin, end):
+	std::vector< glm::vec3 > normals;
+	auto finish = [&](size_t begin, size_t end) {
+		TriangleCluster cluster;
+		cluster.start = uint32_t(begin);
+		cluster.count = uint32_t(end - begin);
+
+		//sphere around the center of the box:
+		glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+		glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+		for (size_t i = begin; i < end; ++i) {
+			glm::vec3 p = position(indices[i]);
+			min = glm::min(min, p);
+			max = glm::max(max, p);
+		}
+		cluster.center = 0.5f * (min + max);
+		float radius2 = 0.0f;
+		for (size_t i = begin; i < end; ++i) {
+			glm::vec3 d = position(indices[i]) - cluster.center;
+			radius2 = std::max(radius2, glm::dot(d, d));
+		}
+		cluster.radius = std::sqrt(radius2);
+
+		//normal cone around the average face normal:
+		normals.clear();
+		glm::vec3 sum = glm::vec3(0.0f);
+		for (size_t i = begin; i + 2 < end; i += 3) {
+			glm::vec3 a = position(indices[i]);
+			glm::vec3 n = glm::cross(position(indices[i+1]) - a, position(indices[i+2]) - a);
+			float length = glm::length(n);
+			if (!(length > 0.0f)) continue; //(degenerate triangles can't be seen either way)
+			normals.emplace_back(n / length);
+			sum += normals.back();
+		}
+		float sum_length = glm::length(sum);
+		if (!normals.empty() && sum_length > 0.0f) {
+			glm::vec3 axis = sum / sum_length;
+			float min_dot = 1.0f;
+			for (auto const &n : normals) {
+				min_dot = std::min(min_dot, glm::dot(n, axis));
+			}
+			//(cones wider than ~84 degrees would hardly ever cull, so don't bother with them)
+			if (min_dot > 0.1f) {
+				cluster.cone_axis = axis;
+				cluster.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+			}
+		}
+
+		clusters.emplace_back(cluster);
+	};
+
+	//vertices used by the cluster being built (marked with the cluster's first index + 1):
+	std::vector< size_t > used;
+	size_t begin = 0;
+	uint32_t vertex_count = 0;
+	for (size_t i = 0; i + 2 < index_count; i += 3) {
+		uint32_t fresh = 0;
+		for (uint32_t c = 0; c < 3; ++c) {
+			uint32_t v = indices[i+c];
+			if (v >= used.size()) used.resize(v + 1, 0);
+			if (used[v] != begin + 1) fresh += 1;
+		}
+		if (i > begin && (vertex_count + fresh > max_vertices || (i - begin) / 3 >= max_triangles)) {
+			finish(begin, i);
+			begin = i;
+			vertex_count = 0;
+		}
+		for (uint32_t c = 0; c < 3; ++c) {
+			uint32_t v = indices[i+c];
+			if (used[v] != begin + 1) {
+				used[v] = begin + 1;
+				vertex_count += 1;
+			}
+		}
+	}
+	if (index_count - index_count % 3 > begin) {
+		finish(begin, index_count - index_count % 3);
+	}
+}
+
+//--------------------------------
+//Quadric error metric simplification:
+// each position carries the sum of the quadrics (squared distance to plane) of its original triangles' planes,
+// and the cheapest collapse -- by the summed quadric of both ends, measured at the end that stays -- goes next.
+
+namespace {
+	//symmetric 4x4 matrix, sum over planes (n,d) of [n d]^T [n d] (upper triangle, row by row):
+	struct Quadric {
+		double m[10] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+
+		void add_plane(glm::vec3 const &n, float d_) {
+			double x = n.x, y = n.y, z = n.z, d = d_;
+			m[0] += x*x; m[1] += x*y; m[2] += x*z; m[3] += x*d;
+			m[4] += y*y; m[5] += y*z; m[6] += y*d;
+			m[7] += z*z; m[8] += z*d;
+			m[9] += d*d;
+		}
+		void add(Quadric const &o) {
+			for (uint32_t i = 0; i < 10; ++i) m[i] += o.m[i];
+		}
+		//sum of squared distances from p to the planes:
+		double error(glm::vec3 const &p) const {
+			double x = p.x, y = p.y, z = p.z;
+			double e = m[0]*x*x + m[4]*y*y + m[7]*z*z + m[9]
+				+ 2.0 * (m[1]*x*y + m[2]*x*z + m[5]*y*z + m[3]*x + m[6]*y + m[8]*z);
+			return std::max(e, 0.0); //(rounding can push exact fits below zero)
+		}
+	};
+}
+
+size_t simplify(uint32_t *destination, uint32_t const *indices, size_t index_count,
+	void const *vertices_, size_t vertex_count, size_t vertex_stride,
+	size_t attribute_offset, size_t attribute_size, size_t normal_offset,
+	size_t target_index_count, float max_error, float *result_error_) {
+	assert(destination);
+	assert(index_count % 3 == 0);
+	unsigned char const *vertices = reinterpret_cast< unsigned char const * >(vertices_);
+	auto read_vec3 = [&](uint32_t v, size_t offset) -> glm::vec3 {
+		glm::vec3 p;
+		std::memcpy(&p, vertices + v * vertex_stride + offset, sizeof(p));
+		return p;
+	};
+
+	//"wedges" are the vertices as the simplifier sees them (position + seam attributes), grouped by position:
+	std::vector< uint32_t > wedge_of; //vertex -> wedge
+	std::vector< uint32_t > position_of; //vertex -> position
+	uint32_t wedge_count, position_count;
+	{
+		size_t key_size = sizeof(glm::vec3) + attribute_size;
+		std::vector< unsigned char > keys(vertex_count * key_size);
+		for (size_t v = 0; v < vertex_count; ++v) {
+			std::memcpy(&keys[v * key_size], vertices + v * vertex_stride, sizeof(glm::vec3));
+			if (attribute_size) std::memcpy(&keys[v * key_size + sizeof(glm::vec3)], vertices + v * vertex_stride + attribute_offset, attribute_size);
+		}
+		wedge_count = index_vertices(keys.data(), vertex_count, key_size, &wedge_of);
+		for (size_t v = 0; v < vertex_count; ++v) {
+			std::memcpy(&keys[v * sizeof(glm::vec3)], vertices + v * vertex_stride, sizeof(glm::vec3));
+		}
+		position_count = index_vertices(keys.data(), vertex_count, sizeof(glm::vec3), &position_of);
+	}
+
+	std::vector< uint32_t > wedge_position(wedge_count, -1U);
+	std::vector< glm::vec3 > wedge_point(wedge_count);
+	std::vector< std::vector< uint32_t > > wedge_vertices(wedge_count); //original vertices of each wedge
+	for (uint32_t v = 0; v < vertex_count; ++v) {
+		uint32_t w = wedge_of[v];
+		if (wedge_position[w] == -1U) {
+			wedge_position[w] = position_of[v];
+			wedge_point[w] = read_vec3(v, 0);
+		}
+		wedge_vertices[w].emplace_back(v);
+	}
+
+	//triangles (as wedges, and as the original vertex at each corner), leaving out ones with no area:
+	std::vector< uint32_t > triangles; //wedges
+	std::vector< uint32_t > corners; //vertices
+	triangles.reserve(index_count);
+	corners.reserve(index_count);
+	for (size_t i = 0; i < index_count; i += 3) {
+		assert(indices[i+0] < vertex_count && indices[i+1] < vertex_count && indices[i+2] < vertex_count);
+		uint32_t p0 = position_of[indices[i+0]], p1 = position_of[indices[i+1]], p2 = position_of[indices[i+2]];
+		if (p0 == p1 || p1 == p2 || p2 == p0) continue;
+		for (uint32_t c = 0; c < 3; ++c) {
+			triangles.emplace_back(wedge_of[indices[i+c]]);
+			corners.emplace_back(indices[i+c]);
+		}
+	}
+	size_t const triangle_count = triangles.size() / 3;
+	std::vector< bool > triangle_alive(triangle_count, true);
+	size_t alive_count = triangle_count;
+
+	auto face_normal = [&](uint32_t t) -> glm::vec3 {
+		glm::vec3 a = wedge_point[triangles[3*t+0]];
+		return glm::cross(wedge_point[triangles[3*t+1]] - a, wedge_point[triangles[3*t+2]] - a);
+	};
+
+	//quadrics, and which positions are locked (seams, open edges, non-manifold edges):
+	std::vector< Quadric > quadrics(position_count);
+	std::vector< bool > locked(position_count, false);
+	{
+		std::vector< uint32_t > position_wedges(position_count, 0);
+		for (uint32_t w = 0; w < wedge_count; ++w) {
+			if (wedge_position[w] != -1U) position_wedges[wedge_position[w]] += 1;
+		}
+		for (uint32_t p = 0; p < position_count; ++p) {
+			if (position_wedges[p] > 1) locked[p] = true;
+		}
+
+		std::vector< uint64_t > edges;
+		edges.reserve(triangles.size());
+		for (size_t t = 0; t < triangle_count; ++t) {
+			glm::vec3 n = face_normal(uint32_t(t));
+			float length = glm::length(n);
+			if (length > 0.0f) {
+				n /= length;
+				float d = -glm::dot(n, wedge_point[triangles[3*t]]);
+				for (uint32_t c = 0; c < 3; ++c) {
+					quadrics[wedge_position[triangles[3*t+c]]].add_plane(n, d);
+				}
+			}
+			for (uint32_t c = 0; c < 3; ++c) {
+				uint32_t a = wedge_position[triangles[3*t+c]];
+				uint32_t b = wedge_position[triangles[3*t+(c+1)%3]];
+				edges.emplace_back((uint64_t(std::min(a,b)) << 32) | std::max(a,b));
+			}
+		}
+		//every edge should show up exactly twice; anything else is an edge that must not move:
+		std::sort(edges.begin(), edges.end());
+		for (size_t i = 0; i < edges.size(); ) {
+			size_t j = i + 1;
+			while (j < edges.size() && edges[j] == edges[i]) ++j;
+			if (j - i != 2) {
+				locked[uint32_t(edges[i] >> 32)] = true;
+				locked[uint32_t(edges[i] & 0xffffffff)] = true;
+			}
+			i = j;
+		}
+	}
+
+	//triangles around each wedge (dead ones get pruned as they're noticed):
+	std::vector< std::vector< uint32_t > > wedge_triangles(wedge_count);
+	for (size_t t = 0; t < triangle_count; ++t) {
+		for (uint32_t c = 0; c < 3; ++c) {
+			wedge_triangles[triangles[3*t+c]].emplace_back(uint32_t(t));
+		}
+	}
+	auto prune = [&](uint32_t w) {
+		auto &list = wedge_triangles[w];
+		list.erase(std::remove_if(list.begin(), list.end(), [&](uint32_t t){ return !triangle_alive[t]; }), list.end());
+	};
+	auto neighbors = [&](uint32_t w, std::vector< uint32_t > *out) {
+		out->clear();
+		for (uint32_t t : wedge_triangles[w]) {
+			for (uint32_t c = 0; c < 3; ++c) {
+				uint32_t o = triangles[3*t+c];
+				if (o != w) out->emplace_back(o);
+			}
+		}
+		std::sort(out->begin(), out->end());
+		out->erase(std::unique(out->begin(), out->end()), out->end());
+	};
+
+	//would moving wedge a onto neighbor b keep the surface a manifold, with no triangles folding over?
+	std::vector< uint32_t > around_a, around_b;
+	auto can_collapse = [&](uint32_t a, uint32_t b) -> bool {
+		//link condition: the only shared neighbors are the far corners of the triangles on edge a-b:
+		uint32_t shared_triangles = 0;
+		for (uint32_t t : wedge_triangles[a]) {
+			if (triangles[3*t+0] == b || triangles[3*t+1] == b || triangles[3*t+2] == b) shared_triangles += 1;
+		}
+		neighbors(b, &around_b);
+		uint32_t shared_neighbors = 0;
+		for (uint32_t o : around_a) {
+			if (std::binary_search(around_b.begin(), around_b.end(), o)) shared_neighbors += 1;
+		}
+		if (shared_neighbors != shared_triangles) return false;
+
+		//no remaining triangle turns more than ~75 degrees:
+		for (uint32_t t : wedge_triangles[a]) {
+			uint32_t const *tri = &triangles[3*t];
+			if (tri[0] == b || tri[1] == b || tri[2] == b) continue;
+			glm::vec3 p[3];
+			for (uint32_t c = 0; c < 3; ++c) {
+				p[c] = wedge_point[tri[c] == a ? b : tri[c]];
+			}
+			glm::vec3 before = face_normal(t);
+			glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+			if (glm::dot(after, before) <= 0.25f * glm::length(after) * glm::length(before)) return false;
+		}
+		return true;
+	};
+
+	//best collapse for each wedge, kept in a heap (entries go stale when their wedge's version changes):
+	std::vector< uint32_t > target(wedge_count, -1U);
+	std::vector< uint32_t > version(wedge_count, 0);
+	std::vector< bool > wedge_alive(wedge_count, true);
+	struct Candidate {
+		double cost;
+		uint32_t wedge;
+		uint32_t version;
+		bool operator<(Candidate const &o) const { return cost > o.cost; } //(so the heap's top is the cheapest)
+	};
+	std::vector< Candidate > heap;
+
+	auto consider = [&](uint32_t a) {
+		version[a] += 1;
+		target[a] = -1U;
+		if (!wedge_alive[a] || locked[wedge_position[a]]) return;
+		prune(a);
+		neighbors(a, &around_a);
+		double best = std::numeric_limits< double >::infinity();
+		for (uint32_t b : around_a) {
+			Quadric q = quadrics[wedge_position[a]];
+			q.add(quadrics[wedge_position[b]]);
+			double cost = q.error(wedge_point[b]);
+			if (cost >= best) continue;
+			prune(b);
+			if (!can_collapse(a, b)) continue;
+			best = cost;
+			target[a] = b;
+		}
+		if (target[a] != -1U) {
+			heap.emplace_back(Candidate{ best, a, version[a] });
+			std::push_heap(heap.begin(), heap.end());
+		}
+	};
+	for (uint32_t w = 0; w < wedge_count; ++w) {
+		if (!wedge_triangles[w].empty()) consider(w);
+	}
+
+	double const max_cost = double(max_error) * double(max_error);
+	double result_cost = 0.0;
+	std::vector< uint32_t > touched;
+	while (alive_count * 3 > target_index_count && !heap.empty()) {
+		Candidate next = heap.front();
+		std::pop_heap(heap.begin(), heap.end());
+		heap.pop_back();
+		if (next.version != version[next.wedge]) continue;
+		if (next.cost > max_cost) break;
+
+		uint32_t a = next.wedge;
+		uint32_t b = target[a];
+		assert(b != -1U);
+
+		//move a onto b:
+		for (uint32_t t : wedge_triangles[a]) {
+			if (!triangle_alive[t]) continue;
+			uint32_t *tri = &triangles[3*t];
+			if (tri[0] == b || tri[1] == b || tri[2] == b) {
+				triangle_alive[t] = false;
+				alive_count -= 1;
+				continue;
+			}
+			uint32_t c = (tri[0] == a ? 0 : (tri[1] == a ? 1 : 2));
+			tri[c] = b;
+			//pick the copy of b that suits this triangle:
+			uint32_t corner = wedge_vertices[b][0];
+			if (normal_offset != size_t(-1) && wedge_vertices[b].size() > 1) {
+				glm::vec3 n = face_normal(t);
+				float best = -std::numeric_limits< float >::infinity();
+				for (uint32_t v : wedge_vertices[b]) {
+					float d = glm::dot(read_vec3(v, normal_offset), n);
+					if (d > best) {
+						best = d;
+						corner = v;
+					}
+				}
+			}
+			corners[3*t+c] = corner;
+			wedge_triangles[b].emplace_back(t);
+		}
+		wedge_triangles[a].clear();
+		wedge_alive[a] = false;
+		version[a] += 1;
+		quadrics[wedge_position[b]].add(quadrics[wedge_position[a]]);
+		result_cost = std::max(result_cost, next.cost);
+
+		//everything around b has a new neighborhood:
+		prune(b);
+		neighbors(b, &touched);
+		consider(b);
+		for (uint32_t o : touched) {
+			consider(o);
+		}
+	}
+
+	if (result_error_) *result_error_ = float(std::sqrt(result_cost));
+
+	size_t written = 0;
+	for (size_t t = 0; t < triangle_count; ++t) {
+		if (!triangle_alive[t]) continue;
+		destination[written++] = corners[3*t+0];
+		destination[written++] = corners[3*t+1];
+		destination[written++] = corners[3*t+2];
+	}
+	assert(written == alive_count * 3);
+	return written;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+/*
+ * Helpers for turning triangle soup into indexed triangle lists that draw efficiently:
+ *  - index_vertices() merges vertices that are exactly equal;
+ *  - optimize_vertex_cache() reorders triangles so the GPU's post-transform cache
+ *    gets more hits (Tom Forsyth's "Linear-Speed Vertex Cache Optimisation");
+ *  - optimize_vertex_fetch() renumbers vertices in order of first use, so vertex
+ *    fetches walk forward through the buffer.
+ *  - build_clusters() cuts a (cache-ordered) triangle list into small runs of
+ *    nearby triangles with bounds, so renderers can cull big meshes piece by piece.
+ *  - simplify() collapses edges of a triangle list by quadric error (Garland and
+ *    Heckbert's "Surface Simplification Using Quadric Error Metrics"), for making
+ *    coarser levels of detail.
+ *
+ * None of these touch OpenGL, so offline tools can use them too.
+ *
+ */
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//find bytewise-identical vertices among 'count' vertices of 'stride' bytes each:
+// fills *remap_ with the new index of each vertex (numbered in order of first appearance)
+// and returns the number of distinct vertices.
+uint32_t index_vertices(void const *vertices, size_t count, size_t stride, std::vector< uint32_t > *remap_);
+
+//reorder the triangles of an indexed triangle list in place for the post-transform vertex cache:
+// (all indices must be less than vertex_count; index_count must be a multiple of three)
+void optimize_vertex_cache(uint32_t *indices, size_t index_count, uint32_t vertex_count);
+
+//renumber vertices in the order the indices first use them:
+// fills *remap_ with the new index of each vertex (unused vertices are numbered last) and returns
+// the number of vertices that were used. (Rewriting the indices and moving the vertices is up to the caller.)
+uint32_t optimize_vertex_fetch(uint32_t const *indices, size_t index_count, uint32_t vertex_count, std::vector< uint32_t > *remap_);
+
+//average number of vertices transformed per triangle by a FIFO cache of 'cache_size' entries:
+// (0.5 is ideal for large regular meshes, 3.0 means no reuse; handy to check the above did its job)
+float vertex_cache_acmr(uint32_t const *indices, size_t index_count, uint32_t vertex_count, uint32_t cache_size = 16);
+
+//a run of triangles in an indexed triangle list, with bounds for culling:
+struct TriangleCluster {
+	uint32_t start = 0; //first index
+	uint32_t count = 0; //number of indices
+	glm::vec3 center = glm::vec3(0.0f); //bounding sphere of the triangles
+	float radius = 0.0f;
+	//every triangle's (counterclockwise) normal n has dot(n, cone_axis) >= sqrt(1 - cone_cutoff^2);
+	// cone_cutoff >= 1 means the normals are too spread out to say anything:
+	glm::vec3 cone_axis = glm::vec3(0.0f, 0.0f, 1.0f);
+	float cone_cutoff = 2.0f;
+};
+static_assert(sizeof(TriangleCluster) == 4 + 4 + 4*3 + 4 + 4*3 + 4, "TriangleCluster is packed.");
+
+//cut the triangles of an indexed triangle list into runs (in order, so the index list isn't changed) of at
+// most max_triangles triangles using at most max_vertices distinct vertices, appending them to *clusters_:
+// (cluster ranges are relative to 'indices'; vertex positions are read from 'positions' + index * position_stride)
+void build_clusters(uint32_t const *indices, size_t index_count, void const *positions, size_t position_stride,
+	std::vector< TriangleCluster > *clusters_, uint32_t max_vertices = 96, uint32_t max_triangles = 128);
+
+//simplify an indexed triangle list, writing the result to 'destination' (room for index_count indices) and
+// returning the number of indices written; stops once at most target_index_count indices are left, or when
+// the next collapse would cost more than max_error (roughly, a distance) -- *result_error_ (optional) gets the
+// largest cost paid. Vertices are 'vertex_stride' bytes each and start with a glm::vec3 position:
+// - vertices are only ever moved onto neighboring vertices, so the result uses a subset of the original vertices;
+// - vertices at the same position whose 'attribute_size' bytes at 'attribute_offset' match (e.g., color and
+//   texcoord) are treated as one, while positions with more than one such vertex (attribute seams), and
+//   positions on open or non-manifold edges, never move;
+// - if normal_offset isn't -1, triangles that gain a vertex use the copy whose glm::vec3 normal (at
+//   'normal_offset') best matches the triangle's, which keeps flat-shaded faces flat.
+size_t simplify(uint32_t *destination, uint32_t const *indices, size_t index_count,
+	void const *vertices, size_t vertex_count, size_t vertex_stride,
+	size_t attribute_offset, size_t attribute_size, size_t normal_offset,
+	size_t target_index_count, float max_error, float *result_error_ = nullptr);
@@ -0,0 +1,276 @@
+//optimize-meshes: reads a .pnct file and writes an indexed .pnct file (see Mesh.hpp) in which each mesh
+// has been given coarser levels of detail ("<name>_LOD1", "<name>_LOD2", ...) by quadric error
+// simplification (see simplify in mesh_optimize.hpp), with every level ordered for the vertex cache
+// and big meshes cut into clusters.
+//
+//usage:
+//  optimize-meshes [--ratios 0.5,0.25,0.125] [--max-error 0.02] [--threads N] <in.pnct> <out.pnct>
+//
+// --ratios     triangle count of each level, as a fraction of the mesh's (at most MeshLODs::Max levels)
+// --max-error  stop simplifying a level early once collapses would move the surface by more than this
+//              fraction of the mesh's bounding box diagonal (so flat meshes shrink more than curvy ones)
+// --threads    meshes are simplified in parallel, one per thread (default: one thread per core)
+//
+//Levels never move vertices or invent new ones, so they share their mesh's vertex data; the vertices
+// are written out unchanged. Meshes that already have levels of detail in the file are passed through.
+
+#include "Mesh.hpp"
+#include "mesh_optimize.hpp"
+#include "read_write_chunk.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+
+	std::vector< float > ratios{ 0.5f, 0.25f, 0.125f };
+	float max_error = 0.02f;
+	uint32_t thread_count = std::max(1U, std::thread::hardware_concurrency());
+	std::vector< std::string > files;
+
+	bool usage = false;
+	//numbers must be numbers all the way through (std::stof alone would take "0.5x" as 0.5):
+	auto parse_float = [](std::string const &str) {
+		size_t used = 0;
+		float value = std::stof(str, &used);
+		if (used != str.size()) throw std::invalid_argument(str);
+		return value;
+	};
+	auto parse_int = [](std::string const &str) {
+		size_t used = 0;
+		int value = std::stoi(str, &used);
+		if (used != str.size()) throw std::invalid_argument(str);
+		return value;
+	};
+	for (int argi = 1; argi < argc && !usage; ++argi) {
+		std::string arg = argv[argi];
+		try {
+			if (arg == "--ratios" && argi + 1 < argc) {
+				ratios.clear();
+				std::string list = argv[++argi];
+				for (size_t begin = 0; begin <= list.size(); ) {
+					size_t end = list.find(',', begin);
+					if (end == std::string::npos) end = list.size();
+					float ratio = parse_float(list.substr(begin, end - begin));
+					if (!(ratio > 0.0f && ratio < 1.0f)) throw std::runtime_error("ratios should be between 0 and 1, not '" + list.substr(begin, end - begin) + "'.");
+					ratios.emplace_back(ratio);
+					begin = end + 1;
+				}
+				if (ratios.size() > MeshLODs::Max) throw std::runtime_error("at most " + std::to_string(MeshLODs::Max) + " levels of detail are supported.");
+				std::sort(ratios.begin(), ratios.end(), [](float a, float b) { return a > b; });
+			} else if (arg == "--max-error" && argi + 1 < argc) {
+				max_error = parse_float(argv[++argi]);
+			} else if (arg == "--threads" && argi + 1 < argc) {
+				thread_count = std::max(1, parse_int(argv[++argi]));
+			} else if (arg.size() >= 2 && arg.substr(0, 2) == "--") {
+				usage = true;
+			} else {
+				files.emplace_back(arg);
+			}
+		} catch (std::invalid_argument const &) {
+			std::cerr << "Expecting a number after '" << arg << "', not '" << argv[argi] << "'." << std::endl;
+			usage = true;
+		} catch (std::out_of_range const &) {
+			std::cerr << "The number after '" << arg << "' ('" << argv[argi] << "') is out of range." << std::endl;
+			usage = true;
+		}
+	}
+	if (usage || files.size() != 2) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [--ratios 0.5,0.25,0.125] [--max-error 0.02] [--threads N] <in.pnct> <out.pnct>" << std::endl;
+		return 1;
+	}
+	std::string in_file = files[0];
+	std::string out_file = files[1];
+
+	std::vector< MeshBuffer::Vertex > vertices;
+	std::vector< uint32_t > indices;
+	std::map< std::string, Mesh > meshes = MeshBuffer::read_indexed(in_file, &vertices, &indices);
+
+	//one job per index range (names that share a range share the result):
+	struct Job {
+		Mesh mesh;
+		std::vector< std::string > names; //names of the range
+		std::vector< std::string > bases; //...without any "_LOD0" (levels are named after these)
+		bool simplify = true; //(false: already has levels of detail, or is one)
+		std::vector< std::vector< uint32_t > > levels; //indices of level 0, 1, ...
+		std::vector< float > errors; //error paid for each level
+	};
+	std::vector< Job > jobs;
+	{
+		std::map< std::pair< GLuint, GLuint >, size_t > job_of;
+		for (auto const &named : meshes) {
+			Mesh const &mesh = named.second;
+			if (mesh.type != GL_TRIANGLES) throw std::runtime_error("mesh '" + named.first + "' isn't triangles.");
+			auto ret = job_of.emplace(std::make_pair(mesh.start, mesh.count), jobs.size());
+			if (ret.second) {
+				jobs.emplace_back();
+				jobs.back().mesh = mesh;
+			}
+			Job &job = jobs[ret.first->second];
+
+			//"<name>_LOD0" is level 0 of "<name>"; other levels (and meshes that have them) are left alone:
+			std::string base = named.first;
+			size_t at = base.rfind("_LOD");
+			if (at != std::string::npos && at + 4 < base.size() && base.find_first_not_of("0123456789", at + 4) == std::string::npos) {
+				if (base.substr(at + 4) == "0") base = base.substr(0, at);
+				else job.simplify = false;
+			}
+			if (mesh.lods.count != 0) job.simplify = false;
+			job.names.emplace_back(named.first);
+			job.bases.emplace_back(base);
+		}
+	}
+
+	//simplify, one mesh per thread at a time:
+	std::atomic< size_t > next_job(0);
+	auto work = [&]() {
+		while (true) {
+			size_t j = next_job++;
+			if (j >= jobs.size()) break;
+			Job &job = jobs[j];
+			Mesh const &mesh = job.mesh;
+
+			//(work in the mesh's own vertex range, so each job only looks at its own vertices)
+			std::vector< uint32_t > level(indices.begin() + mesh.start, indices.begin() + mesh.start + mesh.count);
+			if (!job.simplify || level.empty()) {
+				job.levels.emplace_back(std::move(level));
+				continue;
+			}
+			for (auto &i : level) {
+				i -= mesh.vertex_start;
+			}
+			optimize_vertex_cache(level.data(), level.size(), mesh.vertex_count);
+
+			MeshBuffer::Vertex const *first = vertices.data() + mesh.vertex_start;
+			float error_limit = max_error * glm::length(mesh.max - mesh.min);
+			size_t triangles = level.size() / 3;
+			job.levels.emplace_back(level);
+			job.errors.emplace_back(0.0f);
+			for (float ratio : ratios) {
+				size_t target = 3 * size_t(ratio * triangles);
+				std::vector< uint32_t > coarser(level.size());
+				float error = 0.0f;
+				coarser.resize(simplify(coarser.data(), level.data(), level.size(),
+					first, mesh.vertex_count, sizeof(MeshBuffer::Vertex),
+					offsetof(MeshBuffer::Vertex, Color), sizeof(glm::u8vec4) + sizeof(glm::vec2), //(color and texcoord are next to each other)
+					offsetof(MeshBuffer::Vertex, Normal),
+					target, error_limit, &error));
+				//(no point in a level that isn't any cheaper to draw than the last)
+				if (coarser.empty() || coarser.size() >= level.size() * 9 / 10) break;
+				optimize_vertex_cache(coarser.data(), coarser.size(), mesh.vertex_count);
+				level = coarser;
+				job.levels.emplace_back(std::move(coarser));
+				job.errors.emplace_back(error);
+			}
+
+			for (auto &l : job.levels) {
+				for (auto &i : l) {
+					i += mesh.vertex_start;
+				}
+			}
+		}
+	};
+	{
+		std::vector< std::thread > threads;
+		for (uint32_t t = 1; t < std::min< size_t >(thread_count, jobs.size()); ++t) {
+			threads.emplace_back(work);
+		}
+		work();
+		for (auto &thread : threads) {
+			thread.join();
+		}
+	}
+
+	//gather the levels into one index list (and clusters for the big ones):
+	struct IndexEntry {
+		uint32_t name_begin, name_end;
+		uint32_t index_begin, index_end;
+	};
+	static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+
+	std::vector< char > strings;
+	std::vector< IndexEntry > index;
+	std::vector< uint32_t > out_indices;
+	std::vector< TriangleCluster > clusters;
+	std::set< std::string > written; //(so "<name>" and "<name>_LOD0" don't both get levels)
+	for (auto const &job : jobs) {
+		std::vector< std::pair< uint32_t, uint32_t > > ranges;
+		for (auto const &level : job.levels) {
+			uint32_t begin = uint32_t(out_indices.size());
+			out_indices.insert(out_indices.end(), level.begin(), level.end());
+			ranges.emplace_back(begin, uint32_t(out_indices.size()));
+		}
+		if (ranges[0].second - ranges[0].first >= 3 * MeshBuffer::ClusterMinTriangles) {
+			size_t begin = clusters.size();
+			build_clusters(out_indices.data() + ranges[0].first, ranges[0].second - ranges[0].first, vertices.data(), sizeof(MeshBuffer::Vertex), &clusters);
+			for (size_t c = begin; c < clusters.size(); ++c) {
+				clusters[c].start += ranges[0].first;
+			}
+		}
+
+		auto add = [&](std::string const &name, std::pair< uint32_t, uint32_t > const &range) {
+			if (!written.emplace(name).second) return;
+			IndexEntry entry;
+			entry.name_begin = uint32_t(strings.size());
+			strings.insert(strings.end(), name.begin(), name.end());
+			entry.name_end = uint32_t(strings.size());
+			entry.index_begin = range.first;
+			entry.index_end = range.second;
+			index.emplace_back(entry);
+		};
+		for (std::string const &name : job.names) {
+			add(name, ranges[0]);
+		}
+		for (std::string const &name : job.bases) {
+			for (size_t l = 1; l < ranges.size(); ++l) {
+				add(name + "_LOD" + std::to_string(l), ranges[l]);
+			}
+		}
+
+		if (job.simplify && !job.levels[0].empty()) {
+			std::cout << job.bases[0] << ": " << job.levels[0].size() / 3;
+			for (size_t l = 1; l < job.levels.size(); ++l) {
+				std::cout << " -> " << job.levels[l].size() / 3 << " (error " << job.errors[l] << ")";
+			}
+			std::cout << " triangles" << std::endl;
+		}
+	}
+
+	//write it all out:
+	std::ofstream out(out_file, std::ios::binary);
+	write_chunk("pnct", vertices, &out);
+	write_chunk("str0", strings, &out);
+	write_chunk("idx0", index, &out);
+	write_chunk("ind0", out_indices, &out);
+	if (!clusters.empty()) write_chunk("cls0", clusters, &out);
+	if (!out) {
+		throw std::runtime_error("Failed to write '" + out_file + "'.");
+	}
+
+	std::cout << "Wrote " << out_file << ": " << vertices.size() << " vertices, " << out_indices.size() / 3 << " triangles in " << index.size() << " meshes." << std::endl;
+
+	return 0;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
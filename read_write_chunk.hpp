@@ -4,6 +4,9 @@
 #include <vector>
 #include <stdexcept>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <string>
 
 //helper function that reads an array of structures preceded by a simple header:
 //Expected format:
@@ -41,6 +44,64 @@ void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *
 }
 
 
+//read-only view of an array of T's (e.g., a chunk parsed in place from memory):
+template< typename T >
+struct ChunkView {
+	T const *data = nullptr;
+	size_t count = 0;
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	T const &operator[](size_t i) const { assert(i < count); return data[i]; }
+	T const *begin() const { return data; }
+	T const *end() const { return data + count; }
+};
+
+//helper function that reads a chunk (same format as above) in place from memory -- e.g., a MappedFile:
+// 'at' is advanced past the chunk; the returned view points into [at,end) when it is suitably
+// aligned for T, otherwise the data is copied into *storage_ (which must outlive the view).
+template< typename T >
+ChunkView< T > read_chunk(char const *&at, char const *end, std::string const &magic, std::vector< T > *storage_) {
+	assert(storage_);
+	auto &storage = *storage_;
+
+	struct ChunkHeader {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		uint32_t size = 0;
+	};
+	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+	ChunkHeader header;
+	if (size_t(end - at) < sizeof(header)) {
+		throw std::runtime_error("Failed to read chunk header");
+	}
+	std::memcpy(&header, at, sizeof(header));
+	at += sizeof(header);
+	if (std::string(header.magic,4) != magic) {
+		throw std::runtime_error("Unexpected magic number in chunk");
+	}
+
+	if (header.size % sizeof(T) != 0) {
+		throw std::runtime_error("Size of chunk not divisible by element size");
+	}
+	if (size_t(end - at) < header.size) {
+		throw std::runtime_error("Failed to read chunk data.");
+	}
+
+	ChunkView< T > view;
+	view.count = header.size / sizeof(T);
+	if (reinterpret_cast< uintptr_t >(at) % alignof(T) == 0) {
+		view.data = reinterpret_cast< T const * >(at);
+	} else {
+		//(chunks after one whose size isn't a multiple of 4 -- e.g., after str0 -- can be misaligned)
+		storage.resize(view.count);
+		std::memcpy(storage.data(), at, header.size);
+		view.data = storage.data();
+	}
+	at += header.size;
+	return view;
+}
+
 //helper function to write a chunk of data in the same format as read_chunk:
 template< typename T >
 void write_chunk(std::string const &magic, std::vector< T > const &from, std::ostream *to_) {
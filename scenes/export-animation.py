@@ -0,0 +1,163 @@
+#!/usr/bin/env python
+
+#Note: Script meant to be executed from within blender 2.9, as per:
+#blender --background --python export-animation.py -- [...see below...]
+
+import sys,re
+
+args = []
+for i in range(0,len(sys.argv)):
+	if sys.argv[i] == '--':
+		args = sys.argv[i+1:]
+
+if len(args) != 2:
+	print("\n\nUsage:\nblender --background --python export-animation.py -- <infile.blend>[:collection] <outfile.anim>\nExports the actions of objects in collection (default: master collection) as keyframe animation clips, one clip per action.\n")
+	exit(1)
+
+
+infile = args[0]
+collection_name = None
+m = re.match(r'^(.*?):(.+)$', infile)
+if m:
+	infile = m.group(1)
+	collection_name = m.group(2)
+outfile = args[1]
+
+print("Will export actions of objects in ",end="")
+if collection_name:
+	print("collection '" + collection_name + "'",end="")
+else:
+	print('master collection',end="")
+print(" of '" + infile + "' to '" + outfile + "'.")
+
+
+import bpy
+import mathutils
+import struct
+import math
+
+#---------------------------------------------------------------------
+#Export animation:
+
+bpy.ops.wm.open_mainfile(filepath=infile)
+
+if collection_name:
+	if not collection_name in bpy.data.collections:
+		print("ERROR: Collection '" + collection_name + "' does not exist in scene.")
+		exit(1)
+	collection = bpy.data.collections[collection_name]
+else:
+	collection = bpy.context.scene.collection
+
+#Animation file format (see SceneFile.hpp):
+# str0 len < char > * [strings chunk]
+# anm0 len < uint uint uint uint float > * [clip name + track range + duration]
+# trk0 len < uint uint uint uint uint > * [transform name + channel + keyframe range]
+# tim0 len < float > * [keyframe times]
+# key0 len < float4 > * [keyframe values]
+
+strings_data = b""
+clip_data = b""
+track_data = b""
+time_data = b""
+key_data = b""
+
+track_count = 0
+key_count = 0
+
+#write_string will add a string to the strings section and return a packed (begin,end) reference:
+def write_string(string):
+	global strings_data
+	begin = len(strings_data)
+	strings_data += bytes(string, 'utf8')
+	end = len(strings_data)
+	return struct.pack('II', begin, end)
+
+#which fcurve data paths feed which channel (0: position; 1: rotation; 2: scale):
+CHANNELS = {
+	'location':0,
+	'rotation_quaternion':1,
+	'rotation_euler':1,
+	'rotation_axis_angle':1,
+	'scale':2,
+}
+
+fps = bpy.context.scene.render.fps / bpy.context.scene.render.fps_base
+
+#group objects by the action they play:
+# n.b. only each object's active action is exported (not NLA strips), and objects inside
+#  instanced collections are skipped, since their names aren't unique in the exported scene.
+action_objects = dict()
+for obj in collection.all_objects:
+	if obj.animation_data == None or obj.animation_data.action == None: continue
+	action = obj.animation_data.action
+	if action not in action_objects: action_objects[action] = []
+	action_objects[action].append(obj)
+
+for action in sorted(action_objects.keys(), key=lambda a: a.name):
+	objs = action_objects[action]
+	frame_start, frame_end = action.frame_range
+	print("clip: " + action.name + " (frames " + str(frame_start) + " to " + str(frame_end) + ", " + str(len(objs)) + " objects)")
+
+	#frames with keys in each channel:
+	channel_frames = [set(), set(), set()]
+	for fcurve in action.fcurves:
+		if fcurve.data_path not in CHANNELS:
+			print("  Skipping fcurve '" + fcurve.data_path + "'")
+			continue
+		for point in fcurve.keyframe_points:
+			channel_frames[CHANNELS[fcurve.data_path]].add(point.co.x)
+
+	track_begin = track_count
+	for obj in objs:
+		for channel in range(0,3):
+			frames = sorted(channel_frames[channel])
+			if len(frames) == 0: continue
+
+			#sample the transform relative to the parent (as in export-scene.py) at each keyframe:
+			# (keyframe positions may be fractional, so set the subframe as well)
+			times = b""
+			keys = b""
+			for frame in frames:
+				bpy.context.scene.frame_set(int(math.floor(frame)), subframe=frame - math.floor(frame))
+				if obj.parent == None:
+					world_to_parent = mathutils.Matrix()
+				else:
+					world_to_parent = obj.parent.matrix_world.copy()
+					world_to_parent.invert()
+				transform = (world_to_parent @ obj.matrix_world).decompose()
+				times += struct.pack('f', (frame - frame_start) / fps)
+				if channel == 0:
+					keys += struct.pack('4f', transform[0].x, transform[0].y, transform[0].z, 0.0)
+				elif channel == 1:
+					keys += struct.pack('4f', transform[1].x, transform[1].y, transform[1].z, transform[1].w)
+				else:
+					keys += struct.pack('4f', transform[2].x, transform[2].y, transform[2].z, 0.0)
+
+			track_data += write_string(obj.name)
+			track_data += struct.pack('III', channel, key_count, key_count + len(frames))
+			time_data += times
+			key_data += keys
+			key_count += len(frames)
+			track_count += 1
+			print("  track: " + obj.name + " / " + ['position','rotation','scale'][channel] + " (" + str(len(frames)) + " keys)")
+
+	clip_data += write_string(action.name)
+	clip_data += struct.pack('II', track_begin, track_count)
+	clip_data += struct.pack('f', (frame_end - frame_start) / fps)
+
+#write the chunks to an output blob:
+blob = open(outfile, 'wb')
+def write_chunk(magic, data):
+	blob.write(struct.pack('4s',magic)) #type
+	blob.write(struct.pack('I', len(data))) #length
+	blob.write(data)
+
+write_chunk(b'str0', strings_data)
+write_chunk(b'anm0', clip_data)
+write_chunk(b'trk0', track_data)
+write_chunk(b'tim0', time_data)
+write_chunk(b'key0', key_data)
+
+print("Wrote " + str(blob.tell()) + " bytes to '" + outfile + "'")
+blob.close()
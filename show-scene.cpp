@@ -107,21 +107,28 @@ int main(int argc, char **argv) {
 	if (scene_file != "") {
 		try {
 			scene = new Scene();
-			scene->load(scene_file, [&buffer,&buffer_vao](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
-				if (!buffer_vao) return;
-				Mesh const &mesh = buffer->lookup(mesh_name);
-
-				scene.drawables.emplace_back(transform);
-				Scene::Drawable &drawable = scene.drawables.back();
-
-				drawable.pipeline = show_scene_program_pipeline;
-
-				drawable.pipeline.vao = buffer_vao;
-				drawable.pipeline.type = mesh.type;
-				drawable.pipeline.start = mesh.start;
-				drawable.pipeline.count = mesh.count;
-
-			});
+			if (buffer) {
+				scene->load(scene_file, *buffer, [&buffer_vao](Scene &scene, Scene::Drawable &drawable){
+					Scene::Drawable::Pipeline mesh = drawable.pipeline;
+
+					drawable.pipeline = show_scene_program_pipeline;
+
+					drawable.pipeline.vao = buffer_vao;
+					drawable.pipeline.type = mesh.type;
+					drawable.pipeline.indexed = mesh.indexed;
+					drawable.pipeline.start = mesh.start;
+					drawable.pipeline.count = mesh.count;
+					drawable.pipeline.quantized = mesh.quantized;
+					drawable.pipeline.lods = mesh.lods;
+					drawable.pipeline.clusters = mesh.clusters;
+					drawable.pipeline.cluster_count = mesh.cluster_count;
+					drawable.pipeline.min = mesh.min;
+					drawable.pipeline.max = mesh.max;
+				});
+			} else {
+				scene->load(scene_file);
+			}
+			scene->occlusion_culling = true; //(ShowSceneMode shows how many drawables this skips)
 		} catch (std::exception &e) {
 			std::cerr << "ERROR loading scene '" << scene_file << "': " << e.what() << std::endl;
 			usage = true;
@@ -0,0 +1,332 @@
+//test-bvh: checks DynamicBVH against brute-force loops over the same boxes, and times both.
+//
+//usage:
+//  test-bvh [object count (default 10000)] [query count (default 1000)]
+//
+//Builds a tree over random boxes, then checks its structure and compares the results of box, sphere,
+// ray, and nearest queries with brute-force answers -- after inserting, after moving every object
+// (small moves, which stay inside their fattened bounds, and big ones, which restructure the tree),
+// and after removing half of them. Exits with status 1 if anything disagrees.
+
+#include "DynamicBVH.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+	struct Box {
+		glm::vec3 min, max;
+		bool alive = true;
+		DynamicBVH::Proxy proxy = DynamicBVH::Null;
+	};
+
+	//same tests as DynamicBVH.cpp, written out again so the brute-force answers don't share its code:
+	bool overlaps(Box const &b, glm::vec3 const &min, glm::vec3 const &max) {
+		return b.min.x <= max.x && min.x <= b.max.x
+		    && b.min.y <= max.y && min.y <= b.max.y
+		    && b.min.z <= max.z && min.z <= b.max.z;
+	}
+	float distance2(Box const &b, glm::vec3 const &point) {
+		glm::vec3 d = point - glm::clamp(point, b.min, b.max);
+		return glm::dot(d, d);
+	}
+	bool ray_hits(Box const &b, glm::vec3 const &origin, glm::vec3 const &direction, float max_t) {
+		float enter = 0.0f, exit = max_t;
+		for (uint32_t c = 0; c < 3; ++c) {
+			float t0 = (b.min[c] - origin[c]) / direction[c];
+			float t1 = (b.max[c] - origin[c]) / direction[c];
+			enter = std::max(enter, std::min(t0, t1));
+			exit = std::min(exit, std::max(t0, t1));
+		}
+		return enter <= exit;
+	}
+
+	double seconds_since(std::chrono::high_resolution_clock::time_point before) {
+		return std::chrono::duration< double >(std::chrono::high_resolution_clock::now() - before).count();
+	}
+
+	uint32_t failures = 0;
+	void fail(std::string const &what) {
+		if (failures < 10) std::cerr << "FAIL: " << what << std::endl;
+		failures += 1;
+	}
+
+	//check links, bounds, heights, and leaf count of the whole tree:
+	void check_structure(DynamicBVH const &bvh, std::vector< Box > const &boxes) {
+		if (bvh.root == DynamicBVH::Null) {
+			if (bvh.size() != 0) fail("empty tree with size " + std::to_string(bvh.size()));
+			return;
+		}
+		if (bvh.nodes[bvh.root].parent != DynamicBVH::Null) fail("root has a parent");
+
+		size_t leaves = 0;
+		std::vector< DynamicBVH::Proxy > stack{ bvh.root };
+		while (!stack.empty()) {
+			DynamicBVH::Proxy index = stack.back();
+			stack.pop_back();
+			DynamicBVH::Node const &node = bvh.nodes[index];
+			if (node.is_leaf()) {
+				leaves += 1;
+				if (node.height != 0) fail("leaf with height " + std::to_string(node.height));
+				Box const &box = *static_cast< Box const * >(node.user);
+				if (box.proxy != index || !box.alive) fail("leaf doesn't belong to a live box");
+				if (node.tight_min != box.min || node.tight_max != box.max) fail("leaf's exact bounds aren't its box's");
+				if (glm::any(glm::greaterThan(node.min, node.tight_min)) || glm::any(glm::lessThan(node.max, node.tight_max))) fail("leaf's fat bounds don't contain its box");
+				continue;
+			}
+			DynamicBVH::Node const &a = bvh.nodes[node.child[0]];
+			DynamicBVH::Node const &b = bvh.nodes[node.child[1]];
+			if (a.parent != index || b.parent != index) fail("child doesn't point back at its parent");
+			if (node.height != 1 + std::max(a.height, b.height)) fail("wrong height");
+			if (node.min != glm::min(a.min, b.min) || node.max != glm::max(a.max, b.max)) fail("node bounds aren't the union of its children's");
+			stack.emplace_back(node.child[0]);
+			stack.emplace_back(node.child[1]);
+		}
+		if (leaves != bvh.size()) fail(std::to_string(leaves) + " leaves in a tree of size " + std::to_string(bvh.size()));
+
+		size_t alive = 0;
+		for (auto const &box : boxes) {
+			if (box.alive) alive += 1;
+		}
+		if (alive != bvh.size()) fail(std::to_string(alive) + " live boxes in a tree of size " + std::to_string(bvh.size()));
+	}
+
+	//run every kind of query both ways, compare, and print timings:
+	void check_queries(DynamicBVH const &bvh, std::vector< Box > const &boxes, uint32_t query_count, std::mt19937 &mt, char const *when) {
+		std::uniform_real_distribution< float > coord(0.0f, 100.0f);
+		std::uniform_real_distribution< float > extent(0.5f, 8.0f);
+		std::uniform_real_distribution< float > unit(-1.0f, 1.0f);
+
+		struct Query {
+			glm::vec3 min, max; //box
+			glm::vec3 center; float radius; //sphere
+			glm::vec3 origin, direction; float max_t; //ray
+		};
+		std::vector< Query > queries(query_count);
+		for (auto &q : queries) {
+			glm::vec3 at(coord(mt), coord(mt), coord(mt));
+			glm::vec3 half(extent(mt), extent(mt), extent(mt));
+			q.min = at - half;
+			q.max = at + half;
+			q.center = at;
+			q.radius = half.x;
+			q.origin = glm::vec3(coord(mt), coord(mt), coord(mt));
+			do {
+				q.direction = glm::vec3(unit(mt), unit(mt), unit(mt));
+			} while (glm::dot(q.direction, q.direction) < 0.01f);
+			q.direction = glm::normalize(q.direction);
+			q.max_t = 50.0f;
+		}
+
+		std::vector< std::vector< Box const * > > brute(query_count), tree(query_count);
+		auto compare = [&](char const *kind) {
+			for (uint32_t i = 0; i < query_count; ++i) {
+				std::sort(brute[i].begin(), brute[i].end());
+				std::sort(tree[i].begin(), tree[i].end());
+				if (brute[i] != tree[i]) {
+					fail(std::string(kind) + " query " + std::to_string(i) + " " + when + ": " + std::to_string(tree[i].size()) + " found, " + std::to_string(brute[i].size()) + " expected");
+				}
+				brute[i].clear();
+				tree[i].clear();
+			}
+		};
+		auto report = [&](char const *kind, double brute_time, double tree_time, size_t results) {
+			std::cout << "  " << kind << ": brute force " << (brute_time / query_count * 1e6) << "us, bvh " << (tree_time / query_count * 1e6) << "us per query"
+			          << " (" << (brute_time / tree_time) << "x; " << (double(results) / query_count) << " results per query)" << std::endl;
+		};
+
+		std::cout << when << ", " << bvh.size() << " objects, tree height " << (bvh.root == DynamicBVH::Null ? 0 : bvh.nodes[bvh.root].height) << ":" << std::endl;
+
+		{ //boxes:
+			auto before = std::chrono::high_resolution_clock::now();
+			for (uint32_t i = 0; i < query_count; ++i) {
+				for (auto const &box : boxes) {
+					if (box.alive && overlaps(box, queries[i].min, queries[i].max)) brute[i].emplace_back(&box);
+				}
+			}
+			double brute_time = seconds_since(before);
+			before = std::chrono::high_resolution_clock::now();
+			size_t results = 0;
+			for (uint32_t i = 0; i < query_count; ++i) {
+				bvh.query_box(queries[i].min, queries[i].max, [&](DynamicBVH::Proxy proxy) {
+					tree[i].emplace_back(static_cast< Box const * >(bvh.user(proxy)));
+					return true;
+				});
+				results += tree[i].size();
+			}
+			report("box", brute_time, seconds_since(before), results);
+			compare("box");
+		}
+
+		{ //spheres:
+			auto before = std::chrono::high_resolution_clock::now();
+			for (uint32_t i = 0; i < query_count; ++i) {
+				float r2 = queries[i].radius * queries[i].radius;
+				for (auto const &box : boxes) {
+					if (box.alive && distance2(box, queries[i].center) <= r2) brute[i].emplace_back(&box);
+				}
+			}
+			double brute_time = seconds_since(before);
+			before = std::chrono::high_resolution_clock::now();
+			size_t results = 0;
+			for (uint32_t i = 0; i < query_count; ++i) {
+				bvh.query_sphere(queries[i].center, queries[i].radius, [&](DynamicBVH::Proxy proxy) {
+					tree[i].emplace_back(static_cast< Box const * >(bvh.user(proxy)));
+					return true;
+				});
+				results += tree[i].size();
+			}
+			report("sphere", brute_time, seconds_since(before), results);
+			compare("sphere");
+		}
+
+		{ //rays (every box hit, so the answers can be compared as sets):
+			auto before = std::chrono::high_resolution_clock::now();
+			for (uint32_t i = 0; i < query_count; ++i) {
+				for (auto const &box : boxes) {
+					if (box.alive && ray_hits(box, queries[i].origin, queries[i].direction, queries[i].max_t)) brute[i].emplace_back(&box);
+				}
+			}
+			double brute_time = seconds_since(before);
+			before = std::chrono::high_resolution_clock::now();
+			size_t results = 0;
+			for (uint32_t i = 0; i < query_count; ++i) {
+				bvh.ray_cast(queries[i].origin, queries[i].direction, queries[i].max_t, [&](DynamicBVH::Proxy proxy, float) {
+					tree[i].emplace_back(static_cast< Box const * >(bvh.user(proxy)));
+					return queries[i].max_t;
+				});
+				results += tree[i].size();
+			}
+			report("ray", brute_time, seconds_since(before), results);
+			compare("ray");
+		}
+
+		{ //nearest (compared by distance, since ties may pick either box):
+			std::vector< float > brute_d(query_count), tree_d(query_count);
+			auto before = std::chrono::high_resolution_clock::now();
+			for (uint32_t i = 0; i < query_count; ++i) {
+				float best2 = std::numeric_limits< float >::infinity();
+				for (auto const &box : boxes) {
+					if (box.alive) best2 = std::min(best2, distance2(box, queries[i].origin));
+				}
+				brute_d[i] = std::sqrt(best2);
+			}
+			double brute_time = seconds_since(before);
+			before = std::chrono::high_resolution_clock::now();
+			for (uint32_t i = 0; i < query_count; ++i) {
+				tree_d[i] = std::numeric_limits< float >::infinity();
+				bvh.nearest(queries[i].origin, std::numeric_limits< float >::infinity(), &tree_d[i]);
+			}
+			report("nearest", brute_time, seconds_since(before), (bvh.size() ? query_count : 0));
+			for (uint32_t i = 0; i < query_count; ++i) {
+				if (brute_d[i] != tree_d[i] && !(std::abs(brute_d[i] - tree_d[i]) <= 1e-5f * (1.0f + brute_d[i]))) {
+					fail("nearest query " + std::to_string(i) + " " + when + ": distance " + std::to_string(tree_d[i]) + ", expected " + std::to_string(brute_d[i]));
+				}
+			}
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+	uint32_t object_count = 10000;
+	uint32_t query_count = 1000;
+	if (argc > 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [object count (default 10000)] [query count (default 1000)]" << std::endl;
+		return 1;
+	}
+	if (argc > 1) object_count = uint32_t(std::max(1, std::atoi(argv[1])));
+	if (argc > 2) query_count = uint32_t(std::max(1, std::atoi(argv[2])));
+
+	std::mt19937 mt(0x15466);
+	std::uniform_real_distribution< float > coord(0.0f, 100.0f);
+	std::uniform_real_distribution< float > size(0.1f, 2.0f);
+	std::uniform_real_distribution< float > nudge(-0.05f, 0.05f); //(less than DynamicBVH::margin)
+
+	//(boxes never move in memory, so the tree's user pointers stay good)
+	std::vector< Box > boxes(object_count);
+	for (auto &box : boxes) {
+		box.min = glm::vec3(coord(mt), coord(mt), coord(mt));
+		box.max = box.min + glm::vec3(size(mt), size(mt), size(mt));
+	}
+
+	DynamicBVH bvh;
+	{ //insert:
+		auto before = std::chrono::high_resolution_clock::now();
+		for (auto &box : boxes) {
+			box.proxy = bvh.insert(box.min, box.max, &box);
+		}
+		std::cout << "insert: " << (seconds_since(before) / object_count * 1e6) << "us per object" << std::endl;
+	}
+	check_structure(bvh, boxes);
+	check_queries(bvh, boxes, query_count, mt, "after inserting");
+
+	{ //small moves (refit-free; exact bounds change, fat bounds don't):
+		uint32_t restructured = 0;
+		auto before = std::chrono::high_resolution_clock::now();
+		for (auto &box : boxes) {
+			glm::vec3 d(nudge(mt), nudge(mt), nudge(mt));
+			box.min += d;
+			box.max += d;
+			if (bvh.move(box.proxy, box.min, box.max)) restructured += 1;
+		}
+		std::cout << "small moves: " << (seconds_since(before) / object_count * 1e6) << "us per object, " << restructured << " restructured" << std::endl;
+	}
+	check_structure(bvh, boxes);
+	check_queries(bvh, boxes, query_count, mt, "after small moves");
+
+	{ //big moves (every object leaves its fat bounds, so the tree is rebuilt leaf by leaf):
+		uint32_t restructured = 0;
+		auto before = std::chrono::high_resolution_clock::now();
+		for (auto &box : boxes) {
+			glm::vec3 extent = box.max - box.min;
+			box.min = glm::vec3(coord(mt), coord(mt), coord(mt));
+			box.max = box.min + extent;
+			if (bvh.move(box.proxy, box.min, box.max)) restructured += 1;
+		}
+		std::cout << "big moves: " << (seconds_since(before) / object_count * 1e6) << "us per object, " << restructured << " restructured" << std::endl;
+	}
+	check_structure(bvh, boxes);
+	check_queries(bvh, boxes, query_count, mt, "after big moves");
+
+	{ //remove every other object, then re-insert a few into the freed nodes:
+		auto before = std::chrono::high_resolution_clock::now();
+		for (size_t i = 0; i < boxes.size(); i += 2) {
+			bvh.remove(boxes[i].proxy);
+			boxes[i].alive = false;
+			boxes[i].proxy = DynamicBVH::Null;
+		}
+		std::cout << "remove: " << (seconds_since(before) / ((object_count + 1) / 2) * 1e6) << "us per object" << std::endl;
+		size_t node_count = bvh.nodes.size();
+		for (size_t i = 0; i < boxes.size(); i += 8) {
+			boxes[i].alive = true;
+			boxes[i].proxy = bvh.insert(boxes[i].min, boxes[i].max, &boxes[i]);
+		}
+		if (bvh.nodes.size() != node_count) fail("re-inserting didn't reuse freed nodes");
+	}
+	check_structure(bvh, boxes);
+	check_queries(bvh, boxes, query_count, mt, "after removing");
+
+	{ //remove everything:
+		for (auto &box : boxes) {
+			if (!box.alive) continue;
+			bvh.remove(box.proxy);
+			box.alive = false;
+		}
+		check_structure(bvh, boxes);
+		if (bvh.root != DynamicBVH::Null) fail("tree isn't empty after removing everything");
+	}
+
+	if (failures) {
+		std::cout << failures << " check(s) failed." << std::endl;
+		return 1;
+	}
+	std::cout << "All checks passed." << std::endl;
+	return 0;
+}
@@ -0,0 +1,415 @@
+//test-collision-mesh: checks CollisionMesh queries -- with both its SSE2 and plain C++ lanes -- against
+// brute-force loops over the same triangles, checks the per-triangle sweep test on its own, and times it all.
+//
+//usage:
+//  test-collision-mesh [triangle count (default 10000)] [query count (default 1000)]
+//
+//Builds collision meshes from random triangle soup and from a bumpy grid (whose triangles share edges), then
+// compares ray casts, sphere and capsule sweeps, and box queries with answers found by testing every triangle.
+// The SSE2 and plain lanes must also agree with each other. Separately, sweep_triangle() is checked against
+// distances sampled along the motion. Exits with status 1 if anything disagrees.
+// (where SSE2 isn't compiled in, CollisionMesh::SSE2 runs the plain lanes, so those comparisons pass trivially)
+
+#include "CollisionMesh.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+	struct Soup {
+		std::vector< glm::vec3 > positions;
+		std::vector< uint32_t > indices;
+		size_t triangle_count() const { return indices.size() / 3; }
+		glm::vec3 const &corner(size_t triangle, uint32_t c) const { return positions[indices[3 * triangle + c]]; }
+	};
+
+	//(written out again here, in double precision, so the brute-force answers don't share CollisionMesh's code)
+	typedef glm::dvec3 D3;
+	D3 d3(glm::vec3 const &v) { return D3(v.x, v.y, v.z); }
+
+	//Moller-Trumbore, from either side:
+	bool ray_triangle(glm::vec3 const &origin, glm::vec3 const &direction, glm::vec3 const &a_, glm::vec3 const &b_, glm::vec3 const &c_, double *t) {
+		D3 o = d3(origin), d = d3(direction), a = d3(a_);
+		D3 e1 = d3(b_) - a, e2 = d3(c_) - a;
+		D3 p = glm::cross(d, e2);
+		double det = glm::dot(e1, p);
+		if (det == 0.0) return false;
+		D3 s = o - a;
+		double u = glm::dot(s, p) / det;
+		if (u < 0.0 || u > 1.0) return false;
+		D3 q = glm::cross(s, e1);
+		double v = glm::dot(d, q) / det;
+		if (v < 0.0 || u + v > 1.0) return false;
+		*t = glm::dot(e2, q) / det;
+		return *t >= 0.0;
+	}
+
+	double point_segment_distance(D3 const &p, D3 const &a, D3 const &b) {
+		D3 ab = b - a;
+		double l2 = glm::dot(ab, ab);
+		double s = (l2 > 0.0 ? std::max(0.0, std::min(1.0, glm::dot(p - a, ab) / l2)) : 0.0);
+		return glm::length(p - (a + s * ab));
+	}
+
+	//inside the triangle's outline: distance to the plane; otherwise: distance to the nearest edge:
+	double point_triangle_distance(D3 const &p, D3 const &a, D3 const &b, D3 const &c) {
+		D3 n = glm::cross(b - a, c - a);
+		double n2 = glm::dot(n, n);
+		if (n2 > 0.0) {
+			D3 x = p - n * (glm::dot(p - a, n) / n2);
+			if (glm::dot(glm::cross(b - a, x - a), n) >= 0.0 && glm::dot(glm::cross(c - b, x - b), n) >= 0.0 && glm::dot(glm::cross(a - c, x - c), n) >= 0.0) {
+				return std::abs(glm::dot(p - a, n)) / std::sqrt(n2);
+			}
+		}
+		return std::min(point_segment_distance(p, a, b), std::min(point_segment_distance(p, b, c), point_segment_distance(p, c, a)));
+	}
+
+	//distance from segment p-q to triangle abc, sampled at 'Samples' points along the segment:
+	// (never less than the true distance, and at most |q - p| / (2 * (Samples - 1)) more)
+	constexpr uint32_t Samples = 65;
+	double sampled_distance(D3 const &p, D3 const &q, D3 const &a, D3 const &b, D3 const &c) {
+		double best = std::numeric_limits< double >::infinity();
+		for (uint32_t i = 0; i < Samples; ++i) {
+			best = std::min(best, point_triangle_distance(p + (q - p) * (double(i) / (Samples - 1)), a, b, c));
+		}
+		return best;
+	}
+
+	bool box_overlaps(Soup const &soup, size_t t, glm::vec3 const &min, glm::vec3 const &max) {
+		for (uint32_t axis = 0; axis < 3; ++axis) {
+			float lo = std::min(std::min(soup.corner(t, 0)[axis], soup.corner(t, 1)[axis]), soup.corner(t, 2)[axis]);
+			float hi = std::max(std::max(soup.corner(t, 0)[axis], soup.corner(t, 1)[axis]), soup.corner(t, 2)[axis]);
+			if (lo > max[axis] || hi < min[axis]) return false;
+		}
+		return true;
+	}
+
+	double seconds_since(std::chrono::high_resolution_clock::time_point before) {
+		return std::chrono::duration< double >(std::chrono::high_resolution_clock::now() - before).count();
+	}
+
+	uint32_t failures = 0;
+	void fail(std::string const &what) {
+		if (failures < 10) std::cerr << "FAIL: " << what << std::endl;
+		failures += 1;
+	}
+
+	//t values from different code (float vs double, or differently-ordered float math) agree this closely:
+	bool close(double a, double b) {
+		return std::abs(a - b) <= 1e-4 * (1.0 + std::abs(a) + std::abs(b));
+	}
+
+	//compare a query's answer with the brute-force one:
+	// (on ties -- e.g., a ray through a shared edge -- any of the tied triangles is right, so check the t
+	//  the brute force finds for the reported triangle instead of comparing triangle indices)
+	void check_hit(char const *what, bool found, CollisionMesh::Hit const &hit, bool brute_found, double brute_t, std::function< bool(uint32_t, double *) > const &triangle_t) {
+		if (found != brute_found) {
+			fail(std::string(what) + (found ? " hit (t = " + std::to_string(hit.t) + ")" : " missed") + ", but brute force " + (brute_found ? "hit (t = " + std::to_string(brute_t) + ")" : "missed"));
+			return;
+		}
+		if (!found) return;
+		if (!close(hit.t, brute_t)) fail(std::string(what) + " hit at t = " + std::to_string(hit.t) + ", brute force at t = " + std::to_string(brute_t));
+		double own_t;
+		if (!triangle_t(hit.triangle, &own_t) || !close(own_t, brute_t)) fail(std::string(what) + " reported triangle " + std::to_string(hit.triangle) + ", which isn't first");
+		if (!(std::abs(glm::length(hit.normal) - 1.0f) < 1e-3f)) fail(std::string(what) + " normal isn't unit length");
+	}
+
+	//two lanes of the same mesh should give the same answers:
+	void check_same(char const *what, bool found_a, CollisionMesh::Hit const &a, bool found_b, CollisionMesh::Hit const &b) {
+		if (found_a != found_b || (found_a && !close(a.t, b.t))) {
+			fail(std::string(what) + ": SSE2 and plain lanes disagree");
+		}
+	}
+
+	struct Timings {
+		double brute = 0.0, plain = 0.0, sse = 0.0;
+		void print(char const *kind, uint32_t count) const {
+			std::cout << "  " << kind << ": brute force " << (brute / count * 1e6) << "us, plain lanes " << (plain / count * 1e6)
+				<< "us, SSE2 lanes " << (sse / count * 1e6) << "us per query" << std::endl;
+		}
+	};
+
+	void check_queries(Soup const &soup, uint32_t query_count, std::mt19937 &mt, char const *name) {
+		auto before = std::chrono::high_resolution_clock::now();
+		CollisionMesh plain(soup.indices.data(), soup.indices.size(), soup.positions.data(), sizeof(glm::vec3));
+		std::cout << name << ", " << soup.triangle_count() << " triangles: built in " << (seconds_since(before) * 1e3) << "ms, "
+			<< plain.nodes.size() << " nodes, " << plain.packets.size() << " packets" << std::endl;
+		plain.lanes = CollisionMesh::Scalar;
+		CollisionMesh sse = plain;
+		sse.lanes = CollisionMesh::SSE2;
+
+		if (plain.triangle_count != soup.triangle_count()) fail("mesh has " + std::to_string(plain.triangle_count) + " triangles");
+
+		std::uniform_real_distribution< float > coord(-12.0f, 12.0f);
+		std::uniform_real_distribution< float > unit(-1.0f, 1.0f);
+		std::uniform_real_distribution< float > amount(0.0f, 1.0f);
+		auto random_direction = [&]() {
+			glm::vec3 d;
+			do {
+				d = glm::vec3(unit(mt), unit(mt), unit(mt));
+			} while (glm::dot(d, d) > 1.0f || glm::dot(d, d) < 1e-4f);
+			return glm::normalize(d);
+		};
+
+		//rays:
+		{
+			Timings timings;
+			for (uint32_t q = 0; q < query_count; ++q) {
+				glm::vec3 origin = glm::vec3(coord(mt), coord(mt), coord(mt));
+				glm::vec3 direction = random_direction() * (0.5f + amount(mt));
+				float max_t = 40.0f * amount(mt);
+
+				auto t0 = std::chrono::high_resolution_clock::now();
+				bool brute_found = false;
+				double brute_t = max_t;
+				for (size_t t = 0; t < soup.triangle_count(); ++t) {
+					double hit_t;
+					if (ray_triangle(origin, direction, soup.corner(t, 0), soup.corner(t, 1), soup.corner(t, 2), &hit_t) && hit_t <= brute_t) {
+						brute_t = hit_t;
+						brute_found = true;
+					}
+				}
+				auto t1 = std::chrono::high_resolution_clock::now();
+				CollisionMesh::Hit plain_hit, sse_hit;
+				bool plain_found = plain.ray_cast(origin, direction, max_t, &plain_hit);
+				auto t2 = std::chrono::high_resolution_clock::now();
+				bool sse_found = sse.ray_cast(origin, direction, max_t, &sse_hit);
+				timings.brute += std::chrono::duration< double >(t1 - t0).count();
+				timings.plain += std::chrono::duration< double >(t2 - t1).count();
+				timings.sse += seconds_since(t2);
+
+				//(rays that graze an edge can be called either way by float and double math, so skip near-misses)
+				if (plain_found != brute_found) {
+					CollisionMesh::Hit found_hit = (plain_found ? plain_hit : CollisionMesh::Hit());
+					double grazing_t = (plain_found ? found_hit.t : brute_t);
+					glm::vec3 at = origin + float(grazing_t) * direction;
+					bool near_edge = false;
+					for (size_t t = 0; t < soup.triangle_count() && !near_edge; ++t) {
+						for (uint32_t e = 0; e < 3; ++e) {
+							near_edge = near_edge || point_segment_distance(d3(at), d3(soup.corner(t, e)), d3(soup.corner(t, (e + 1) % 3))) < 1e-4;
+						}
+					}
+					if (near_edge) continue;
+				}
+				auto triangle_t = [&](uint32_t t, double *hit_t) {
+					return t < soup.triangle_count() && ray_triangle(origin, direction, soup.corner(t, 0), soup.corner(t, 1), soup.corner(t, 2), hit_t);
+				};
+				check_hit("ray (plain)", plain_found, plain_hit, brute_found, brute_t, triangle_t);
+				check_hit("ray (SSE2)", sse_found, sse_hit, brute_found, brute_t, triangle_t);
+				check_same("ray", plain_found, plain_hit, sse_found, sse_hit);
+			}
+			timings.print("rays", query_count);
+		}
+
+		//spheres and capsules:
+		for (uint32_t capsule = 0; capsule < 2; ++capsule) {
+			Timings timings;
+			for (uint32_t q = 0; q < query_count; ++q) {
+				glm::vec3 a = glm::vec3(coord(mt), coord(mt), coord(mt));
+				glm::vec3 b = (capsule ? a + random_direction() * (2.0f * amount(mt)) : a);
+				float radius = 0.05f + 0.5f * amount(mt);
+				glm::vec3 displacement = random_direction() * (10.0f * amount(mt));
+
+				auto t0 = std::chrono::high_resolution_clock::now();
+				bool brute_found = false;
+				float brute_t = 1.0f;
+				for (size_t t = 0; t < soup.triangle_count(); ++t) {
+					float hit_t;
+					glm::vec3 point, normal;
+					if (CollisionMesh::sweep_triangle(a, b, radius, displacement, soup.corner(t, 0), soup.corner(t, 1), soup.corner(t, 2), brute_t, &hit_t, &point, &normal)
+					 && (!brute_found || hit_t < brute_t)) {
+						brute_t = hit_t;
+						brute_found = true;
+					}
+				}
+				auto t1 = std::chrono::high_resolution_clock::now();
+				CollisionMesh::Hit plain_hit, sse_hit;
+				bool plain_found = (capsule ? plain.sweep_capsule(a, b, radius, displacement, &plain_hit) : plain.sweep_sphere(a, radius, displacement, &plain_hit));
+				auto t2 = std::chrono::high_resolution_clock::now();
+				bool sse_found = (capsule ? sse.sweep_capsule(a, b, radius, displacement, &sse_hit) : sse.sweep_sphere(a, radius, displacement, &sse_hit));
+				timings.brute += std::chrono::duration< double >(t1 - t0).count();
+				timings.plain += std::chrono::duration< double >(t2 - t1).count();
+				timings.sse += seconds_since(t2);
+
+				auto triangle_t = [&](uint32_t t, double *hit_t) {
+					float found_t;
+					glm::vec3 point, normal;
+					if (t >= soup.triangle_count()) return false;
+					if (!CollisionMesh::sweep_triangle(a, b, radius, displacement, soup.corner(t, 0), soup.corner(t, 1), soup.corner(t, 2), 1.0f, &found_t, &point, &normal)) return false;
+					*hit_t = found_t;
+					return true;
+				};
+				char const *kind = (capsule ? "capsule" : "sphere");
+				check_hit((std::string(kind) + " (plain)").c_str(), plain_found, plain_hit, brute_found, brute_t, triangle_t);
+				check_hit((std::string(kind) + " (SSE2)").c_str(), sse_found, sse_hit, brute_found, brute_t, triangle_t);
+				check_same(kind, plain_found, plain_hit, sse_found, sse_hit);
+			}
+			timings.print(capsule ? "capsules" : "spheres", query_count);
+		}
+
+		//boxes:
+		{
+			Timings timings;
+			for (uint32_t q = 0; q < query_count; ++q) {
+				glm::vec3 center = glm::vec3(coord(mt), coord(mt), coord(mt));
+				glm::vec3 half = 2.0f * glm::vec3(amount(mt), amount(mt), amount(mt));
+				glm::vec3 min = center - half, max = center + half;
+
+				auto t0 = std::chrono::high_resolution_clock::now();
+				std::vector< uint32_t > brute;
+				for (size_t t = 0; t < soup.triangle_count(); ++t) {
+					if (box_overlaps(soup, t, min, max)) brute.emplace_back(uint32_t(t));
+				}
+				auto t1 = std::chrono::high_resolution_clock::now();
+				std::vector< uint32_t > plain_found, sse_found;
+				plain.query_box(min, max, [&](uint32_t triangle, glm::vec3 const &, glm::vec3 const &, glm::vec3 const &) {
+					plain_found.emplace_back(triangle);
+					return true;
+				});
+				auto t2 = std::chrono::high_resolution_clock::now();
+				sse.query_box(min, max, [&](uint32_t triangle, glm::vec3 const &, glm::vec3 const &, glm::vec3 const &) {
+					sse_found.emplace_back(triangle);
+					return true;
+				});
+				timings.brute += std::chrono::duration< double >(t1 - t0).count();
+				timings.plain += std::chrono::duration< double >(t2 - t1).count();
+				timings.sse += seconds_since(t2);
+
+				//(corners are stored as a corner and two edges, so bounds can differ from the brute force by rounding)
+				std::sort(plain_found.begin(), plain_found.end());
+				std::sort(sse_found.begin(), sse_found.end());
+				if (plain_found != sse_found) fail("box: SSE2 and plain lanes disagree");
+				std::vector< uint32_t > missing, extra;
+				std::set_difference(brute.begin(), brute.end(), plain_found.begin(), plain_found.end(), std::back_inserter(missing));
+				std::set_difference(plain_found.begin(), plain_found.end(), brute.begin(), brute.end(), std::back_inserter(extra));
+				for (uint32_t t : missing) {
+					if (box_overlaps(soup, t, min + glm::vec3(1e-4f), max - glm::vec3(1e-4f))) fail("box query missed triangle " + std::to_string(t));
+				}
+				for (uint32_t t : extra) {
+					if (!box_overlaps(soup, t, min - glm::vec3(1e-4f), max + glm::vec3(1e-4f))) fail("box query reported triangle " + std::to_string(t) + ", which is outside the box");
+				}
+			}
+			timings.print("boxes", query_count);
+		}
+	}
+
+	//sweep_triangle on its own, against distances sampled along the motion:
+	void check_sweep_triangle(uint32_t case_count, std::mt19937 &mt) {
+		std::uniform_real_distribution< float > unit(-1.0f, 1.0f);
+		std::uniform_real_distribution< float > amount(0.0f, 1.0f);
+		constexpr uint32_t Steps = 200;
+		uint32_t hits = 0;
+		auto before = std::chrono::high_resolution_clock::now();
+		for (uint32_t c = 0; c < case_count; ++c) {
+			glm::vec3 a = glm::vec3(unit(mt), unit(mt), unit(mt));
+			glm::vec3 b = glm::vec3(unit(mt), unit(mt), unit(mt));
+			glm::vec3 tc = glm::vec3(unit(mt), unit(mt), unit(mt));
+			if (c % 8 == 0) tc = a + (b - a) * amount(mt); //(some slivers)
+			glm::vec3 p = 3.0f * glm::vec3(unit(mt), unit(mt), unit(mt));
+			glm::vec3 q = (c % 2 ? p : p + 0.8f * glm::vec3(unit(mt), unit(mt), unit(mt)));
+			float radius = 0.02f + 0.5f * amount(mt);
+			//aim roughly at the triangle, so most cases hit:
+			glm::vec3 d = ((a + b + tc) / 3.0f - 0.5f * (p + q)) * (0.5f + 1.5f * amount(mt)) + 0.5f * glm::vec3(unit(mt), unit(mt), unit(mt));
+
+			float t;
+			glm::vec3 point, normal;
+			bool found = CollisionMesh::sweep_triangle(p, q, radius, d, a, b, tc, 1.0f, &t, &point, &normal);
+
+			D3 P = d3(p), Q = d3(q), D = d3(d), A = d3(a), B = d3(b), C = d3(tc);
+			double sampling = glm::length(Q - P) / (2.0 * (Samples - 1)); //(how much sampled_distance can overestimate)
+			double slack = 1e-4 + 1e-4 * radius;
+			auto distance_at = [&](double at) {
+				return sampled_distance(P + at * D, Q + at * D, A, B, C);
+			};
+			std::string which = "sweep_triangle case " + std::to_string(c);
+
+			//no contact before the reported one (or at all, for a miss):
+			// (sampled distances are never below the true distance, so one below the radius is a real contact)
+			double end = (found ? double(t) : 1.0);
+			for (uint32_t s = 0; s <= Steps; ++s) {
+				double at = end * s / Steps;
+				if (found && at > end - 1e-3) break;
+				if (distance_at(at) < radius - slack) {
+					fail(which + (found ? " hit at t = " + std::to_string(t) + ", but touches already at t = " : " missed, but touches at t = ") + std::to_string(at));
+					break;
+				}
+			}
+			if (!found) continue;
+			hits += 1;
+
+			//touching at the reported t:
+			double distance = distance_at(t);
+			if (distance - sampling > radius + slack) fail(which + " hit at t = " + std::to_string(t) + ", where the distance is " + std::to_string(distance) + " (radius " + std::to_string(radius) + ")");
+			//...at a point on the triangle:
+			if (point_triangle_distance(d3(point), A, B, C) > slack) fail(which + " contact point isn't on the triangle");
+			if (!(std::abs(glm::length(normal) - 1.0f) < 1e-3f)) fail(which + " normal isn't unit length");
+		}
+		std::cout << "sweep_triangle: " << case_count << " cases (" << hits << " hits) checked in " << seconds_since(before) << "s" << std::endl;
+	}
+}
+
+int main(int argc, char **argv) {
+	uint32_t triangle_count = 10000;
+	uint32_t query_count = 1000;
+	if (argc > 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [triangle count (default 10000)] [query count (default 1000)]" << std::endl;
+		return 1;
+	}
+	if (argc > 1) triangle_count = uint32_t(std::max(1, std::atoi(argv[1])));
+	if (argc > 2) query_count = uint32_t(std::max(1, std::atoi(argv[2])));
+
+	std::cout << "queries use " << (CollisionMesh::BestLanes == CollisionMesh::SSE2 ? "SSE2" : "plain (SSE2 isn't compiled in)") << " lanes by default" << std::endl;
+
+	std::mt19937 mt(0x7e57c011);
+
+	{ //random triangle soup:
+		std::uniform_real_distribution< float > coord(-10.0f, 10.0f);
+		std::uniform_real_distribution< float > offset(-1.0f, 1.0f);
+		Soup soup;
+		for (uint32_t t = 0; t < triangle_count; ++t) {
+			glm::vec3 center = glm::vec3(coord(mt), coord(mt), coord(mt));
+			float size = 0.1f + 1.4f * (offset(mt) * 0.5f + 0.5f);
+			for (uint32_t c = 0; c < 3; ++c) {
+				soup.indices.emplace_back(uint32_t(soup.positions.size()));
+				soup.positions.emplace_back(center + size * glm::vec3(offset(mt), offset(mt), offset(mt)));
+			}
+		}
+		check_queries(soup, query_count, mt, "soup");
+	}
+
+	{ //bumpy grid (shared edges and vertices, and big flat-ish areas):
+		std::uniform_real_distribution< float > height(-1.0f, 1.0f);
+		uint32_t size = std::max(2U, uint32_t(std::sqrt(triangle_count / 2.0f)) + 1);
+		Soup soup;
+		for (uint32_t y = 0; y < size; ++y) {
+			for (uint32_t x = 0; x < size; ++x) {
+				soup.positions.emplace_back(glm::vec3(-10.0f + 20.0f * x / (size - 1), -10.0f + 20.0f * y / (size - 1), height(mt)));
+			}
+		}
+		for (uint32_t y = 0; y + 1 < size; ++y) {
+			for (uint32_t x = 0; x + 1 < size; ++x) {
+				uint32_t i = y * size + x;
+				soup.indices.insert(soup.indices.end(), { i, i + 1, i + size + 1, i, i + size + 1, i + size });
+			}
+		}
+		check_queries(soup, query_count, mt, "grid");
+	}
+
+	check_sweep_triangle(query_count, mt);
+
+	if (failures) {
+		std::cout << failures << " check(s) failed." << std::endl;
+		return 1;
+	}
+	std::cout << "All checks passed." << std::endl;
+	return 0;
+}